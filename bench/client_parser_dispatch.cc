@@ -0,0 +1,160 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+
+// Compares the parsing of a FETCH heavy response stream via
+// IMAP::Client::Parser (i.e. virtual callback dispatch) with
+// IMAP::Client::Basic_Parser instantiated for a final handler
+// (i.e. the callbacks can be inlined).
+//
+// Call: bench_dispatch [#responses [#repetitions]]
+
+#include <imap/client_parser.h>
+#include "client_parser_impl.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace std;
+
+namespace {
+
+  // what a downloader typically does with a FETCH response
+  // minus the I/O
+  struct Counter {
+    size_t   fetches  {0};
+    size_t   flags    {0};
+    uint64_t uids     {0};
+    size_t   sections {0};
+    size_t   bytes    {0};
+  };
+
+  class Virtual_Handler : public IMAP::Client::Callback::Null {
+    public:
+      Counter c;
+    protected:
+      void imap_data_fetch_begin(uint32_t number) override
+      {
+        ++c.fetches;
+      }
+      void imap_flag(IMAP::Flag flag) override
+      {
+        ++c.flags;
+      }
+      void imap_uid(uint32_t number) override
+      {
+        c.uids += number;
+      }
+      void imap_body_section_inner() override
+      {
+        ++c.sections;
+      }
+      void imap_literal_slice(const char *begin, size_t n) override
+      {
+        c.bytes += n;
+      }
+  };
+
+  class Inline_Handler final : public IMAP::Client::Callback::Null {
+    private:
+      friend class IMAP::Client::Basic_Parser<Inline_Handler>;
+    public:
+      Counter c;
+    protected:
+      void imap_data_fetch_begin(uint32_t number) override
+      {
+        ++c.fetches;
+      }
+      void imap_flag(IMAP::Flag flag) override
+      {
+        ++c.flags;
+      }
+      void imap_uid(uint32_t number) override
+      {
+        c.uids += number;
+      }
+      void imap_body_section_inner() override
+      {
+        ++c.sections;
+      }
+      void imap_literal_slice(const char *begin, size_t n) override
+      {
+        c.bytes += n;
+      }
+  };
+
+}
+
+template class IMAP::Client::Basic_Parser<Inline_Handler>;
+
+static string create_input(unsigned n)
+{
+  ostringstream o;
+  const string body("From: juser@example.org\r\nSubject: hello\r\n\r\nWorld\r\n");
+  for (unsigned i = 1; i <= n; ++i) {
+    o << "* " << i << " FETCH (UID " << (1000 + i)
+      << " FLAGS (\\Seen \\Answered) BODY[] {" << body.size() << "}\r\n"
+      << body << ")\r\n";
+  }
+  o << "A001 OK Fetch completed.\r\n";
+  return o.str();
+}
+
+template <typename Parser, typename Handler>
+static void bench(const char *name, const string &input, unsigned n, unsigned k)
+{
+  Handler h;
+  Memory::Buffer::Vector buffer;
+  Memory::Buffer::Vector tag_buffer;
+  Parser p(buffer, tag_buffer, h);
+  p.set_slice_literals(true);
+  const char *begin = input.data();
+  const char *end   = begin + input.size();
+  auto start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < k; ++i) {
+    // similar to what is read from a socket at once
+    for (const char *x = begin; x < end; x += 4096)
+      p.read(x, min(x + 4096, end));
+  }
+  auto stop = chrono::steady_clock::now();
+  double s = chrono::duration<double>(stop - start).count();
+  double bytes = double(input.size()) * k;
+  cout << name << ": " << (bytes / s / 1024.0 / 1024.0) << " MiB/s, "
+    << (s * 1e9 / (double(n) * k)) << " ns/response"
+    << " (fetches: " << h.c.fetches << ", flags: " << h.c.flags
+    << ", sections: " << h.c.sections << ", bytes: " << h.c.bytes << ")\n";
+}
+
+int main(int argc, char **argv)
+{
+  unsigned n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  unsigned k = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+  string input(create_input(n));
+  cout << "Input: " << n << " FETCH responses, " << input.size()
+    << " bytes, " << k << " repetitions\n";
+  bench<IMAP::Client::Parser, Virtual_Handler>("virtual", input, n, k);
+  bench<IMAP::Client::Basic_Parser<Inline_Handler>, Inline_Handler>(
+      "inline ", input, n, k);
+  return 0;
+}
@@ -0,0 +1,381 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+
+// Parser throughput benchmark.
+//
+// Replays the recorded IMAP sessions (i.e. the server to client streams
+// through IMAP::Client::Parser and the client to server streams through
+// IMAP::Server::Parser) and some synthetic corpora through the parsers
+// and the MIME decoders. Reports MiB/s and ns per response (or command,
+// header field, KiB).
+//
+// Call: bench_parser [-r REPETITIONS] [TRACE_FILE...]
+//
+// Without trace files, the ones under unittest/ are used.
+//
+// The Ragel code style is selected at configure time, e.g.
+// cmake -DIMAPDL_RAGEL_STYLE=-G2 (or meson -Dragel_style=-G2).
+
+#include "config.h"
+
+#include <imap/client_parser.h>
+#include <imap/server_parser.h>
+#include <mime/header_decoder.h>
+#include <mime/base64_decoder.h>
+#include <trace/trace.h>
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+namespace {
+
+  // the chunks as they were read from/written to the socket
+  struct Stream {
+    vector<string> chunks;
+    size_t         bytes {0};
+
+    void push(const string &s)
+    {
+      chunks.push_back(s);
+      bytes += s.size();
+    }
+  };
+
+  struct Session {
+    string name;
+    Stream received;
+    Stream sent;
+  };
+
+  Session read_trace(const string &filename)
+  {
+    Session session;
+    session.name = fs::path(filename).filename().string();
+    ifstream f(filename, ifstream::in);
+    f.exceptions(ifstream::badbit | ifstream::failbit );
+    boost::archive::text_iarchive iarchive(f);
+    for (;;) {
+      Trace::Record r;
+      iarchive >> r;
+      if (r.type == Trace::Type::END_OF_FILE)
+        break;
+      if (r.type == Trace::Type::RECEIVED)
+        session.received.push(r.message);
+      else if (r.type == Trace::Type::SENT)
+        session.sent.push(r.message);
+    }
+    return session;
+  }
+
+  // counts every complete response
+  class Client_Counter : public IMAP::Client::Callback::Null {
+    public:
+      size_t responses {0};
+    protected:
+      void imap_tagged_status_end(IMAP::Server::Response::Status c) override
+      {
+        ++responses;
+      }
+      void imap_untagged_status_end(IMAP::Server::Response::Status c) override
+      {
+        ++responses;
+      }
+      void imap_data_exists(uint32_t number) override
+      {
+        ++responses;
+      }
+      void imap_data_recent(uint32_t number) override
+      {
+        ++responses;
+      }
+      void imap_data_expunge(uint32_t number) override
+      {
+        ++responses;
+      }
+      void imap_data_fetch_end() override
+      {
+        ++responses;
+      }
+      void imap_data_flags_end() override
+      {
+        ++responses;
+      }
+      void imap_list_end() override
+      {
+        ++responses;
+      }
+  };
+
+  class Bench {
+    private:
+      unsigned repetitions_;
+    public:
+      Bench(unsigned repetitions) : repetitions_(repetitions) {}
+
+      // fn() is called once per repetition and returns the number of
+      // units (e.g. responses) it processed
+      void run(const string &name, size_t bytes, const char *unit,
+          const std::function<size_t()> &fn)
+      {
+        size_t units = 0;
+        auto start = chrono::steady_clock::now();
+        try {
+          for (unsigned i = 0; i < repetitions_; ++i)
+            units += fn();
+        } catch (const std::exception &e) {
+          cout << setw(36) << left << name << " error: " << e.what() << '\n';
+          return;
+        }
+        auto stop = chrono::steady_clock::now();
+        double s = chrono::duration<double>(stop - start).count();
+        double b = double(bytes) * repetitions_;
+        cout << setw(36) << left << name << right
+          << setw(10) << fixed << setprecision(1)
+          << (b / s / 1024.0 / 1024.0) << " MiB/s ";
+        if (units)
+          cout << setw(10) << (s * 1e9 / double(units)) << " ns/" << unit;
+        cout << '\n';
+      }
+  };
+
+  size_t parse_client(const Stream &stream)
+  {
+    Client_Counter cb;
+    Memory::Buffer::Vector buffer;
+    Memory::Buffer::Vector tag_buffer;
+    IMAP::Client::Parser p(buffer, tag_buffer, cb);
+    for (auto &chunk : stream.chunks)
+      p.read(chunk.data(), chunk.data() + chunk.size());
+    return cb.responses;
+  }
+
+  size_t parse_server(const Stream &stream)
+  {
+    IMAP::Server::Callback::Null cb;
+    Memory::Buffer::Vector buffer;
+    Memory::Buffer::Vector tag_buffer;
+    IMAP::Server::Parser p(buffer, tag_buffer, cb);
+    for (auto &chunk : stream.chunks)
+      p.read(chunk.data(), chunk.data() + chunk.size());
+    return stream.chunks.size();
+  }
+
+  // like what a socket read returns
+  Stream split(const string &s, size_t n = 4096)
+  {
+    Stream r;
+    for (size_t i = 0; i < s.size(); i += n)
+      r.push(s.substr(i, n));
+    return r;
+  }
+
+  string body_text(mt19937 &g, size_t lines)
+  {
+    static const char alphabet[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,-";
+    uniform_int_distribution<size_t> c(0, sizeof(alphabet) - 2);
+    uniform_int_distribution<size_t> l(0, 78);
+    string r;
+    for (size_t i = 0; i < lines; ++i) {
+      size_t n = l(g);
+      for (size_t j = 0; j < n; ++j)
+        r += alphabet[c(g)];
+      r += "\r\n";
+    }
+    return r;
+  }
+
+  string fetch_body_corpus(mt19937 &g, unsigned n)
+  {
+    ostringstream o;
+    for (unsigned i = 1; i <= n; ++i) {
+      string body(body_text(g, 200));
+      o << "* " << i << " FETCH (UID " << (1000 + i)
+        << " FLAGS (\\Seen) BODY[] {" << body.size() << "}\r\n"
+        << body << ")\r\n";
+    }
+    o << "A004 OK Fetch completed.\r\n";
+    return o.str();
+  }
+
+  string fetch_flags_corpus(unsigned n)
+  {
+    ostringstream o;
+    for (unsigned i = 1; i <= n; ++i) {
+      o << "* " << i << " FETCH (UID " << (1000 + i) << " FLAGS (";
+      if (i % 2)
+        o << "\\Seen";
+      if (i % 3 == 0)
+        o << " \\Answered";
+      o << "))\r\n";
+    }
+    o << "A003 OK Fetch completed.\r\n";
+    return o.str();
+  }
+
+  string command_corpus(unsigned n)
+  {
+    ostringstream o;
+    o << "A000 LOGIN juser secret\r\n"
+      << "A001 SELECT INBOX\r\n";
+    for (unsigned i = 0; i < n; ++i)
+      o << "A" << setw(3) << setfill('0') << ((i + 2) % 1000)
+        << " UID FETCH " << (1000 + i) << ":" << (2000 + i)
+        << " (UID FLAGS BODY.PEEK[])\r\n";
+    return o.str();
+  }
+
+  string header_corpus(mt19937 &g, unsigned n)
+  {
+    string r;
+    for (unsigned i = 0; i < n; ++i) {
+      r += "From: Juser <juser@example.org>\n";
+      r += "Subject: =?utf-8?Q?Gr=C3=BC=C3=9Fe_aus_Bielefeld?= - ";
+      string s(body_text(g, 1));
+      r.append(s, 0, s.size() - 2);
+      r += '\n';
+      r += "Subject: =?iso-8859-1?B?R3L832Tf?= and some words\n";
+      r += "Date: Wed, 17 Jul 1996 02:23:25 -0700 (PDT)\n";
+    }
+    return r;
+  }
+
+  string base64_corpus(mt19937 &g, size_t n)
+  {
+    static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uniform_int_distribution<unsigned> d(0, 255);
+    string r;
+    r.reserve((n + 2) / 3 * 4);
+    for (size_t i = 0; i + 3 <= n; i += 3) {
+      unsigned x = (d(g) << 16) | (d(g) << 8) | d(g);
+      r += alphabet[(x >> 18) & 0x3f];
+      r += alphabet[(x >> 12) & 0x3f];
+      r += alphabet[(x >>  6) & 0x3f];
+      r += alphabet[ x        & 0x3f];
+    }
+    return r;
+  }
+
+  vector<string> default_traces()
+  {
+    vector<string> r;
+    fs::path dir(IMAPDL_TRACE_DIR);
+    for (fs::directory_iterator i(dir), e; i != e; ++i)
+      if (i->path().extension() == ".trace")
+        r.push_back(i->path().string());
+    sort(r.begin(), r.end());
+    return r;
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  unsigned repetitions = 100;
+  vector<string> traces;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      repetitions = strtoul(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+      cout << "Call: " << *argv << " [-r REPETITIONS] [TRACE_FILE...]\n";
+      return 0;
+    } else
+      traces.push_back(argv[i]);
+  }
+  if (traces.empty())
+    traces = default_traces();
+
+  cout << "Ragel style: " << IMAPDL_RAGEL_STYLE
+    << ", repetitions: " << repetitions << '\n';
+  Bench bench(repetitions);
+
+  for (auto &filename : traces) {
+    Session s(read_trace(filename));
+    bench.run("client " + s.name, s.received.bytes, "response",
+        [&s]() { return parse_client(s.received); });
+    bench.run("server " + s.name, s.sent.bytes, "command",
+        [&s]() { return parse_server(s.sent); });
+  }
+
+  mt19937 g(23);
+  {
+    Stream st(split(fetch_body_corpus(g, 1000)));
+    bench.run("client synthetic fetch body", st.bytes, "response",
+        [&st]() { return parse_client(st); });
+  }
+  {
+    Stream st(split(fetch_flags_corpus(100000)));
+    bench.run("client synthetic fetch flags", st.bytes, "response",
+        [&st]() { return parse_client(st); });
+  }
+  {
+    string s(command_corpus(10000));
+    // one command per write
+    Stream st;
+    for (size_t i = 0, j = 0; (j = s.find('\n', i)) != string::npos; i = j + 1)
+      st.push(s.substr(i, j + 1 - i));
+    bench.run("server synthetic uid fetch", st.bytes, "command",
+        [&st]() { return parse_server(st); });
+  }
+  {
+    string s(header_corpus(g, 10000));
+    bench.run("mime header decoder", s.size(), "field", [&s]() {
+        size_t fields = 0;
+        Memory::Buffer::Vector field;
+        Memory::Buffer::Vector body;
+        MIME::Header::Decoder d(field, body, [&fields]() { ++fields; });
+        d.set_ending_policy(MIME::Header::Decoder::Ending::LF);
+        d.read(s.data(), s.data() + s.size());
+        d.verify_finished();
+        return fields;
+        });
+  }
+  {
+    string s(base64_corpus(g, 3 * 1024 * 1024));
+    bench.run("base64 decoder", s.size(), "KiB", [&s]() {
+        Memory::Buffer::Vector v;
+        MIME::Base64::Decoder d(v);
+        d.read(s.data(), s.data() + s.size());
+        d.verify_finished();
+        return s.size() / 1024;
+        });
+  }
+  return 0;
+}
@@ -0,0 +1,258 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+
+// Receive buffer benchmark.
+//
+// A server thread sends a stream of bytes over a loopback TCP connection,
+// which is read via Net::TCP::Client::Base - once with each fixed receive
+// buffer size and once with the adaptive sizing (4 KiB to 256 KiB).
+//
+// The fixed 4 KiB and the adaptive case are also read via the concrete
+// handler members of the client, i.e. without the virtual dispatch and
+// the std::function completion of Net::Client::Base.
+//
+// With a certificate and key, the stream is also sent over TLS and read
+// via Net::TCP::SSL::Client::Base - with the userspace record layer and
+// with kTLS (which falls back to userspace if the kernel doesn't support
+// it, cf. the log output).
+//
+// Call: bench_read [#MiB [server.crt server.key]]
+
+#include <net/tcp_client.h>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/algorithm/hex.hpp>
+#include <boost/log/core.hpp>
+
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <stdlib.h>
+
+using namespace std;
+namespace asio = boost::asio;
+
+template <typename Stream>
+static void send(Stream &stream, size_t n)
+{
+  vector<char> v(64 * 1024, 'x');
+  for (size_t i = 0; i < n; i += v.size())
+    asio::write(stream, asio::buffer(v.data(), min(v.size(), n - i)));
+}
+
+static void serve(asio::ip::tcp::acceptor &acceptor, size_t n)
+{
+  asio::io_service io_service;
+  asio::ip::tcp::socket socket(io_service);
+  acceptor.accept(socket);
+  send(socket, n);
+  socket.shutdown(asio::ip::tcp::socket::shutdown_send);
+}
+
+static void serve_tls(asio::ip::tcp::acceptor &acceptor,
+    asio::ssl::context &context, size_t n)
+{
+  asio::io_service io_service;
+  asio::ssl::stream<asio::ip::tcp::socket> stream(io_service, context);
+  acceptor.accept(stream.next_layer());
+  stream.handshake(asio::ssl::stream_base::server);
+  send(stream, n);
+  // no TLS shutdown, since that would wait for the close_notify of the client
+  stream.lowest_layer().shutdown(asio::ip::tcp::socket::shutdown_send);
+}
+
+// i.e. in the format that Net::SSL::Verification expects
+static string fingerprint(const string &filename)
+{
+  unique_ptr<FILE, int(*)(FILE*)> f(fopen(filename.c_str(), "r"), fclose);
+  if (!f)
+    throw runtime_error("Could not open " + filename);
+  unique_ptr<X509, void(*)(X509*)> cert(
+      PEM_read_X509(f.get(), nullptr, nullptr, nullptr), X509_free);
+  if (!cert)
+    throw runtime_error("Could not read certificate " + filename);
+  unsigned char buffer[EVP_MAX_MD_SIZE];
+  unsigned size = sizeof buffer;
+  X509_digest(cert.get(), EVP_sha1(), buffer, &size);
+  string r;
+  boost::algorithm::hex(buffer, buffer + size, back_inserter(r));
+  return r;
+}
+
+// i.e. via the virtual interface
+template <typename Handler>
+static void read_some(Net::Client::Base &client, Handler handler)
+{
+  client.async_read_some(handler);
+}
+template <typename Client, typename Handler>
+static void read_some(Client &client, Handler handler)
+{
+  client.async_read_some_impl(handler);
+}
+
+template <typename Client>
+class Reader {
+  private:
+    Client &client_;
+    size_t  bytes_ {0};
+    size_t  reads_ {0};
+
+    void do_read()
+    {
+      read_some(client_, [this](const boost::system::error_code &ec,
+            size_t size)
+          {
+            if (ec)
+              return;
+            bytes_ += size;
+            ++reads_;
+            do_read();
+          });
+    }
+  public:
+    Reader(Client &client)
+      :
+        client_(client)
+    {
+    }
+    void start()
+    {
+      client_.async_resolve([this](const boost::system::error_code &ec,
+            asio::ip::tcp::resolver::iterator iterator)
+          {
+            if (ec)
+              throw boost::system::system_error(ec);
+            client_.async_connect(iterator,
+                [this](const boost::system::error_code &ec)
+                {
+                  if (ec)
+                    throw boost::system::system_error(ec);
+                  client_.async_handshake(
+                      [this](const boost::system::error_code &ec)
+                      {
+                        if (ec)
+                          throw boost::system::system_error(ec);
+                        do_read();
+                      });
+                });
+          });
+    }
+    size_t bytes() const { return bytes_; }
+    size_t reads() const { return reads_; }
+};
+
+// name is called after the transfer
+template <typename Reader>
+static void run(asio::io_service &io_service, Reader &reader, thread &server,
+    const function<string(void)> &name)
+{
+  auto start = chrono::steady_clock::now();
+  reader.start();
+  io_service.run();
+  auto stop = chrono::steady_clock::now();
+  server.join();
+
+  double s = chrono::duration<double>(stop - start).count();
+  cout << name() << ": "
+    << (double(reader.bytes()) / s / 1024.0 / 1024.0) << " MiB/s, "
+    << reader.reads() << " reads, "
+    << (reader.reads() ? reader.bytes() / reader.reads() : 0)
+    << " bytes/read\n";
+}
+
+// Client: Net::Client::Base or the concrete client
+template <typename Client>
+static void bench(size_t min_size, size_t max_size, size_t n)
+{
+  asio::io_service io_service;
+  asio::ip::tcp::acceptor acceptor(io_service,
+      asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+
+  Net::TCP::Client::Options opts;
+  opts.host           = "127.0.0.1";
+  opts.service        = to_string(acceptor.local_endpoint().port());
+  opts.min_input_size = min_size;
+  opts.max_input_size = max_size;
+  boost::log::sources::severity_logger<Log::Severity> lg;
+  Net::TCP::Client::Base client(io_service, opts, lg);
+  Reader<Client> reader(client);
+
+  thread server(serve, std::ref(acceptor), n);
+  bool concrete = !is_same<Client, Net::Client::Base>::value;
+  run(io_service, reader, server, [min_size, max_size, concrete]() {
+      return to_string(min_size / 1024) + "-" + to_string(max_size / 1024)
+        + " KiB" + (concrete ? " (concrete handler)" : ""); });
+}
+
+static void bench_tls(const string &cert, const string &key, bool ktls,
+    size_t n)
+{
+  asio::io_service io_service;
+  asio::ip::tcp::acceptor acceptor(io_service,
+      asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+  asio::ssl::context server_context(asio::ssl::context::sslv23_server);
+  server_context.use_certificate_chain_file(cert);
+  server_context.use_private_key_file(key, asio::ssl::context::pem);
+
+  Net::TCP::SSL::Client::Options opts;
+  opts.host           = "127.0.0.1";
+  opts.service        = to_string(acceptor.local_endpoint().port());
+  opts.fingerprint    = fingerprint(cert);
+  opts.ktls           = ktls;
+  asio::ssl::context context(asio::ssl::context::sslv23);
+  boost::log::sources::severity_logger<Log::Severity> lg;
+  Net::TCP::SSL::Client::Base client(io_service, context, opts, lg);
+  Reader<Net::Client::Base> reader(client);
+
+  thread server(serve_tls, std::ref(acceptor), std::ref(server_context), n);
+  run(io_service, reader, server, [ktls, &client]() -> string {
+      return !ktls ? "TLS (userspace)" : client.ktls_active() ? "TLS (kTLS)"
+        : "TLS (kTLS not active)"; });
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = size_t(argc > 1 ? strtoul(argv[1], nullptr, 10) : 256)
+    * 1024 * 1024;
+  cout << "Input: " << (n / 1024 / 1024) << " MiB\n";
+  boost::log::core::get()->set_logging_enabled(false);
+  for (size_t k : { 4, 16, 64, 256 })
+    bench<Net::Client::Base>(k * 1024, k * 1024, n);
+  bench<Net::Client::Base>(4 * 1024, 256 * 1024, n);
+  bench<Net::TCP::Client::Base>(4 * 1024, 4 * 1024, n);
+  bench<Net::TCP::Client::Base>(4 * 1024, 256 * 1024, n);
+  if (argc > 3) {
+    bench_tls(argv[2], argv[3], false, n);
+    bench_tls(argv[2], argv[3], true, n);
+  }
+  return 0;
+}
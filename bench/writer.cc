@@ -0,0 +1,94 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+
+// Command generation benchmark.
+//
+// Generates UID STORE and UID EXPUNGE commands with large sequence sets
+// (as they are sent after downloading a big mailbox) via
+// IMAP::Client::Writer - once for each validation mode, i.e. with and
+// without running the commands through IMAP::Server::Parser.
+//
+// Call: bench_writer [#ranges [#repetitions]]
+
+#include <imap/client_writer.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+using namespace std;
+
+static vector<pair<uint32_t, uint32_t> > create_set(unsigned n)
+{
+  vector<pair<uint32_t, uint32_t> > set;
+  set.reserve(n);
+  // e.g. 1:2,4:5,7:8,... - i.e. every third message was not fetched
+  for (unsigned i = 0; i < n; ++i)
+    set.emplace_back(3 * i + 1, 3 * i + 2);
+  return set;
+}
+
+static void bench(IMAP::Client::Validation v,
+    const vector<pair<uint32_t, uint32_t> > &set, unsigned k)
+{
+  using namespace IMAP::Client;
+  size_t bytes = 0;
+  Tag tag;
+  Writer writer(tag, [&bytes](vector<char> &x) { bytes += x.size(); });
+  writer.set_validation(v);
+  vector<IMAP::Flag> flags = { IMAP::Flag::DELETED };
+  string t;
+  writer.login("juser", "secretvery", t);
+  tag.pop(t);
+  writer.select("INBOX", t);
+  tag.pop(t);
+  bytes = 0;
+  auto start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < k; ++i) {
+    writer.uid_store(set, flags, t, Store_Mode::ADD, true);
+    tag.pop(t);
+    writer.uid_expunge(set, t);
+    tag.pop(t);
+  }
+  auto stop = chrono::steady_clock::now();
+  double s = chrono::duration<double>(stop - start).count();
+  cout << v << ": " << (double(bytes) / s / 1024.0 / 1024.0) << " MiB/s, "
+    << (s * 1e3 / (2.0 * k)) << " ms/command\n";
+}
+
+int main(int argc, char **argv)
+{
+  unsigned n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  unsigned k = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+  auto set = create_set(n);
+  cout << "Input: " << n << " ranges, " << k << " repetitions"
+#ifdef NDEBUG
+    << " (NDEBUG)"
+#endif
+    << '\n';
+  using IMAP::Client::Validation;
+  // with FIRST_N only the first UID STORE/UID EXPUNGE is parsed
+  for (auto v : { Validation::ALWAYS, Validation::FIRST_N, Validation::DEBUG })
+    bench(v, set, k);
+  return 0;
+}
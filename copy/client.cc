@@ -33,6 +33,7 @@ using namespace Memory;
 #include <sstream>
 #include <string>
 #include <functional>
+#include <algorithm>
 using namespace std;
 
 #include <boost/filesystem.hpp>
@@ -40,14 +41,38 @@ namespace fs = boost::filesystem;
 
 #include "journal.h"
 
+// generated from imap/client_parser.rl
+#include "client_parser_impl.h"
+
 #include <boost/asio/yield.hpp>
 
 namespace IMAP {
+  namespace Client {
+    template class Basic_Parser<IMAP::Copy::Client>;
+  }
   namespace Copy {
 
     Client::Client(IMAP::Copy::Options &opts,
         Net::Client::Base &net_client,
         boost::log::sources::severity_logger<Log::Severity> &lg)
+      :
+        Client(opts, net_client, false, false, false, nullptr, lg)
+    {
+    }
+    Client::Client(IMAP::Copy::Options &opts,
+        Net::Client::Connection &connection,
+        bool release, std::function<void(bool)> done_fn,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+      :
+        Client(opts, connection.client(), true, connection.authenticated(),
+            release, std::move(done_fn), lg)
+    {
+    }
+    Client::Client(IMAP::Copy::Options &opts,
+        Net::Client::Base &net_client,
+        bool established, bool authenticated,
+        bool release, std::function<void(bool)> done_fn,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
       :
         IMAP::Client::Base(std::bind(&Client::write_command, this, std::placeholders::_1), lg),
         lg_(lg),
@@ -56,22 +81,41 @@ namespace IMAP {
         app_(opts_.host, client_, lg_),
         signals_(client_.io_service(), SIGINT, SIGTERM),
         login_timer_(client_.io_service()),
+        release_(release),
+        done_fn_(std::move(done_fn)),
         maildir_(opts_.maildir),
-        tmp_dir_(maildir_.tmp_dir_fd()),
         parser_(buffer_proxy_, tag_buffer_, *this),
         mailbox_(opts_.mailbox),
         fetch_timer_(client_, lg_),
-        header_printer_(opts_, buffer_, lg_)
+        header_printer_(opts_, buffer_, lg_),
+        part_filter_(opts_.part_policy, uint64_t(opts_.max_part_kb) * 1024)
     {
       BOOST_LOG_FUNCTION();
       buffer_proxy_.set(&buffer_);
+      set_validation(opts_.validation, opts_.validate_first);
+      set_max_command_length(opts_.max_command_length);
+      set_cork([this](std::function<void(void)> fn) {
+          client_.io_service().post(std::move(fn));
+        });
       read_journal();
       do_signal_wait();
-      app_.async_start([this](){
-            //state_ = State::ESTABLISHED;
-            do_read();
-            do_pre_login();
-          });
+      if (authenticated) {
+        BOOST_LOG(lg_) << "Reusing the authenticated session";
+        set_authenticated();
+        greeted_ = true;
+        do_read();
+        // e.g. UIDPLUS and BINARY
+        cond_async_capabilities(std::bind(&Client::do_post_login, this));
+      } else if (established) {
+        do_read();
+        do_pre_login();
+      } else {
+        app_.async_start([this](){
+              //state_ = State::ESTABLISHED;
+              do_read();
+              do_pre_login();
+            });
+      }
     }
     Client::~Client()
     {
@@ -102,7 +146,8 @@ namespace IMAP {
       if (!opts_.del)
         return;
       BOOST_LOG_SEV(lg_, Log::MSG) << "Writing journal " << opts_.journal_file << " ...";
-      Journal journal(opts_.mailbox, uidvalidity_, uids_);
+      // i.e. the mailbox the uids belong to
+      Journal journal(mailbox_, uidvalidity_, uids_);
       journal.write(opts_.journal_file);
     }
 
@@ -165,23 +210,39 @@ namespace IMAP {
     {
       BOOST_LOG_FUNCTION();
       reenter (download_coroutine_) {
-        yield async_select(bind(&Client::do_download, this));
-        if (exists_) {
-          BOOST_LOG(lg_) << "Fetching into " << opts_.maildir << " ...";
-          fetch_timer_.start();
-          yield async_fetch(bind(&Client::do_download, this));
-          fetch_timer_.stop();
-          if (opts_.del) {
-            yield async_store(bind(&Client::do_download, this));
-            yield async_uid_or_simple_expunge(bind(&Client::do_download, this));
+        // the mailboxes share the authenticated session
+        for (mailbox_index_ = 0; mailbox_index_ < opts_.mailboxes.size();
+            ++mailbox_index_) {
+          mailbox_ = opts_.mailboxes[mailbox_index_];
+          exists_ = 0;
+          recent_ = 0;
+          yield async_select(bind(&Client::do_download, this));
+          if (exists_) {
+            BOOST_LOG(lg_) << "Fetching into " << opts_.maildir << " ...";
+            fetch_timer_.start();
+            part_filter_.set_binary(opts_.binary && has_binary());
+            if (part_filter_.policy() == Part_Policy::ALL
+                && !part_filter_.binary()) {
+              yield async_fetch(bind(&Client::do_download, this));
+            } else {
+              yield async_fetch_structure(bind(&Client::do_download, this));
+              if (!structures_.empty()) {
+                yield async_fetch_parts(bind(&Client::do_download, this));
+              }
+              structures_.clear();
+            }
+            fetch_timer_.stop();
+            if (opts_.del) {
+              yield async_store(bind(&Client::do_download, this));
+              yield async_uid_or_simple_expunge(bind(&Client::do_download, this));
+            }
+          } else {
+            BOOST_LOG_SEV(lg_, Log::MSG) << "Mailbox " << mailbox_
+              << " is empty.";
           }
-        } else {
-          BOOST_LOG_SEV(lg_, Log::MSG) << "Mailbox " << opts_.mailbox
-            << " is empty.";
+          uids_.clear();
         }
-        uids_.clear();
-        yield async_logout(bind(&Client::do_download, this));
-        do_quit();
+        do_logout();
       }
     }
 
@@ -195,8 +256,7 @@ namespace IMAP {
         yield async_select      ([this](){do_fetch_header();});
         yield async_fetch_header([this](){do_fetch_header();});
         uids_.clear();
-        yield async_logout      ([this](){do_fetch_header();});
-        do_quit();
+        do_logout();
       }
     }
 
@@ -216,12 +276,9 @@ namespace IMAP {
     void Client::do_list()
     {
       BOOST_LOG_FUNCTION();
-      auto finish_fn = [this](){
-        do_quit();
-      };
-      auto logout_fn = [this, finish_fn](){
+      auto logout_fn = [this](){
         uids_.clear();
-        async_logout(finish_fn);
+        do_logout();
       };
       auto list_fn = [this, logout_fn](){
         async_list(logout_fn);
@@ -231,7 +288,13 @@ namespace IMAP {
 
     void Client::do_pre_login()
     {
-      login_timer_.expires_from_now(std::chrono::milliseconds(opts_.greeting_wait));
+      if (opts_.tunnel.empty() && opts_.unix_socket.empty())
+        login_timer_.expires_from_now(std::chrono::milliseconds(opts_.greeting_wait));
+      else
+        // the command (e.g. ssh) might need a while, and sending
+        // LOGIN before a PREAUTH greeting would fail
+        login_timer_.expires_at(
+            std::chrono::steady_clock::time_point::max());
       login_timer_.async_wait([this](
           const boost::system::error_code &ec)
         {
@@ -240,12 +303,22 @@ namespace IMAP {
             THROW_ERROR(ec);
           } else {
             BOOST_LOG(lg_) << "Point after first possibly occured read";
-            cond_async_capabilities([this](){
-                async_login_capabilities(std::bind(&Client::do_post_login, this));
-              });
+            do_login();
           }
         });
     }
+    void Client::do_login()
+    {
+      if (preauth_) {
+        BOOST_LOG(lg_) << "Pre-authenticated connection, skipping LOGIN";
+        set_authenticated();
+        cond_async_capabilities(std::bind(&Client::do_post_login, this));
+        return;
+      }
+      cond_async_capabilities([this](){
+          async_login_capabilities(std::bind(&Client::do_post_login, this));
+        });
+    }
     void Client::do_post_login()
     {
       if (need_cleanup_)
@@ -328,6 +401,138 @@ namespace IMAP {
       IMAP::Client::Base::async_fetch(set, atts, fn);
     }
 
+    void Client::async_fetch_structure(std::function<void(void)> fn)
+    {
+      vector<pair<uint32_t, uint32_t> > set = {
+        {1, numeric_limits<uint32_t>::max()}
+      };
+
+      using namespace IMAP::Client;
+      vector<Fetch_Attribute> atts;
+      atts.emplace_back(Fetch::UID);
+      atts.emplace_back(Fetch::BODYSTRUCTURE);
+
+      BOOST_LOG(lg_) << "Fetching body structures (download policy: "
+        << part_filter_.policy() << ") ...";
+      structures_.clear();
+      state_ = State::FETCHING_STRUCTURE;
+      IMAP::Client::Base::async_fetch(set, atts, [this, fn]() {
+          std::sort(structures_.begin(), structures_.end(),
+            [](const Message_Structure &a, const Message_Structure &b) {
+              return a.number < b.number; });
+          fn();
+        });
+    }
+
+    // Fetch the messages that aren't reconstructed from parts with one
+    // streamed UID FETCH and the others one by one - with up to
+    // fetch_window UID FETCH commands in flight, i.e. the round trip
+    // time isn't paid for each message.
+    void Client::async_fetch_parts(std::function<void(void)> fn)
+    {
+      parts_fn_ = std::move(fn);
+      next_part_ = 0;
+      pending_parts_ = 0;
+      state_ = State::FETCHING;
+
+      Sequence_Set whole;
+      for (auto &m : structures_)
+        if (!m.partial)
+          whole.push(m.uid);
+      if (!whole.empty()) {
+        vector<pair<uint32_t, uint32_t> > set;
+        whole.copy(set);
+        using namespace IMAP::Client;
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::UID);
+        atts.emplace_back(Fetch::FLAGS);
+        atts.emplace_back(Fetch::BODY_PEEK);
+        BOOST_LOG_SEV(lg_, Log::DEBUG) << "Fetching " << whole.size()
+          << " messages completely";
+        ++pending_parts_;
+        IMAP::Client::Base::async_uid_fetch(set, atts,
+            [this]() { part_fetched(); }, true);
+      }
+      // corked, i.e. the first window is written at once
+      while (pending_parts_ < opts_.fetch_window && async_fetch_next_part())
+        ;
+    }
+
+    bool Client::async_fetch_next_part()
+    {
+      for (; next_part_ < structures_.size(); ++next_part_)
+        if (structures_[next_part_].partial) {
+          async_fetch_part(next_part_++);
+          return true;
+        }
+      return false;
+    }
+
+    void Client::async_fetch_part(size_t i)
+    {
+      const Message_Structure &m = structures_[i];
+      vector<pair<uint32_t, uint32_t> > set = { {m.uid, m.uid} };
+
+      using namespace IMAP::Client;
+      vector<Fetch_Attribute> atts;
+      atts.emplace_back(Fetch::UID);
+      atts.emplace_back(Fetch::FLAGS);
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Fetching only selected parts of UID "
+        << m.uid;
+      part_filter_.attributes(m.root, atts);
+
+      ++pending_parts_;
+      IMAP::Client::Base::async_uid_fetch(set, atts,
+          [this]() { part_fetched(); }, true);
+    }
+
+    void Client::part_fetched()
+    {
+      --pending_parts_;
+      if (async_fetch_next_part() || pending_parts_)
+        return;
+      auto fn = std::move(parts_fn_);
+      parts_fn_ = nullptr;
+      fn();
+    }
+
+    // The responses of the pipelined fetches are matched via the UID,
+    // since e.g. a concurrent EXPUNGE shifts the sequence numbers. The UID
+    // might follow the sections, thus, they are collected until a BODY[]
+    // section shows that it's a complete message, and the structure is
+    // only looked up at the end of the response.
+    bool Client::select_structure(uint32_t uid)
+    {
+      // the UIDs ascend with the sequence numbers
+      auto i = std::lower_bound(structures_.begin(), structures_.end(), uid,
+          [](const Message_Structure &m, uint32_t u) { return m.uid < u; });
+      if (i == structures_.end() || i->uid != uid || !i->partial)
+        return false;
+      structure_index_ = i - structures_.begin();
+      return true;
+    }
+
+    void Client::write_partial()
+    {
+      BOOST_LOG_FUNCTION();
+      assembler_.assemble(structures_[structure_index_].root, part_filter_,
+          message_);
+      string filename;
+      maildir_.create_tmp_name(filename);
+      file_sink_.open(maildir_.tmp_dir_fd(), filename);
+      file_sink_.push(message_.data(), message_.size());
+      file_sink_.close();
+      if (flags_.empty()) {
+        maildir_.move_to_new();
+      } else  {
+        BOOST_LOG_SEV(lg_, Log::DEBUG) << "Using maildir flags: " << flags_;
+        maildir_.move_to_cur(flags_);
+      }
+      assembler_.clear();
+      partial_ = false;
+      fetch_timer_.increase_messages();
+    }
+
     void Client::async_fetch_header(std::function<void(void)> fn)
     {
       vector<pair<uint32_t, uint32_t> > set = {
@@ -372,6 +577,14 @@ namespace IMAP {
       return i != capabilities_.end();
     }
 
+    bool Client::has_binary() const
+    {
+      BOOST_LOG_FUNCTION();
+      auto i = capabilities_.find(IMAP::Server::Response::Capability::BINARY);
+      BOOST_LOG(lg_) << "Has BINARY capability: " << (i != capabilities_.end());
+      return i != capabilities_.end();
+    }
+
     void Client::async_uid_or_simple_expunge(std::function<void(void)> fn)
     {
       BOOST_LOG_FUNCTION();
@@ -424,28 +637,97 @@ namespace IMAP {
               }
             } else {
               parser_.read(client_.input().data(), client_. input().data() + size);
-              if (state_ != State::LOGGED_OUT) // && client_.is_open())
+              // body slices point into the input buffer
+              if (file_sink_.is_open())
+                file_sink_.flush();
+              do_drain();
+              if (release_pending_ && parser_.finished())
+                finish_release();
+              else if (state_ != State::LOGGED_OUT && state_ != State::RELEASED)
                 do_read();
             }
           });
     }
 
+    // read what is already available without another reactor round trip -
+    // limited by drain_size to not starve timers and signals
+    void Client::do_drain()
+    {
+      size_t budget = opts_.drain_size;
+      while (budget && state_ != State::LOGGED_OUT
+          && state_ != State::RELEASED && !release_pending_) {
+        boost::system::error_code ec;
+        size_t size = client_.read_some(ec);
+        // would_block or e.g. EOF - the latter is then
+        // reported by the next async read
+        if (ec)
+          break;
+        parser_.read(client_.input().data(), client_.input().data() + size);
+        if (file_sink_.is_open())
+          file_sink_.flush();
+        budget -= std::min(budget, size);
+      }
+    }
+
     void Client::write_command(vector<char> &cmd)
     {
       client_.push_write(cmd);
     }
 
+    // at the end of the task
+    void Client::do_logout()
+    {
+      if (release_)
+        do_release();
+      else
+        async_logout([this](){ do_quit(); });
+    }
+    // called from a completion handler, i.e. from within parser_.read() -
+    // the rest of the input might already belong to the next responses,
+    // thus the connection is only handed over at the end of a read where
+    // the parser is between two responses (cf. do_read())
+    void Client::do_release()
+    {
+      BOOST_LOG_FUNCTION();
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "do_release()";
+      release_pending_ = true;
+    }
+    // i.e. the read isn't re-armed and the next session can read from the
+    // connection
+    void Client::finish_release()
+    {
+      BOOST_LOG_FUNCTION();
+      release_pending_ = false;
+      state_ = State::RELEASED;
+      Log::flush();
+      signals_.cancel();
+      client_.io_service().post(std::bind(done_fn_, true));
+    }
+
     void Client::do_quit()
     {
       BOOST_LOG_FUNCTION();
       BOOST_LOG_SEV(lg_, Log::DEBUG) << "do_quit()";
       state_ = State::LOGGED_OUT;
+      // i.e. with asynchronous logging, everything up to here is written
+      Log::flush();
       app_.async_finish([this](){
             signals_.cancel();
+            if (done_fn_)
+              client_.io_service().post(std::bind(done_fn_, false));
           });
     }
 
 
+    void Client::imap_untagged_status_end(IMAP::Server::Response::Status c)
+    {
+      if (greeted_)
+        return;
+      greeted_ = true;
+      preauth_ = c == IMAP::Server::Response::Status::PREAUTH;
+      // i.e. don't wait longer for the greeting
+      login_timer_.cancel();
+    }
     void Client::imap_status_code_capability_begin()
     {
       BOOST_LOG_FUNCTION();
@@ -470,14 +752,14 @@ namespace IMAP {
     void Client::imap_data_exists(uint32_t number)
     {
       BOOST_LOG_FUNCTION();
-      BOOST_LOG(lg_) << "Mailbox " << opts_.mailbox << " contains " << number
+      BOOST_LOG(lg_) << "Mailbox " << mailbox_ << " contains " << number
         << " messages";
       exists_ = number;
     }
     void Client::imap_data_recent(uint32_t number)
     {
       BOOST_LOG_FUNCTION();
-      BOOST_LOG(lg_) << "Mailbox " << opts_.mailbox << " has " << number
+      BOOST_LOG(lg_) << "Mailbox " << mailbox_ << " has " << number
         << " RECENT messages";
       recent_ = number;
     }
@@ -497,9 +779,15 @@ namespace IMAP {
     {
       BOOST_LOG_FUNCTION();
       flags_.clear();
+      fetch_number_ = number;
+      if (state_ == State::FETCHING_STRUCTURE)
+        last_uid_ = 0;
       if (state_ == State::FETCHING) {
         BOOST_LOG(lg_) << "Fetching message: " << number;
         last_uid_ = 0;
+        partial_ = !structures_.empty();
+        if (partial_)
+          assembler_.clear();
         if (opts_.simulate_error == fetch_timer_.messages() + 1) {
           ostringstream o;
           o << "Simulated error after fetched message: " << fetch_timer_.messages();
@@ -511,6 +799,25 @@ namespace IMAP {
     {
       if (!last_uid_)
         THROW_MSG("Did not retrieve any UID");
+      if (state_ == State::FETCHING_STRUCTURE) {
+        if (!body_structure_.complete())
+          THROW_MSG("Did not retrieve a BODYSTRUCTURE");
+        structures_.emplace_back();
+        structures_.back().number  = fetch_number_;
+        structures_.back().uid     = last_uid_;
+        structures_.back().root    = body_structure_.root();
+        structures_.back().partial = part_filter_.partial(structures_.back().root);
+        body_structure_.clear();
+        return;
+      }
+      if (partial_) {
+        if (select_structure(last_uid_)) {
+          write_partial();
+        } else {
+          assembler_.clear();
+          partial_ = false;
+        }
+      }
       BOOST_LOG_SEV(lg_, Log::DEBUG) << "Storing UID: " << last_uid_;
       uids_.push(last_uid_);
     }
@@ -520,27 +827,51 @@ namespace IMAP {
         if (opts_.task == Task::FETCH_HEADER)
           THROW_MSG("server sends body during header only fetch");
         full_body_ = true;
+        partial_ = false;
       }
     }
+    void Client::imap_body_section_begin()
+    {
+      if (partial_)
+        assembler_.section_begin();
+    }
+    void Client::imap_section_header()
+    {
+      if (partial_)
+        assembler_.section_header();
+    }
+    void Client::imap_section_part(uint32_t number)
+    {
+      if (partial_)
+        assembler_.section_part(number);
+    }
+    void Client::imap_section_mime()
+    {
+      if (partial_)
+        assembler_.section_mime();
+    }
     void Client::imap_body_section_inner()
     {
       if (state_ == State::FETCHING) {
         if (full_body_) {
           string filename;
           maildir_.create_tmp_name(filename);
-          Buffer::File f(tmp_dir_, filename);
-          file_buffer_ = std::move(f);
-          buffer_proxy_.set(&file_buffer_);
+          file_sink_.open(maildir_.tmp_dir_fd(), filename);
+          parser_.set_slice_literals(true);
         }
       }
     }
     void Client::imap_body_section_end()
     {
       BOOST_LOG_FUNCTION();
+      if (partial_) {
+        assembler_.section_end(buffer_.begin(), buffer_.end());
+        return;
+      }
       if (state_ == State::FETCHING) {
         if (full_body_) {
-          buffer_proxy_.set(&buffer_);
-          file_buffer_.close();
+          parser_.set_slice_literals(false);
+          file_sink_.close();
           if (flags_.empty()) {
             maildir_.move_to_new();
           } else  {
@@ -554,6 +885,60 @@ namespace IMAP {
         }
       }
     }
+    void Client::imap_binary_section_begin()
+    {
+      if (partial_)
+        assembler_.binary_section_begin();
+    }
+    void Client::imap_binary_section_end()
+    {
+      if (partial_)
+        assembler_.binary_section_end(buffer_.begin(), buffer_.end());
+    }
+    void Client::imap_body_begin()
+    {
+      body_structure_.begin();
+    }
+    void Client::imap_body_end()
+    {
+      body_structure_.end();
+    }
+    void Client::imap_body_type()
+    {
+      body_structure_.type(buffer_.begin(), buffer_.end());
+    }
+    void Client::imap_body_subtype()
+    {
+      body_structure_.subtype(buffer_.begin(), buffer_.end());
+    }
+    void Client::imap_body_param_name()
+    {
+      body_structure_.param_name(buffer_.begin(), buffer_.end());
+    }
+    void Client::imap_body_param_value()
+    {
+      body_structure_.param_value(buffer_.begin(), buffer_.end());
+    }
+    void Client::imap_body_encoding()
+    {
+      body_structure_.encoding(buffer_.begin(), buffer_.end());
+    }
+    void Client::imap_body_octets(uint32_t number)
+    {
+      body_structure_.octets(number);
+    }
+    void Client::imap_body_lines(uint32_t number)
+    {
+      body_structure_.lines(number);
+    }
+    void Client::imap_body_disposition()
+    {
+      body_structure_.disposition(buffer_.begin(), buffer_.end());
+    }
+    void Client::imap_literal_slice(const char *begin, size_t n)
+    {
+      file_sink_.push(begin, n);
+    }
     void Client::imap_flag(Flag flag)
     {
       switch (flag) {
@@ -579,7 +964,7 @@ namespace IMAP {
     void Client::imap_uid(uint32_t number)
     {
       BOOST_LOG_FUNCTION();
-      if (state_ == State::FETCHING) {
+      if (state_ == State::FETCHING || state_ == State::FETCHING_STRUCTURE) {
         BOOST_LOG_SEV(lg_, Log::DEBUG) << "UID: " << number;
         last_uid_ = number;
       }
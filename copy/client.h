@@ -26,16 +26,19 @@
 #include <copy/state.h>
 #include <copy/fetch_timer.h>
 #include <copy/header_printer.h>
+#include <copy/file_sink.h>
+#include <copy/part_filter.h>
 
 #include <net/tcp_client.h>
 #include <net/client_application.h>
+#include <net/client_pool.h>
 #include <imap/client_parser.h>
 #include <imap/client_writer.h>
 #include <imap/client_base.h>
+#include <imap/body_structure.h>
 #include <log/log.h>
 #include <maildir/maildir.h>
 #include <buffer/buffer.h>
-#include <buffer/file.h>
 #include <sequence_set.h>
 
 #include <string>
@@ -49,8 +52,11 @@
 namespace IMAP {
   namespace Copy {
     class Options;
-    class Client : public IMAP::Client::Base {
+    // final, such that the parser can inline the callbacks
+    class Client final : public IMAP::Client::Base {
       private:
+        friend class IMAP::Client::Basic_Parser<Client>;
+
         boost::asio::coroutine  download_coroutine_;
         boost::asio::coroutine  fetch_header_coroutine_;
         boost::log::sources::severity_logger<Log::Severity> &lg_;
@@ -60,14 +66,22 @@ namespace IMAP {
         boost::asio::signal_set signals_;
         unsigned                signaled_ {0};
         boost::asio::basic_waitable_timer<std::chrono::steady_clock> login_timer_;
+        // i.e. on a pooled connection the session isn't logged out
+        // at the end of the task
+        bool                    release_;
+        // the task is done, waiting for the end of the current read
+        bool                    release_pending_ {false};
+        std::function<void(bool)> done_fn_;
 
         Memory::Buffer::Proxy   buffer_proxy_;
         Maildir                 maildir_;
-        Memory::Dir             tmp_dir_;
-        Memory::Buffer::File    file_buffer_;
-        IMAP::Client::Parser    parser_;
+        File_Sink               file_sink_;
+        IMAP::Client::Basic_Parser<Client> parser_;
 
         bool          need_cleanup_ {false};
+        bool          greeted_      {false};
+        // i.e. no LOGIN
+        bool          preauth_      {false};
         State         state_        {State::DISCONNECTED };
 
         unsigned      exists_      {0};
@@ -84,18 +98,49 @@ namespace IMAP {
         Fetch_Timer    fetch_timer_;
         Header_Printer header_printer_;
 
+        // selective download of MIME parts (Options::part_policy)
+        struct Message_Structure {
+          // message sequence number, i.e. identifies the FETCH response
+          uint32_t                  number  {0};
+          uint32_t                  uid     {0};
+          bool                      partial {false};
+          IMAP::Client::Body_Part   root;
+        };
+        Part_Filter                     part_filter_;
+        IMAP::Client::Body_Structure    body_structure_;
+        std::vector<Message_Structure>  structures_;
+        size_t                          structure_index_ {0};
+        uint32_t                        fetch_number_    {0};
+        // pipelined UID FETCH commands (Options::fetch_window)
+        size_t                          next_part_       {0};
+        size_t                          pending_parts_   {0};
+        std::function<void(void)>       parts_fn_;
+        size_t                          mailbox_index_   {0};
+        bool                            partial_         {false};
+        Message_Assembler               assembler_;
+        std::string                     message_;
+
+        Client(IMAP::Copy::Options &opts,
+            Net::Client::Base &net_client,
+            bool established, bool authenticated,
+            bool release, std::function<void(bool)> done_fn,
+            boost::log::sources::severity_logger< Log::Severity > &lg);
+
         void read_journal();
         void write_journal();
 
         void do_signal_wait();
 
         void do_read();
+        void do_drain();
         void write_command(vector<char> &cmd);
 
         bool has_uidplus() const;
+        bool has_binary() const;
 
         // specialized download client functions
         void do_pre_login();
+        void do_login();
         void do_post_login();
         void async_login_capabilities(std::function<void(void)> fn);
         void cond_async_capabilities(std::function<void(void)> fn);
@@ -103,6 +148,13 @@ namespace IMAP {
         void async_select(std::function<void(void)> fn);
         void async_fetch_header(std::function<void(void)> fn);
         void async_fetch(std::function<void(void)> fn);
+        void async_fetch_structure(std::function<void(void)> fn);
+        void async_fetch_parts(std::function<void(void)> fn);
+        bool async_fetch_next_part();
+        void async_fetch_part(size_t i);
+        void part_fetched();
+        bool select_structure(uint32_t uid);
+        void write_partial();
         void async_list(std::function<void(void)> fn);
         void async_store(std::function<void(void)> fn);
         void async_uid_or_simple_expunge(std::function<void(void)> fn);
@@ -112,14 +164,26 @@ namespace IMAP {
         void do_fetch_header();
         void do_download();
         void do_task();
+        void do_logout();
+        void do_release();
+        void finish_release();
         void do_quit();
       public:
         Client(IMAP::Copy::Options &opts,
             Net::Client::Base &net_client,
             boost::log::sources::severity_logger< Log::Severity > &lg);
+        // On a connection of a Net::Client::Pool, i.e. it's established
+        // and possibly already authenticated. With release, the session
+        // isn't logged out at the end of the task. done_fn is posted when
+        // the session is finished - with true if it's still logged in.
+        Client(IMAP::Copy::Options &opts,
+            Net::Client::Connection &connection,
+            bool release, std::function<void(bool)> done_fn,
+            boost::log::sources::severity_logger< Log::Severity > &lg);
         ~Client();
 
       protected:
+        void imap_untagged_status_end(IMAP::Server::Response::Status c) override;
         void imap_status_code_capability_begin() override;
         void imap_capability_begin() override;
         void imap_capability(IMAP::Server::Response::Capability capability) override;
@@ -131,8 +195,25 @@ namespace IMAP {
         void imap_data_fetch_begin(uint32_t number) override;
         void imap_data_fetch_end() override;
         void imap_section_empty() override;
+        void imap_body_section_begin() override;
+        void imap_section_header() override;
+        void imap_section_part(uint32_t number) override;
+        void imap_section_mime() override;
         void imap_body_section_inner() override;
         void imap_body_section_end() override;
+        void imap_binary_section_begin() override;
+        void imap_binary_section_end() override;
+        void imap_body_begin() override;
+        void imap_body_end() override;
+        void imap_body_type() override;
+        void imap_body_subtype() override;
+        void imap_body_param_name() override;
+        void imap_body_param_value() override;
+        void imap_body_encoding() override;
+        void imap_body_octets(uint32_t number) override;
+        void imap_body_lines(uint32_t number) override;
+        void imap_body_disposition() override;
+        void imap_literal_slice(const char *begin, size_t n) override;
         void imap_flag(Flag flag) override;
         void imap_uid(uint32_t number) override;
 
@@ -0,0 +1,122 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "file_sink.h"
+
+#include <system_error>
+#include <algorithm>
+using namespace std;
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <ixxx/ixxx.h>
+using namespace ixxx;
+
+#ifndef IOV_MAX
+  #define IOV_MAX 1024
+#endif
+
+namespace IMAP {
+  namespace Copy {
+
+    File_Sink::File_Sink()
+    {
+      iov_.reserve(IOV_MAX);
+    }
+    File_Sink::~File_Sink()
+    {
+      if (fd_ != -1)
+        ::close(fd_);
+    }
+
+    void File_Sink::open(int dir_fd, const std::string &filename)
+    {
+      if (fd_ != -1)
+        throw logic_error("file sink is already open");
+      fd_ = posix::openat(dir_fd, filename.c_str(),
+          O_CREAT | O_EXCL | O_WRONLY, 0666);
+      iov_.clear();
+      bytes_ = 0;
+    }
+    bool File_Sink::is_open() const
+    {
+      return fd_ != -1;
+    }
+
+    void File_Sink::push(const char *begin, size_t n)
+    {
+      if (!n)
+        return;
+      // coalesce contiguous slices
+      if (!iov_.empty()) {
+        iovec &last = iov_.back();
+        if (static_cast<const char*>(last.iov_base) + last.iov_len == begin) {
+          last.iov_len += n;
+          return;
+        }
+      }
+      if (iov_.size() == IOV_MAX)
+        flush();
+      iov_.push_back(iovec{const_cast<char*>(begin), n});
+    }
+
+    void File_Sink::flush()
+    {
+      iovec *i = iov_.data();
+      iovec *e = i + iov_.size();
+      while (i != e) {
+        ssize_t r = ::writev(fd_, i, e - i);
+        if (r == -1) {
+          if (errno == EINTR)
+            continue;
+          throw system_error(errno, system_category(), "writev");
+        }
+        bytes_ += r;
+        // partial write
+        size_t n = r;
+        for (; i != e && n >= i->iov_len; ++i)
+          n -= i->iov_len;
+        if (n) {
+          i->iov_base = static_cast<char*>(i->iov_base) + n;
+          i->iov_len -= n;
+        }
+      }
+      iov_.clear();
+    }
+
+    void File_Sink::close()
+    {
+      flush();
+      int fd = fd_;
+      fd_ = -1;
+      posix::fsync(fd);
+      posix::close(fd);
+    }
+
+    size_t File_Sink::bytes() const
+    {
+      return bytes_;
+    }
+
+  }
+}
@@ -0,0 +1,63 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef COPY_FILE_SINK_H
+#define COPY_FILE_SINK_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <sys/uio.h>
+
+namespace IMAP {
+  namespace Copy {
+
+    // Writes slices (e.g. as reported by
+    // IMAP::Client::Parser::set_slice_literals()) to a file without
+    // copying them - they are collected and written with writev()
+    // on flush().
+    //
+    // Thus, the slices have to stay valid until the next flush().
+    class File_Sink {
+      private:
+        int                 fd_    {-1};
+        std::vector<iovec>  iov_;
+        size_t              bytes_ {0};
+      public:
+        File_Sink();
+        File_Sink(const File_Sink &) =delete;
+        File_Sink &operator=(const File_Sink &) =delete;
+        ~File_Sink();
+
+        // create a new file relative to a directory
+        void open(int dir_fd, const std::string &filename);
+        bool is_open() const;
+        void push(const char *begin, size_t n);
+        void flush();
+        // flush, fsync and close
+        void close();
+        // bytes written since the last open()
+        size_t bytes() const;
+    };
+
+  }
+}
+
+#endif
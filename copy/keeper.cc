@@ -0,0 +1,153 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "keeper.h"
+#include "options.h"
+
+#include <net/client.h>
+
+#include <exception>
+
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/system/error_code.hpp>
+
+using namespace std;
+
+namespace IMAP {
+  namespace Copy {
+
+    Keeper::Keeper(const Options &opts, Net::Client::Base &client,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+      :
+        IMAP::Client::Base([&client](std::vector<char> &v) {
+              client.push_write(v);
+            }, lg),
+        opts_(opts),
+        client_(client),
+        lg_(lg),
+        parser_(buffer_, tag_buffer_, *this)
+    {
+    }
+
+    void Keeper::async_login(Done_Fn fn)
+    {
+      fn_ = std::move(fn);
+      greeting_fn_ = [this]() {
+        if (preauth_) {
+          BOOST_LOG(lg_) << "Pre-authenticated connection, skipping LOGIN";
+          finish(true);
+        } else if (capabilities_.empty()) {
+          async_capabilities([this]() { do_login(); });
+        } else {
+          do_login();
+        }
+      };
+      do_read();
+    }
+    void Keeper::do_login()
+    {
+      using namespace IMAP::Server::Response;
+      if (!capabilities_.count(Capability::IMAP4rev1)
+          || capabilities_.count(Capability::LOGINDISABLED)) {
+        BOOST_LOG_SEV(lg_, Log::WARN) << "Can't log in on the spare connection";
+        finish(false);
+        return;
+      }
+      IMAP::Client::Base::async_login(opts_.username, opts_.password,
+          [this]() { finish(true); });
+    }
+    void Keeper::async_noop(Done_Fn fn)
+    {
+      fn_ = std::move(fn);
+      // i.e. the previous session got the greeting
+      greeted_ = true;
+      IMAP::Client::Base::async_noop([this]() { finish(true); });
+      do_read();
+    }
+    void Keeper::async_logout(Done_Fn fn)
+    {
+      fn_ = std::move(fn);
+      greeted_ = true;
+      IMAP::Client::Base::async_logout([this]() { finish(true); });
+      do_read();
+    }
+
+    void Keeper::do_read()
+    {
+      auto self = shared_from_this();
+      client_.async_read_some([this, self](
+            const boost::system::error_code &ec, size_t size)
+          {
+            if (!fn_)
+              return;
+            if (ec) {
+              BOOST_LOG_SEV(lg_, Log::DEBUG) << "Idle connection: " << ec.message();
+              finish(false);
+              return;
+            }
+            try {
+              parser_.read(client_.input().data(), client_.input().data() + size);
+            } catch (const std::exception &e) {
+              BOOST_LOG_SEV(lg_, Log::WARN) << "Idle connection: " << e.what();
+              finish(false);
+              return;
+            }
+            // i.e. no read is pending after the sequence is completed
+            if (fn_)
+              do_read();
+          });
+    }
+
+    void Keeper::finish(bool ok)
+    {
+      if (!fn_)
+        return;
+      auto fn = std::move(fn_);
+      fn_ = nullptr;
+      fn(ok);
+    }
+
+    void Keeper::imap_untagged_status_end(IMAP::Server::Response::Status c)
+    {
+      if (greeted_)
+        return;
+      greeted_ = true;
+      if (c == IMAP::Server::Response::Status::BYE) {
+        finish(false);
+        return;
+      }
+      preauth_ = c == IMAP::Server::Response::Status::PREAUTH;
+      if (greeting_fn_) {
+        auto fn = std::move(greeting_fn_);
+        greeting_fn_ = nullptr;
+        fn();
+      }
+    }
+    void Keeper::imap_status_code_capability_begin()
+    {
+      capabilities_.clear();
+    }
+    void Keeper::imap_capability(IMAP::Server::Response::Capability capability)
+    {
+      capabilities_.insert(capability);
+    }
+
+  }
+}
@@ -0,0 +1,79 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef COPY_KEEPER_H
+#define COPY_KEEPER_H
+
+#include <imap/client_base.h>
+#include <imap/client_parser.h>
+#include <log/log.h>
+
+#include <functional>
+#include <memory>
+#include <unordered_set>
+
+namespace Net { namespace Client { class Base; } }
+
+namespace IMAP {
+  namespace Copy {
+    class Options;
+
+    // Runs one IMAP command sequence on an idle connection of the
+    // Net::Client::Pool - the greeting and LOGIN of a spare connection,
+    // a NOOP to keep it alive or the final LOGOUT. It stops reading when
+    // the sequence is completed, such that the next session can take
+    // the connection over. Failures (e.g. a tagged NO or a disconnect)
+    // are reported via fn(false) instead of thrown.
+    class Keeper : public IMAP::Client::Base,
+                   public std::enable_shared_from_this<Keeper> {
+      public:
+        using Done_Fn = std::function<void(bool ok)>;
+      private:
+        const Options                                        &opts_;
+        Net::Client::Base                                    &client_;
+        boost::log::sources::severity_logger<Log::Severity> &lg_;
+        IMAP::Client::Parser                                  parser_;
+        Done_Fn                                               fn_;
+        bool                                                  greeted_ {false};
+        bool                                                  preauth_ {false};
+        std::function<void(void)>                             greeting_fn_;
+        std::unordered_set<IMAP::Server::Response::Capability> capabilities_;
+
+        void do_read();
+        void do_login();
+        void finish(bool ok);
+      protected:
+        void imap_untagged_status_end(IMAP::Server::Response::Status c) override;
+        void imap_status_code_capability_begin() override;
+        void imap_capability(IMAP::Server::Response::Capability capability) override;
+      public:
+        Keeper(const Options &opts, Net::Client::Base &client,
+            boost::log::sources::severity_logger<Log::Severity> &lg);
+
+        // have to be called on a shared_ptr
+        void async_login (Done_Fn fn);
+        void async_noop  (Done_Fn fn);
+        void async_logout(Done_Fn fn);
+    };
+
+  }
+}
+
+#endif
@@ -18,71 +18,40 @@
     along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
 
 }}} */
-#include "client.h"
+#include "runner.h"
 #include "options.h"
 #include <log/log.h>
 
 using namespace IMAP::Copy;
 
-#include <utility>
 #include <exception>
 #include <iostream>
-#include <memory>
+#include <vector>
 using namespace std;
 
 #include <boost/log/sources/record_ostream.hpp>
-#include <boost/exception/diagnostic_information.hpp>
-#include <boost/log/support/exception.hpp>
 
 int main(int argc, char **argv)
 {
   try {
-    Options opts(argc, argv);
+    vector<Options> sessions(parse_sessions(argc, argv));
+    const Options &opts = sessions.front();
+
+    if (opts.log_async)
+      Log::setup_async(opts.log_overflow_policy);
     // no std::move() because return value is an r-value
     boost::log::sources::severity_logger<Log::Severity> lg(Log::create(
             static_cast<Log::Severity>(opts.severity),
             static_cast<Log::Severity>(opts.file_severity),
             opts.logfile));
 
-    try {
-      BOOST_LOG(lg) << "Startup.";
-      BOOST_LOG(lg) << "Username: |" << opts.username << "|";
-      BOOST_LOG_SEV(lg, Log::INSANE) << "Password: |" << opts.password << "|";
-      BOOST_LOG(lg) << "Parsing options ... done";
-
-      boost::asio::io_service io_service;
-      boost::asio::ssl::context context(boost::asio::ssl::context::sslv23);
-
-      unique_ptr<Net::Client::Base> net_client;
-      if (opts.use_ssl) {
-        unique_ptr<Net::Client::Base> c(
-            new Net::TCP::SSL::Client::Base(io_service, context, opts, lg));
-        net_client = std::move(c);
-      } else {
-        unique_ptr<Net::Client::Base> c(
-            new Net::TCP::Client::Base(io_service, opts, lg));
-        net_client = std::move(c);
-      }
-      IMAP::Copy::Client client(opts, *net_client, lg);
-
-      io_service.run();
-    } catch (const exception &e) {
-      BOOST_LOG_SEV(lg, Log::ERROR) << e.what();
-
-      auto tfu = boost::get_error_info<boost::throw_function>(e);
-      auto tfi = boost::get_error_info<boost::throw_file>(e);
-      auto tl  = boost::get_error_info<boost::throw_line>(e);
-      BOOST_LOG_SEV(lg, Log::DEBUG) << "in "
-        << (tfu?*tfu:"") << " (" << (tfi?*tfi:"") << ':' << (tl?*tl:0) << ")"
-        ;
-      auto si = boost::get_error_info<boost::log::current_scope_info>(e);
-      if (si)
-        BOOST_LOG_SEV(lg, Log::DEBUG) << "Scope stack: " << *si;
-
-      //BOOST_LOG_SEV(lg, Log::ERROR) << boost::diagnostic_information(e);
+    BOOST_LOG(lg) << "Startup.";
+    BOOST_LOG(lg) << "Parsing options ... done";
 
+    bool ok = run_sessions(sessions, opts.threads, lg);
+    Log::stop();
+    if (!ok)
       return 1;
-    }
   } catch (const exception &e) {
     cerr << "Error: " << e.what() << '\n';
     return 1;
@@ -23,6 +23,7 @@
 #include "id.h"
 
 #include <exception.h>
+#include "config.h"
 #include <net/ssl_util.h>
 #include <ixxx/ansi.h>
 
@@ -31,6 +32,8 @@
 #include <sstream>
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 #include <string.h>
 #include <stdlib.h>
@@ -57,6 +60,18 @@ namespace OPT {
   static const char LOCAL_ADDRESS[]  = "bind"          ;
   static const char LOCAL_PORT[]     = "lport"         ;
   static const char IP[]             = "ip"            ;
+  static const char TUNNEL[]         = "tunnel"        ;
+  static const char UNIX_SOCKET[]    = "unix_socket"   ;
+  static const char CONNECT_TIMEOUT[]   = "connect_timeout"  ;
+  static const char HANDSHAKE_TIMEOUT[] = "handshake_timeout";
+  static const char RCVBUF_KB[]      = "rcvbuf_kb"     ;
+  static const char SNDBUF_KB[]      = "sndbuf_kb"     ;
+  static const char NODELAY[]        = "nodelay"       ;
+  static const char KEEPALIVE_IDLE[]     = "keepalive_idle"    ;
+  static const char KEEPALIVE_INTERVAL[] = "keepalive_interval";
+  static const char KEEPALIVE_COUNT[]    = "keepalive_count"   ;
+  static const char QUICKACK[]       = "quickack"      ;
+  static const char CONGESTION[]     = "congestion"    ;
 
   static const char FINGERPRINT[]    = "fp"            ;
   static const char CIPHER[]         = "cipher"        ;
@@ -72,10 +87,15 @@ namespace OPT {
 //  static const char SEVERITY[]       = "verbose"       ;
   static const char SEVERITY_S[]     = "verbose,v"     ;
   static const char FILE_SEVERITY[]  = "log_v"         ;
+  static const char LOG_ASYNC[]      = "log_async"     ;
+  static const char LOG_OVERFLOW[]   = "log_overflow"  ;
 
   static const char CONFIGFILE[]     = "config"        ;
 
   static const char ACCOUNT[]        = "account"       ;
+  static const char THREADS[]        = "threads"       ;
+  static const char NOOP_INTERVAL[]  = "noop_interval" ;
+  static const char SPARE[]          = "spare"         ;
 //  static const char DELETE[]         = "delete"        ;
   static const char DELETE_S[]       = "delete,d"      ;
   static const char MAILBOX[]        = "mailbox"       ;
@@ -87,6 +107,19 @@ namespace OPT {
   static const char LIST[]           = "list"          ;
   static const char LIST_REFERENCE[] = "list_reference";
   static const char LIST_MAILBOX[]   = "list_mailbox"  ;
+  static const char PARTS[]          = "parts"         ;
+  static const char MAX_PART_KB[]    = "max_part_kb"   ;
+  static const char BINARY[]         = "binary"        ;
+  static const char FETCH_WINDOW[]   = "fetch_window"  ;
+  static const char VALIDATE[]       = "validate"      ;
+  static const char VALIDATE_FIRST[] = "validate_first";
+  static const char MAX_COMMAND_LENGTH[] = "max_command_length";
+  static const char INPUT_MIN_KB[]   = "input_min_kb"  ;
+  static const char INPUT_MAX_KB[]   = "input_max_kb"  ;
+  static const char DRAIN_KB[]       = "drain_kb"      ;
+  static const char TLS_CACHE[]      = "tls_cache"     ;
+  static const char TLS_CACHE_TTL[]  = "tls_cache_ttl" ;
+  static const char KTLS[]           = "ktls"          ;
 }
 
 namespace KEY {
@@ -98,6 +131,16 @@ namespace KEY {
   static const char LOCAL_PORT[]    = "lport"         ;
   static const char HOST[]          = "host"          ;
   static const char SERVICE[]       = "port"          ;
+  static const char TUNNEL[]        = "tunnel"        ;
+  static const char UNIX_SOCKET[]   = "unix_socket"   ;
+  static const char RCVBUF_KB[]     = "rcvbuf_kb"     ;
+  static const char SNDBUF_KB[]     = "sndbuf_kb"     ;
+  static const char NODELAY[]       = "nodelay"       ;
+  static const char KEEPALIVE_IDLE[]     = "keepalive_idle"    ;
+  static const char KEEPALIVE_INTERVAL[] = "keepalive_interval";
+  static const char KEEPALIVE_COUNT[]    = "keepalive_count"   ;
+  static const char QUICKACK[]      = "quickack"      ;
+  static const char CONGESTION[]    = "congestion"    ;
 
   static const char SSL[]           = "ssl"           ;
   static const char FINGERPRINT[]   = "fingerprint"   ;
@@ -112,6 +155,9 @@ namespace KEY {
   static const char MAILBOX[]       = "mailbox"       ;
   static const char MAILDIR[]       = "maildir"       ;
   static const char JOURNAL_FILE[]   = "journal"       ;
+  static const char PARTS[]         = "parts"         ;
+  static const char MAX_PART_KB[]   = "max_part_kb"   ;
+  static const char BINARY[]        = "binary"        ;
 
   static const unordered_set<const char*> set = {
     USERNAME,
@@ -121,6 +167,16 @@ namespace KEY {
     LOCAL_PORT,
     HOST,
     SERVICE,
+    TUNNEL,
+    UNIX_SOCKET,
+    RCVBUF_KB,
+    SNDBUF_KB,
+    NODELAY,
+    KEEPALIVE_IDLE,
+    KEEPALIVE_INTERVAL,
+    KEEPALIVE_COUNT,
+    QUICKACK,
+    CONGESTION,
 
     SSL,
     FINGERPRINT,
@@ -134,7 +190,10 @@ namespace KEY {
     DELETE,
     MAILBOX,
     MAILDIR,
-    JOURNAL_FILE
+    JOURNAL_FILE,
+    PARTS,
+    MAX_PART_KB,
+    BINARY
   };
 }
 
@@ -170,6 +229,11 @@ namespace IMAP {
 
 
     Options::Options(int argc, char **argv)
+      :
+        Options(argc, argv, string())
+    {
+    }
+    Options::Options(int argc, char **argv, const std::string &account_name)
     {
       po::options_description hidden_group;
       //hidden_group.add_options()
@@ -199,8 +263,10 @@ namespace IMAP {
       }
       if (vm.count(OPT::CONFIGFILE))
         configfile = vm[OPT::CONFIGFILE].as<string>();
-      if (vm.count(OPT::ACCOUNT))
-        account = vm[OPT::ACCOUNT].as<string>();
+      if (!account_name.empty())
+        account = account_name;
+      else if (vm.count(OPT::ACCOUNT))
+        account = vm[OPT::ACCOUNT].as<vector<string> >().front();
       load();
       po::notify(vm);
 
@@ -250,14 +316,65 @@ namespace IMAP {
            ->default_value(0, "same as non-file")
            ->implicit_value(7), //->value_name("bool"),
            "default verbosity for log file, level, 0 means nothing - higher means more")
+        (OPT::LOG_ASYNC, po::value<bool>(&log_async)
+           ->default_value(false)->implicit_value(true)->value_name("bool"),
+           "format and write log messages in a separate thread")
+        (OPT::LOG_OVERFLOW, po::value<string>(&log_overflow)
+           ->default_value("block"),
+           "what happens when the asynchronous log queue is full: "
+           "drop, block or count (i.e. drop and report the number)")
         ;
     }
     void Options_Priv::add_net_opts(po::options_description &net_group)
     {
       net_group.add_options()
+        (OPT::TUNNEL, po::value<string>(&tunnel)
+           //->default_value(""),
+           , "instead of connecting via TCP, talk IMAP to stdin/stdout of "
+             "this command, e.g. 'ssh host /usr/libexec/dovecot/imap' - "
+             "LOGIN is skipped if the server sends a PREAUTH greeting")
+        (OPT::UNIX_SOCKET, po::value<string>(&unix_socket)
+           //->default_value(""),
+           , "instead of connecting via TCP, connect to this Unix domain socket")
         (OPT::IP, po::value<unsigned>(&ip)
            //->default_value(4),
-           , "IP version - 4 or 6 (default: 4)")
+           , "preferred IP version - 4 or 6, the other one is tried in "
+             "parallel after a short delay (default: 4)")
+        (OPT::CONNECT_TIMEOUT, po::value<unsigned>(&connect_timeout)
+           ->default_value(30)
+           , "seconds until the connect fails (0: no timeout)")
+        (OPT::HANDSHAKE_TIMEOUT, po::value<unsigned>(&handshake_timeout)
+           ->default_value(30)
+           , "seconds until the TLS handshake fails (0: no timeout)")
+        (OPT::RCVBUF_KB, po::value<unsigned>(&rcvbuf_kb)
+           //->default_value(0),
+           , "socket receive buffer size (SO_RCVBUF) in KiB, e.g. for long fat "
+             "pipes - 0 means kernel autotuning (default: 0)")
+        (OPT::SNDBUF_KB, po::value<unsigned>(&sndbuf_kb)
+           //->default_value(0),
+           , "socket send buffer size (SO_SNDBUF) in KiB - 0 means kernel "
+             "autotuning (default: 0)")
+        (OPT::NODELAY, po::value<bool>(&nodelay)
+           ->implicit_value(true, "true")->value_name("bool"),
+           "disable Nagle's algorithm (TCP_NODELAY) (default: true)")
+        (OPT::KEEPALIVE_IDLE, po::value<unsigned>(&keepalive_idle)
+           //->default_value(0),
+           , "seconds until the first TCP keepalive probe - 0 disables "
+             "keepalive (default: 0)")
+        (OPT::KEEPALIVE_INTERVAL, po::value<unsigned>(&keepalive_interval)
+           //->default_value(0),
+           , "seconds between TCP keepalive probes (default: system default)")
+        (OPT::KEEPALIVE_COUNT, po::value<unsigned>(&keepalive_count)
+           //->default_value(0),
+           , "unanswered TCP keepalive probes until the connection is dropped "
+             "(default: system default)")
+        (OPT::QUICKACK, po::value<bool>(&quickack)
+           ->implicit_value(true, "true")->value_name("bool"),
+           "don't delay ACKs (TCP_QUICKACK) (default: false)")
+        (OPT::CONGESTION, po::value<string>(&congestion)
+           //->default_value(""),
+           , "TCP congestion control algorithm, e.g. cubic or bbr "
+             "(default: system default)")
         (OPT::LOCAL_ADDRESS, po::value<string>(&local_address)
            //->default_value(""),
            , "local address to bind to (default: system default)")
@@ -268,6 +385,18 @@ namespace IMAP {
            //->default_value("", "imaps or imap"),
            , "remote service name or port - usually imaps=993 (SSL) and imap=143"
            " (default: imaps or imap)")
+        (OPT::INPUT_MIN_KB, po::value<unsigned>(&input_min_kb)
+           ->default_value(4)
+           , "minimal size of the receive buffer in KiB")
+        (OPT::INPUT_MAX_KB, po::value<unsigned>(&input_max_kb)
+           ->default_value(256)
+           , "maximal size of the receive buffer in KiB - it grows while "
+             "reads fill it completely")
+        (OPT::DRAIN_KB, po::value<unsigned>(&drain_kb)
+           ->default_value(1024)
+           , "read up to that many KiB with non-blocking reads after "
+             "each completed asynchronous read, over TLS without kTLS only "
+             "what was already received (0: disable)")
         ;
     }
     void Options_Priv::add_ssl_opts(po::options_description &ssl_group)
@@ -303,7 +432,24 @@ namespace IMAP {
            ->implicit_value(true, "true"),
            "enable/disable use of TLSv1 - disabling means that only TLSv1.1/TLSv1.2 "
            "are allowed. (default: true)")
+        (OPT::TLS_CACHE, po::value<string>(&session_cache)
+         ->default_value("", "$HOME/.config/"  + string(ID::argv0) + "/$ACCOUNT.tls"),
+           "file for storing TLS sessions, i.e. the next run can resume "
+           "the session instead of doing a full handshake - with several "
+           "accounts, \".$ACCOUNT\" is appended")
+        (OPT::TLS_CACHE_TTL, po::value<unsigned>(&session_ttl)
+         ->default_value(86400)
+           , "maximal age of a cached TLS session in seconds (0: no caching)")
         ;
+#if defined(IMAPDL_USE_KTLS)
+      ssl_group.add_options()
+        (OPT::KTLS, po::value<bool>(&ktls)
+           ->implicit_value(true, "true"),
+           "experimental: try to offload the record encryption to the "
+           "kernel (kTLS) - falls back to userspace if not supported "
+           "(default: false)")
+        ;
+#endif
     }
     void Options_Priv::add_test_opts(po::options_description &test_group)
     {
@@ -317,16 +463,35 @@ namespace IMAP {
     void Options_Priv::add_imap_opts(po::options_description &imap_group)
     {
       imap_group.add_options()
-        (OPT::ACCOUNT, po::value<string>(&account)->default_value("default"),
-           "account name - is used to find section in configuration file")
+        (OPT::ACCOUNT, po::value<vector<string> >(&accounts)
+           ->default_value(vector<string>(1, "default"), "default"),
+           "account name - is used to find section in configuration file - "
+           "can be specified multiple times, then each account is downloaded "
+           "in its own session")
+        (OPT::THREADS, po::value<unsigned>(&threads)->default_value(1),
+           "number of threads - i.e. how many accounts are downloaded "
+           "in parallel (accounts that share a connection are downloaded "
+           "one after another)")
+        (OPT::NOOP_INTERVAL, po::value<unsigned>(&noop_interval)
+           ->default_value(120),
+           "interval (in seconds) of the NOOP commands that keep an idle "
+           "connection alive, 0 disables them - accounts with the same "
+           "server, TLS settings, username and password share a connection")
+        (OPT::SPARE, po::value<bool>(&spare)
+           ->default_value(true)->implicit_value(true)->value_name("bool"),
+           "log in to the server of the next account while the current "
+           "one is downloaded - i.e. only if they differ in server, TLS "
+           "settings, username or password")
         (OPT::CONFIGFILE,
            po::value<string>(&configfile)
            ->default_value("", "$HOME/.config/" + string(ID::argv0) + "/rc.json"),
            "configuration file where account credentials etc. are read from")
         (OPT::MAILBOX,
-           po::value<string>(&mailbox)
+           po::value<vector<string> >(&mailboxes)
            //->default_value("INBOX"),
-           , "configuration file where account credentials etc. are read from (default: INBOX)")
+           , "mailbox to download - can be specified multiple times, then "
+             "the mailboxes are downloaded one after another over the same "
+             "connection (default: INBOX)")
         (OPT::GREETING_WAIT,
            po::value<unsigned>(&greeting_wait)
            ->default_value(100)
@@ -346,7 +511,8 @@ namespace IMAP {
         (OPT::JOURNAL_FILE, po::value<string>(&journal_file)
          ->default_value("", "$HOME/.config/"  + string(ID::argv0) + "/$ACCOUNT.journal"),
            "write already fetched and not yet expunged messages to a journal "
-           "for expunging on the next connect")
+           "for expunging on the next connect - with several accounts, "
+           "\".$ACCOUNT\" is appended")
         (OPT::FETCH_HEADER, po::value<bool>(&fetch_header_only)
          ->default_value(false, "false")
          ->implicit_value(true, "true")
@@ -360,13 +526,58 @@ namespace IMAP {
         (OPT::LIST_MAILBOX, po::value<string>(&list_mailbox)
          ->default_value("%")
          , "LIST mailbox argument")
+        (OPT::PARTS, po::value<string>(&parts)
+           //->default_value("all"),
+           , "MIME parts to download: all, text (text parts that aren't "
+             "attachments) or small (text parts and attachments up to max_part_kb) "
+             "- omitted parts are replaced with a note (default: all)")
+        (OPT::MAX_PART_KB, po::value<unsigned>(&max_part_kb)
+           //->default_value(0),
+           , "size limit (in KiB) of attachments for parts=small (default: 0)")
+        (OPT::BINARY, po::value<bool>(&binary)
+         ->default_value(false, "false")
+         ->implicit_value(true, "true")
+         , "fetch base64 encoded parts of multipart messages decoded "
+           "(RFC3516 BINARY, if supported by the server) and encode them "
+           "locally again")
+        (OPT::FETCH_WINDOW, po::value<unsigned>(&fetch_window)
+         ->default_value(32)
+           , "maximal number of pipelined UID FETCH commands when messages "
+             "are fetched one by one (e.g. with parts=text)")
+        (OPT::VALIDATE, po::value<string>(&validate)
+           , "check outgoing commands against the IMAP grammar: always, "
+             "first (only the first validate_first commands of each type) or "
+             "debug (only in debug builds) (default: always)")
+        (OPT::VALIDATE_FIRST, po::value<unsigned>(&validate_first)
+         ->default_value(1)
+           , "number of commands per type that are checked with validate=first")
+        (OPT::MAX_COMMAND_LENGTH, po::value<unsigned>(&max_command_length)
+         ->default_value(8192)
+           , "split UID STORE/EXPUNGE/FETCH commands with longer lines into several "
+             "ones (0: unlimited)")
         ;
     }
 
+    // i.e. setsockopt() takes an int - larger values are capped
+    // by the kernel, anyway
+    static unsigned socket_buffer_size(unsigned kb)
+    {
+      return unsigned(min<size_t>(size_t(kb) * 1024,
+            size_t(numeric_limits<int>::max())));
+    }
+
     void Options::fix()
     {
       if (maildir.substr(0, 2) == "~/")
         maildir = ansi::getenv("HOME") + maildir.substr(1);
+      if (mailboxes.empty())
+        mailboxes.push_back(mailbox);
+      mailbox = mailboxes.front();
+      if (!tunnel.empty() && !unix_socket.empty())
+        THROW_MSG("Either specify a tunnel or a Unix domain socket");
+      // for the log messages
+      if (host.empty())
+        host = tunnel.empty() ? unix_socket : tunnel;
       if (cert_host.empty())
         cert_host = host;
       if (cipher.empty())
@@ -381,16 +592,49 @@ namespace IMAP {
       }
       if (!file_severity)
         file_severity = severity;
+      // sessions must not write into the same trace file, journal or
+      // TLS session cache (the defaults already contain the account)
+      if (accounts.size() > 1) {
+        if (!tracefile.empty())
+          tracefile += "." + account;
+        if (!journal_file.empty())
+          journal_file += "." + account;
+        if (!session_cache.empty())
+          session_cache += "." + account;
+      }
       if (journal_file.empty()) {
         ostringstream o;
         o << ansi::getenv("HOME") << "/.config/" << ID::argv0 << '/'
           << account << ".journal";
         journal_file = o.str();
       }
+      if (session_cache.empty()) {
+        ostringstream o;
+        o << ansi::getenv("HOME") << "/.config/" << ID::argv0 << '/'
+          << account << ".tls";
+        session_cache = o.str();
+      }
       if (fetch_header_only)
         task = Task::FETCH_HEADER;
       if (list)
         task = Task::LIST;
+      if (!parts.empty())
+        part_policy = to_part_policy(parts);
+      if (!validate.empty())
+        validation = IMAP::Client::to_validation(validate);
+      if (!log_overflow.empty())
+        log_overflow_policy = Log::to_overflow(log_overflow);
+      if (!input_min_kb || input_min_kb > input_max_kb) {
+        ostringstream o;
+        o << "Invalid receive buffer sizes: " << input_min_kb << " KiB - "
+          << input_max_kb << " KiB";
+        THROW_MSG(o.str());
+      }
+      min_input_size = size_t(input_min_kb) * 1024;
+      max_input_size = size_t(input_max_kb) * 1024;
+      drain_size = size_t(drain_kb) * 1024;
+      rcvbuf = socket_buffer_size(rcvbuf_kb);
+      sndbuf = socket_buffer_size(sndbuf_kb);
     }
     void Options::verify()
     {
@@ -398,6 +642,13 @@ namespace IMAP {
         throw runtime_error("No host specified on the command line/in the rc file");
       if (maildir.empty())
         throw runtime_error("No maildir specified on the command line/in the rc file");
+      if (!threads)
+        throw runtime_error("At least one thread is needed");
+      for (auto i = accounts.begin(); i != accounts.end(); ++i)
+        if (std::find(i + 1, accounts.end(), *i) != accounts.end())
+          throw runtime_error("Account " + *i + " is specified more than once");
+      if (!fetch_window)
+        throw runtime_error("The fetch window must not be empty");
     }
 
     static const char default_rc_file[] =
@@ -433,8 +684,17 @@ R"({
     "password"      : "muchsecret",
     "host"          : "imap.example.org",
     "ca_path"       : "some/path",
+    "rcvbuf_kb"     : 4096,
+    "keepalive_idle": 60,
     "maildir"       : "~/maildir/example",
     "delete"        : true
+  },
+  "5th_example_account":
+  {
+    "username"      : "juser",
+    "password"      : "unused with a PREAUTH greeting",
+    "tunnel"        : "ssh imap.example.org /usr/libexec/dovecot/imap",
+    "maildir"       : "~/maildir/example"
   }
 }
 )";
@@ -512,6 +772,16 @@ R"({
       local_port    = sub_tree.get<unsigned short> (KEY::LOCAL_PORT   , 0       );
       host          = sub_tree.get<string>         (KEY::HOST         , ""      );
       service       = sub_tree.get<string>         (KEY::SERVICE      , ""      );
+      tunnel        = sub_tree.get<string>         (KEY::TUNNEL       , ""      );
+      unix_socket   = sub_tree.get<string>         (KEY::UNIX_SOCKET  , ""      );
+      rcvbuf_kb     = sub_tree.get<unsigned>       (KEY::RCVBUF_KB    , 0       );
+      sndbuf_kb     = sub_tree.get<unsigned>       (KEY::SNDBUF_KB    , 0       );
+      nodelay       = sub_tree.get<bool>           (KEY::NODELAY      , true    );
+      keepalive_idle     = sub_tree.get<unsigned>  (KEY::KEEPALIVE_IDLE    , 0);
+      keepalive_interval = sub_tree.get<unsigned>  (KEY::KEEPALIVE_INTERVAL, 0);
+      keepalive_count    = sub_tree.get<unsigned>  (KEY::KEEPALIVE_COUNT   , 0);
+      quickack      = sub_tree.get<bool>           (KEY::QUICKACK     , false   );
+      congestion    = sub_tree.get<string>         (KEY::CONGESTION   , ""      );
 
       use_ssl       = sub_tree.get<bool>           (KEY::SSL          , true    );
       fingerprint   = sub_tree.get<string>         (KEY::FINGERPRINT  , ""      );
@@ -524,8 +794,15 @@ R"({
 
       del           = sub_tree.get<bool>           (KEY::DELETE       , false   );
       mailbox       = sub_tree.get<string>         (KEY::MAILBOX      , "INBOX" );
+      // or an array of mailboxes
+      if (auto a = sub_tree.get_child_optional(KEY::MAILBOX))
+        for (auto &i : *a)
+          mailboxes.push_back(i.second.data());
       maildir       = sub_tree.get<string>         (KEY::MAILDIR      , ""      );
       journal_file  = sub_tree.get<string>         (KEY::JOURNAL_FILE , ""      );
+      parts         = sub_tree.get<string>         (KEY::PARTS        , "all"   );
+      max_part_kb   = sub_tree.get<unsigned>       (KEY::MAX_PART_KB  , 0       );
+      binary        = sub_tree.get<bool>           (KEY::BINARY       , false   );
     }
     std::ostream &Options::print(std::ostream &o) const
     {
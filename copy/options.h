@@ -22,6 +22,9 @@
 #define IMAP_COPY_OPTIONS_H
 
 #include <net/tcp_client.h>
+#include <imap/client_writer.h>
+#include <copy/part_filter.h>
+#include <log/log.h>
 
 #include <string>
 #include <ostream>
@@ -39,6 +42,9 @@ namespace IMAP {
       public:
         Options();
         Options(int argc, char **argv);
+        // read the options of one of the accounts that are given
+        // on the command line
+        Options(int argc, char **argv, const std::string &account_name);
         void fix();
         void verify();
         void check_configfile();
@@ -46,10 +52,25 @@ namespace IMAP {
         std::ostream &print(std::ostream &o) const;
 
         std::string logfile;
+        bool        log_async      {false};
+        std::string log_overflow;
         bool        use_ssl        {true};
+        // instead of TCP, e.g. for a PREAUTH server on the same host
+        std::string tunnel;
+        std::string unix_socket;
         std::string account;
+        // all accounts given on the command line, account is one of them
+        std::vector<std::string> accounts;
+        unsigned    threads        {1};
+        // seconds, idle pooled connections are kept alive with NOOP
+        unsigned    noop_interval  {120};
+        // open the connection of the next account ahead of time
+        bool        spare          {true};
         std::string configfile;
         std::string mailbox;
+        // downloaded one after another over the same session,
+        // mailbox is the first one
+        std::vector<std::string> mailboxes;
         std::string maildir;
         bool        del            {false};
         std::string username;
@@ -61,8 +82,24 @@ namespace IMAP {
         bool        list           {true};
         std::string list_reference;
         std::string list_mailbox;
+        std::string parts;
+        unsigned    max_part_kb    {0};
+        bool        binary         {false};
+        unsigned    fetch_window   {32};
+        std::string validate;
+        unsigned    validate_first {1};
+        // RFC 7162 recommends about 8 KiB
+        unsigned    max_command_length {8192};
+        unsigned    input_min_kb   {4};
+        unsigned    input_max_kb   {256};
+        unsigned    drain_kb       {1024};
+        unsigned    rcvbuf_kb      {0};
+        unsigned    sndbuf_kb      {0};
 
         Task        task           {Task::DOWNLOAD};
+        Part_Policy part_policy    {Part_Policy::ALL};
+        IMAP::Client::Validation validation {IMAP::Client::Validation::ALWAYS};
+        Log::Overflow log_overflow_policy {Log::Overflow::BLOCK};
 
     };
     std::ostream &operator<<(std::ostream &o, const Options &opts);
@@ -0,0 +1,272 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "part_filter.h"
+
+#include <exception.h>
+#include <enum.h>
+#include <mime/base64_encoder.h>
+
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace IMAP {
+  namespace Copy {
+
+    static const char *const part_policy_map[] = {
+      "all",
+      "text",
+      "small"
+    };
+    std::ostream &operator<<(std::ostream &o, Part_Policy p)
+    {
+      o << enum_str(part_policy_map, p);
+      return o;
+    }
+    Part_Policy to_part_policy(const std::string &s)
+    {
+      for (unsigned i = 0; i < sizeof(part_policy_map)/sizeof(part_policy_map[0]);
+          ++i)
+        if (s == part_policy_map[i])
+          return static_cast<Part_Policy>(i + 1);
+      ostringstream o;
+      o << "Unknown part policy: " << s << " (expected: all, text or small)";
+      throw runtime_error(o.str());
+    }
+
+    Part_Filter::Part_Filter()
+    {
+    }
+    Part_Filter::Part_Filter(Part_Policy policy, uint64_t max_bytes)
+      :
+        policy_(policy),
+        max_bytes_(max_bytes)
+    {
+    }
+    Part_Policy Part_Filter::policy() const
+    {
+      return policy_;
+    }
+    void Part_Filter::set_binary(bool b)
+    {
+      binary_ = b;
+    }
+    bool Part_Filter::binary() const
+    {
+      return binary_;
+    }
+    bool Part_Filter::binary(const IMAP::Client::Body_Part &p) const
+    {
+      return binary_ && p.encoding == "base64";
+    }
+
+    bool Part_Filter::selected(const IMAP::Client::Body_Part &p) const
+    {
+      switch (policy_) {
+        case Part_Policy::ALL:
+          return true;
+        case Part_Policy::TEXT:
+          return p.is_text() && p.disposition != "attachment";
+        case Part_Policy::SMALL:
+          return (p.is_text() && p.disposition != "attachment")
+            || p.octets <= max_bytes_;
+        default:
+          ;
+      }
+      throw logic_error("unknown part policy");
+    }
+
+    bool Part_Filter::omits(const IMAP::Client::Body_Part &p) const
+    {
+      if (!p.is_multipart())
+        return !selected(p);
+      for (auto &c : p.children)
+        if (omits(c))
+          return true;
+      return false;
+    }
+
+    bool Part_Filter::has_binary(const IMAP::Client::Body_Part &p) const
+    {
+      if (!p.is_multipart())
+        return selected(p) && binary(p);
+      for (auto &c : p.children)
+        if (has_binary(c))
+          return true;
+      return false;
+    }
+
+    static bool has_boundaries(const IMAP::Client::Body_Part &p)
+    {
+      if (!p.is_multipart())
+        return true;
+      if (!p.parameter("boundary"))
+        return false;
+      for (auto &c : p.children)
+        if (!has_boundaries(c))
+          return false;
+      return true;
+    }
+
+    bool Part_Filter::partial(const IMAP::Client::Body_Part &root) const
+    {
+      return root.is_multipart() && has_boundaries(root)
+        && (omits(root) || has_binary(root));
+    }
+
+    void Part_Filter::add_attributes(const IMAP::Client::Body_Part &p,
+        std::vector<IMAP::Client::Fetch_Attribute> &atts) const
+    {
+      using namespace IMAP::Client;
+      for (auto &c : p.children) {
+        if (c.is_multipart()) {
+          atts.emplace_back(Fetch::BODY_PEEK,
+              Section_Attribute(c.part, Section::MIME));
+          add_attributes(c, atts);
+        } else if (selected(c)) {
+          atts.emplace_back(Fetch::BODY_PEEK,
+              Section_Attribute(c.part, Section::MIME));
+          atts.emplace_back(binary(c) ? Fetch::BINARY_PEEK : Fetch::BODY_PEEK,
+              Section_Attribute(c.part));
+        }
+      }
+    }
+    void Part_Filter::attributes(const IMAP::Client::Body_Part &root,
+        std::vector<IMAP::Client::Fetch_Attribute> &atts) const
+    {
+      using namespace IMAP::Client;
+      atts.emplace_back(Fetch::BODY_PEEK, Section_Attribute(Section::HEADER));
+      add_attributes(root, atts);
+    }
+
+
+    void Message_Assembler::clear()
+    {
+      sections_.clear();
+      binary_sections_.clear();
+      spec_.clear();
+    }
+    void Message_Assembler::section_begin()
+    {
+      spec_.clear();
+    }
+    void Message_Assembler::section_part(uint32_t n)
+    {
+      if (!spec_.empty())
+        spec_ += '.';
+      spec_ += to_string(n);
+    }
+    void Message_Assembler::section_mime()
+    {
+      spec_ += ".MIME";
+    }
+    void Message_Assembler::section_header()
+    {
+      spec_ += spec_.empty() ? "HEADER" : ".HEADER";
+    }
+    void Message_Assembler::section_end(const char *begin, const char *end)
+    {
+      sections_[spec_].assign(begin, end);
+    }
+
+    void Message_Assembler::binary_section_begin()
+    {
+      spec_.clear();
+    }
+    void Message_Assembler::binary_section_end(const char *begin,
+        const char *end)
+    {
+      binary_sections_[spec_].assign(begin, end);
+    }
+
+    const std::string &Message_Assembler::section(const std::string &spec) const
+    {
+      auto i = sections_.find(spec);
+      if (i == sections_.end())
+        THROW_MSG("Server did not send section BODY[" + spec + "]");
+      return i->second;
+    }
+
+    static void omitted_note(const IMAP::Client::Body_Part &p, std::string &out)
+    {
+      ostringstream o;
+      o << "Content-Type: text/plain; charset=us-ascii\n"
+        << "Content-Disposition: inline\n"
+        << "X-Imapdl-Omitted: " << p.type << '/' << p.subtype
+        << "; octets=" << p.octets;
+      const string *name = p.disposition_parameter("filename");
+      if (!name)
+        name = p.parameter("name");
+      if (name)
+        o << "; name=\"" << *name << '"';
+      o << "\n\n"
+        << "[omitted " << p.type << '/' << p.subtype << " part of "
+        << p.octets << " octets]\n";
+      out += o.str();
+    }
+
+    void Message_Assembler::assemble_body(const IMAP::Client::Body_Part &p,
+        const Part_Filter &filter, std::string &out) const
+    {
+      const string &boundary = *p.parameter("boundary");
+      for (auto &c : p.children) {
+        out += "--";
+        out += boundary;
+        out += "\n";
+        string spec(c.part_str());
+        if (c.is_multipart()) {
+          out += section(spec + ".MIME");
+          assemble_body(c, filter, out);
+        } else if (filter.selected(c) && filter.binary(c)) {
+          out += section(spec + ".MIME");
+          auto i = binary_sections_.find(spec);
+          if (i == binary_sections_.end())
+            THROW_MSG("Server did not send section BINARY[" + spec + "]");
+          const string &b = i->second;
+          MIME::Base64::encode(b.data(), b.data() + b.size(), out,
+              MIME::Base64::line_length(b.size(), c.octets), false);
+        } else if (filter.selected(c)) {
+          out += section(spec + ".MIME");
+          out += section(spec);
+        } else {
+          omitted_note(c, out);
+        }
+        // the line break before a delimiter belongs to the delimiter
+        out += "\n";
+      }
+      out += "--";
+      out += boundary;
+      out += "--\n";
+    }
+
+    void Message_Assembler::assemble(const IMAP::Client::Body_Part &root,
+        const Part_Filter &filter, std::string &out) const
+    {
+      if (!filter.partial(root))
+        throw logic_error("message is not partially fetched");
+      out.clear();
+      out += section("HEADER");
+      assemble_body(root, filter, out);
+    }
+
+  }
+}
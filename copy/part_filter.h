@@ -0,0 +1,121 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef COPY_PART_FILTER_H
+#define COPY_PART_FILTER_H
+
+#include <imap/imap.h>
+#include <imap/body_structure.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+
+namespace IMAP {
+  namespace Copy {
+
+    // Which MIME parts of a message are downloaded.
+    enum class Part_Policy : unsigned {
+      FIRST_,
+      // everything, i.e. BODY.PEEK[]
+      ALL,
+      // only text parts that aren't attachments
+      TEXT,
+      // text parts and attachments up to a size limit
+      SMALL,
+      LAST_
+    };
+    std::ostream &operator<<(std::ostream &o, Part_Policy p);
+    // "all", "text" or "small"
+    Part_Policy to_part_policy(const std::string &s);
+
+    class Part_Filter {
+      private:
+        Part_Policy policy_    { Part_Policy::ALL };
+        uint64_t    max_bytes_ {0};
+        bool        binary_    {false};
+        bool omits(const IMAP::Client::Body_Part &p) const;
+        bool has_binary(const IMAP::Client::Body_Part &p) const;
+        void add_attributes(const IMAP::Client::Body_Part &p,
+            std::vector<IMAP::Client::Fetch_Attribute> &atts) const;
+      public:
+        Part_Filter();
+        Part_Filter(Part_Policy policy, uint64_t max_bytes);
+        Part_Policy policy() const;
+        // fetch base64 encoded parts via BINARY.PEEK (RFC3516), i.e.
+        // without the transfer encoding overhead - only enable
+        // when the server has the BINARY capability
+        void set_binary(bool b);
+        bool binary() const;
+
+        // for non-multipart parts
+        bool selected(const IMAP::Client::Body_Part &p) const;
+        // true if the selected part is fetched via BINARY.PEEK
+        bool binary(const IMAP::Client::Body_Part &p) const;
+        // true if parts would be omitted (or fetched via BINARY) - and the
+        // message can be reconstructed from the others, i.e. it is a
+        // multipart and all multiparts specify a boundary
+        bool partial(const IMAP::Client::Body_Part &root) const;
+        // BODY.PEEK/BINARY.PEEK attributes for reconstructing a partial
+        // message
+        void attributes(const IMAP::Client::Body_Part &root,
+            std::vector<IMAP::Client::Fetch_Attribute> &atts) const;
+    };
+
+    // Collects the sections of a partial fetch and reassembles
+    // the message from them - omitted parts are replaced with
+    // a short text/plain note.
+    class Message_Assembler {
+      private:
+        std::map<std::string, std::string> sections_;
+        std::map<std::string, std::string> binary_sections_;
+        std::string spec_;
+
+        const std::string &section(const std::string &spec) const;
+        void assemble_body(const IMAP::Client::Body_Part &p,
+            const Part_Filter &filter, std::string &out) const;
+      public:
+        void clear();
+
+        // build the section spec of the current BODY[...] response,
+        // e.g. "HEADER", "1.2.MIME" or "2"
+        void section_begin();
+        void section_part(uint32_t n);
+        void section_mime();
+        void section_header();
+        void section_end(const char *begin, const char *end);
+        // BINARY[...], section_part() builds the spec
+        void binary_section_begin();
+        void binary_section_end(const char *begin, const char *end);
+
+        // the line endings are LF, as with the converted literals -
+        // binary sections are base64 encoded again, with the line length
+        // guessed from the part size such that the result is identical
+        // to the original encoding in the usual cases
+        void assemble(const IMAP::Client::Body_Part &root,
+            const Part_Filter &filter, std::string &out) const;
+    };
+
+  }
+}
+
+#endif
@@ -0,0 +1,336 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "runner.h"
+#include "client.h"
+#include "keeper.h"
+#include "options.h"
+#include <net/local_client.h>
+#include <net/client_pool.h>
+#include <exception.h>
+
+#include <exception>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/log/support/exception.hpp>
+
+using namespace std;
+
+namespace IMAP {
+  namespace Copy {
+
+    std::vector<Options> parse_sessions(int argc, char **argv)
+    {
+      vector<Options> sessions;
+      sessions.emplace_back(argc, argv);
+      vector<string> accounts(sessions.front().accounts);
+      for (size_t i = 1; i < accounts.size(); ++i)
+        sessions.emplace_back(argc, argv, accounts[i]);
+      return sessions;
+    }
+
+    namespace {
+
+      // i.e. a pooled connection owns its context
+      class SSL_Context {
+        protected:
+          boost::asio::ssl::context ssl_context_ {boost::asio::ssl::context::sslv23};
+      };
+      class SSL_Client : private SSL_Context,
+                         public Net::TCP::SSL::Client::Base {
+        public:
+          SSL_Client(boost::asio::io_service &io_service, const Options &opts,
+              boost::log::sources::severity_logger<Log::Severity> &lg)
+            :
+              Net::TCP::SSL::Client::Base(io_service, ssl_context_, opts, lg)
+          {
+          }
+      };
+
+    }
+
+    static unique_ptr<Net::Client::Base> create_client(
+        boost::asio::io_service &io_service, const Options &opts,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+    {
+      unique_ptr<Net::Client::Base> c;
+      if (!opts.tunnel.empty())
+        c.reset(new Net::Pipe::Client::Base(io_service, opts, opts.tunnel, lg));
+      else if (!opts.unix_socket.empty())
+        c.reset(new Net::Local::Client::Base(io_service, opts, opts.unix_socket, lg));
+      else if (opts.use_ssl)
+        c.reset(new SSL_Client(io_service, opts, lg));
+      else
+        c.reset(new Net::TCP::Client::Base(io_service, opts, lg));
+      return c;
+    }
+
+    // sessions with the same key may share an authenticated connection,
+    // i.e. it includes the username and password and everything the server
+    // was verified against
+    static string session_key(const Options &opts)
+    {
+      ostringstream o;
+      o << opts.tunnel << '\n' << opts.unix_socket << '\n' << opts.use_ssl
+        << '\n' << opts.host << '\n' << opts.service << '\n' << opts.ip
+        << '\n' << opts.username << '\n' << opts.password;
+      if (opts.use_ssl)
+        o << '\n' << opts.fingerprint << '\n' << opts.cert_host
+          << '\n' << opts.ca_file << '\n' << opts.ca_path
+          << '\n' << opts.cipher << '\n' << opts.cipher_preset
+          << '\n' << opts.tls1 << '\n' << opts.ktls;
+      return o.str();
+    }
+
+    static void log_exception(const exception &e,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+    {
+      BOOST_LOG_SEV(lg, Log::ERROR) << e.what();
+
+      auto tfu = boost::get_error_info<boost::throw_function>(e);
+      auto tfi = boost::get_error_info<boost::throw_file>(e);
+      auto tl  = boost::get_error_info<boost::throw_line>(e);
+      BOOST_LOG_SEV(lg, Log::DEBUG) << "in "
+        << (tfu?*tfu:"") << " (" << (tfi?*tfi:"") << ':' << (tl?*tl:0) << ")"
+        ;
+      auto si = boost::get_error_info<boost::log::current_scope_info>(e);
+      if (si)
+        BOOST_LOG_SEV(lg, Log::DEBUG) << "Scope stack: " << *si;
+
+      //BOOST_LOG_SEV(lg, Log::ERROR) << boost::diagnostic_information(e);
+    }
+
+    namespace {
+
+      // The sessions of one thread share an io_service and a
+      // connection pool, i.e. a session can leave its authenticated
+      // connection to the next one with the same key.
+      //
+      // After a failed session, the io_service and the pool are
+      // replaced - thus, handlers of the failed session never run.
+      class Worker {
+        private:
+          boost::log::sources::severity_logger<Log::Severity> &lg_;
+          std::chrono::milliseconds                             keepalive_;
+          unique_ptr<boost::asio::io_service>                   io_service_;
+          unique_ptr<Net::Client::Pool>                         pool_;
+          // for logging in on idle connections
+          map<string, const Options*>                           options_;
+
+          void setup();
+          void teardown();
+        public:
+          Worker(boost::log::sources::severity_logger<Log::Severity> &lg,
+              std::chrono::milliseconds keepalive);
+          ~Worker();
+          // with release, the connection is kept for the next session
+          bool run(Options &opts, const string &key, bool release);
+          // opens the connection of a later session ahead of time
+          void prepare(const Options &opts, const string &key);
+          // logs out of the idle connections
+          void close();
+      };
+
+      Worker::Worker(boost::log::sources::severity_logger<Log::Severity> &lg,
+          std::chrono::milliseconds keepalive)
+        :
+          lg_(lg),
+          keepalive_(keepalive)
+      {
+      }
+      Worker::~Worker()
+      {
+        teardown();
+      }
+
+      void Worker::setup()
+      {
+        if (pool_)
+          return;
+        io_service_.reset(new boost::asio::io_service());
+        pool_.reset(new Net::Client::Pool(*io_service_, lg_, keepalive_));
+        auto keeper = [this](Net::Client::Connection &c) {
+          return make_shared<Keeper>(*options_.at(c.key()), c.client(), lg_);
+        };
+        pool_->set_login([keeper](Net::Client::Connection &c,
+              Net::Client::Pool::Done_Fn fn) {
+            keeper(c)->async_login(std::move(fn));
+          });
+        pool_->set_keepalive([keeper](Net::Client::Connection &c,
+              Net::Client::Pool::Done_Fn fn) {
+            keeper(c)->async_noop(std::move(fn));
+          });
+        pool_->set_logout([keeper](Net::Client::Connection &c,
+              Net::Client::Pool::Done_Fn fn) {
+            if (c.authenticated())
+              keeper(c)->async_logout(std::move(fn));
+            else
+              fn(true);
+          });
+      }
+      void Worker::teardown()
+      {
+        // the pending handlers reference the pool
+        pool_.reset();
+        io_service_.reset();
+      }
+
+      bool Worker::run(Options &opts, const string &key, bool release)
+      {
+        try {
+          BOOST_LOG(lg_) << "Account: |" << opts.account << "|";
+          BOOST_LOG(lg_) << "Username: |" << opts.username << "|";
+          BOOST_LOG_SEV(lg_, Log::INSANE) << "Password: |" << opts.password << "|";
+
+          setup();
+          options_[key] = &opts;
+          Net::Client::Connection *connection = nullptr;
+          bool done = false;
+          bool released = false;
+          unique_ptr<IMAP::Copy::Client> client;
+          pool_->async_acquire(key, opts.host,
+              [this, &opts]() { return create_client(*io_service_, opts, lg_); },
+              [this, &opts, &connection, &client, &done, &released, release](
+                Net::Client::Connection &c) {
+                connection = &c;
+                client.reset(new IMAP::Copy::Client(opts, c, release,
+                      [&done, &released](bool r) { done = true; released = r; },
+                      lg_));
+              });
+          io_service_->reset();
+          while (!done && io_service_->run_one())
+            ;
+          if (!done)
+            THROW_LOGIC_MSG("session stopped without finishing");
+          // e.g. the cancelled signal wait of the client
+          io_service_->poll();
+          client.reset();
+          if (released) {
+            connection->set_authenticated(true);
+            pool_->release(*connection);
+          } else {
+            pool_->discard(*connection);
+          }
+        } catch (const exception &e) {
+          log_exception(e, lg_);
+          teardown();
+          return false;
+        }
+        return true;
+      }
+
+      void Worker::prepare(const Options &opts, const string &key)
+      {
+        try {
+          setup();
+          options_[key] = &opts;
+          pool_->prepare(key, opts.host,
+              [this, &opts]() { return create_client(*io_service_, opts, lg_); });
+        } catch (const exception &e) {
+          log_exception(e, lg_);
+        }
+      }
+
+      void Worker::close()
+      {
+        if (!pool_)
+          return;
+        try {
+          pool_->async_close([](){});
+          io_service_->reset();
+          io_service_->run();
+        } catch (const exception &e) {
+          // i.e. nothing is lost
+          log_exception(e, lg_);
+        }
+        teardown();
+      }
+
+    }
+
+    bool run_sessions(std::vector<Options> &sessions, unsigned threads,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+    {
+      // the sessions with the same key are run one after another
+      // in the same thread
+      vector<string> keys;
+      vector<vector<size_t> > groups;
+      map<string, size_t> group_of;
+      for (size_t i = 0; i < sessions.size(); ++i) {
+        keys.push_back(session_key(sessions[i]));
+        auto r = group_of.insert(make_pair(keys.back(), groups.size()));
+        if (r.second)
+          groups.emplace_back();
+        groups[r.first->second].push_back(i);
+      }
+      size_t n = min<size_t>(threads, groups.size());
+      const Options &first = sessions.front();
+      std::chrono::milliseconds keepalive(std::chrono::seconds(first.noop_interval));
+      bool spare = first.spare;
+
+      // each thread processes groups until none is left
+      atomic<size_t> next {0};
+      // a thread only opens a spare connection after all threads got
+      // their first group - otherwise it might take a group from an
+      // idle thread
+      atomic<size_t> started {0};
+      atomic<bool> failed {false};
+      auto work = [&](boost::log::sources::severity_logger<Log::Severity> lg) {
+        Worker worker(lg, keepalive);
+        size_t i = next++;
+        ++started;
+        while (i < groups.size()) {
+          auto &g = groups[i];
+          size_t k = groups.size();
+          for (size_t j = 0; j < g.size(); ++j) {
+            bool last = j + 1 == g.size();
+            if (last && spare && started == n) {
+              k = next++;
+              if (k < groups.size())
+                worker.prepare(sessions[groups[k].front()], keys[groups[k].front()]);
+            }
+            if (!worker.run(sessions[g[j]], keys[g[j]], !last))
+              failed = true;
+          }
+          i = k < groups.size() ? k : next++;
+        }
+        worker.close();
+      };
+      vector<thread> ts;
+      // the logger is copied, i.e. each thread gets its own
+      for (size_t i = 1; i < n; ++i)
+        ts.emplace_back(work, lg);
+      work(lg);
+      for (auto &t : ts)
+        t.join();
+      return !failed;
+    }
+
+  }
+}
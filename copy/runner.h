@@ -0,0 +1,48 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef COPY_RUNNER_H
+#define COPY_RUNNER_H
+
+#include <log/log.h>
+
+#include <vector>
+
+namespace IMAP {
+  namespace Copy {
+
+    class Options;
+
+    // one session per --account, i.e. the first one is parsed as usual
+    // and the others are parsed again with their account name
+    std::vector<Options> parse_sessions(int argc, char **argv);
+
+    // Runs the sessions - each one with its own io_service - with up
+    // to threads of them in parallel. Sessions that may share a connection
+    // (i.e. same server and credentials) are run one after another in the
+    // same thread, i.e. they aren't spread over several connections.
+    // Errors are logged, false is returned if a session failed.
+    bool run_sessions(std::vector<Options> &sessions, unsigned threads,
+        boost::log::sources::severity_logger<Log::Severity> &lg);
+
+  }
+}
+
+#endif
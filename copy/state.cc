@@ -45,12 +45,14 @@ namespace IMAP {
       "LOGGED_IN",
       "GOT_CAPABILITIES",
       "SELECTED_MAILBOX",
+      "FETCHING_STRUCTURE",
       "FETCHING",
       "FETCHED",
       "STORED",
       "EXPUNGED",
       "LOGGING_OUT",
       "LOGGED_OUT",
+      "RELEASED",
       "END"
     };
     std::ostream &operator<<(std::ostream &o, State s)
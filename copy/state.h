@@ -34,12 +34,15 @@ namespace IMAP {
       LOGGED_IN,
       GOT_CAPABILITIES,
       SELECTED_MAILBOX,
+      FETCHING_STRUCTURE,
       FETCHING,
       FETCHED,
       STORED,
       EXPUNGED,
       LOGGING_OUT,
       LOGGED_OUT,
+      // i.e. still logged in, the connection is handed back to the pool
+      RELEASED,
       END,
       LAST_
     };
@@ -24,11 +24,11 @@
 #include <string>
 #include <cstring>
 #include <cassert>
+#include <limits>
+#include <stdexcept>
 
 using namespace std;
 
-#include <boost/lexical_cast.hpp>
-
 #include <buffer/buffer.h>
 
 
@@ -39,13 +39,16 @@ machine ma;
 
 action number_begin
 {
-  buffer.start(p);
   number = 0;
 }
+action number_digit
+{
+  number = number * 10 + (fc - '0');
+  if (number > numeric_limits<unsigned>::max())
+    throw overflow_error("number too large");
+}
 action number_end
 {
-  buffer.finish(p);
-  number = boost::lexical_cast<unsigned>(string(buffer.begin(), buffer.end()));
   buffer.clear();
   literal_pos = 0;
   cout << "number: " << number << '\n';
@@ -85,7 +88,7 @@ number = [0-9]+;
 #literal = '{' number '}' CRLF CHAR8* ;
 
 literal_tail := (CHAR8*) >literal_tail_begin  $literal_tail_cond_return ;
-literal = '{'  number >number_begin %number_end '}' '_' @call_literal_tail ;
+literal = '{'  number >number_begin $number_digit %number_end '}' '_' @call_literal_tail ;
 
 main :=  SP literal+ SP ;
 
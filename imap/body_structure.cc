@@ -0,0 +1,174 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "body_structure.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <ctype.h>
+
+using namespace std;
+
+namespace IMAP {
+
+  namespace Client {
+
+    static string to_lower(const char *begin, const char *end)
+    {
+      string r(begin, end);
+      transform(r.begin(), r.end(), r.begin(),
+          [](char c) { return char(tolower(static_cast<unsigned char>(c))); });
+      return r;
+    }
+
+    static const string *find_parameter(const Body_Part::Parameters &ps,
+        const string &name)
+    {
+      string n(to_lower(name.data(), name.data() + name.size()));
+      for (auto &p : ps)
+        if (p.first == n)
+          return &p.second;
+      return nullptr;
+    }
+
+    bool Body_Part::is_multipart() const
+    {
+      return type == "multipart";
+    }
+    bool Body_Part::is_message() const
+    {
+      return type == "message" && subtype == "rfc822";
+    }
+    bool Body_Part::is_text() const
+    {
+      return type == "text";
+    }
+    const std::string *Body_Part::parameter(const std::string &name) const
+    {
+      return find_parameter(parameters, name);
+    }
+    const std::string *Body_Part::disposition_parameter(
+        const std::string &name) const
+    {
+      return find_parameter(disposition_parameters, name);
+    }
+    std::string Body_Part::part_str() const
+    {
+      ostringstream o;
+      for (auto i = part.begin(); i != part.end(); ++i) {
+        if (i != part.begin())
+          o << '.';
+        o << *i;
+      }
+      return o.str();
+    }
+
+    Body_Part &Body_Structure::current()
+    {
+      if (stack_.empty())
+        throw logic_error("body structure callback outside of a body");
+      return *stack_.back();
+    }
+
+    void Body_Structure::clear()
+    {
+      root_ = Body_Part();
+      stack_.clear();
+      complete_       = false;
+      in_disposition_ = false;
+    }
+
+    void Body_Structure::begin()
+    {
+      in_disposition_ = false;
+      if (stack_.empty()) {
+        clear();
+        stack_.push_back(&root_);
+        return;
+      }
+      Body_Part &parent = *stack_.back();
+      parent.children.emplace_back();
+      Body_Part &child = parent.children.back();
+      child.part = parent.part;
+      // the type of a multipart is only known after its parts
+      if (!parent.is_message())
+        child.part.push_back(parent.children.size());
+      stack_.push_back(&child);
+    }
+    void Body_Structure::end()
+    {
+      current();
+      stack_.pop_back();
+      in_disposition_ = false;
+      if (stack_.empty())
+        complete_ = true;
+    }
+    void Body_Structure::type(const char *begin, const char *end)
+    {
+      current().type = to_lower(begin, end);
+    }
+    void Body_Structure::subtype(const char *begin, const char *end)
+    {
+      Body_Part &p = current();
+      if (p.type.empty())
+        p.type = "multipart";
+      p.subtype = to_lower(begin, end);
+    }
+    void Body_Structure::param_name(const char *begin, const char *end)
+    {
+      name_ = to_lower(begin, end);
+    }
+    void Body_Structure::param_value(const char *begin, const char *end)
+    {
+      Body_Part &p = current();
+      auto &ps = in_disposition_ ? p.disposition_parameters : p.parameters;
+      ps.emplace_back(name_, string(begin, end));
+    }
+    void Body_Structure::encoding(const char *begin, const char *end)
+    {
+      current().encoding = to_lower(begin, end);
+    }
+    void Body_Structure::octets(uint32_t n)
+    {
+      current().octets = n;
+    }
+    void Body_Structure::lines(uint32_t n)
+    {
+      current().lines = n;
+    }
+    void Body_Structure::disposition(const char *begin, const char *end)
+    {
+      current().disposition = to_lower(begin, end);
+      in_disposition_ = true;
+    }
+
+    bool Body_Structure::complete() const
+    {
+      return complete_;
+    }
+    const Body_Part &Body_Structure::root() const
+    {
+      return root_;
+    }
+
+  }
+
+}
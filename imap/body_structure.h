@@ -0,0 +1,101 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef IMAP_BODY_STRUCTURE_H
+#define IMAP_BODY_STRUCTURE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+namespace IMAP {
+
+  namespace Client {
+
+    // One (possibly multipart) part of a BODYSTRUCTURE response.
+    class Body_Part {
+      public:
+        using Parameters = std::vector<std::pair<std::string, std::string> >;
+
+        // lower case, e.g. "text" and "plain"
+        std::string type;
+        std::string subtype;
+        Parameters  parameters;
+        std::string encoding;
+        uint32_t    octets {0};
+        uint32_t    lines  {0};
+        // lower case, e.g. "attachment", empty if NIL/not present
+        std::string disposition;
+        Parameters  disposition_parameters;
+
+        // section-part, e.g. {1, 2} for BODY[1.2] - empty for the
+        // top-level body
+        std::vector<uint32_t> part;
+        // the parts of a multipart - or the encapsulated body of
+        // a message/rfc822 part (which has the same section-part
+        // as its enclosing part)
+        std::vector<Body_Part> children;
+
+        bool is_multipart() const;
+        bool is_message() const;
+        bool is_text() const;
+        // case-insensitive lookup, nullptr if not present
+        const std::string *parameter(const std::string &name) const;
+        const std::string *disposition_parameter(const std::string &name) const;
+        // e.g. "1.2", empty for the top-level body
+        std::string part_str() const;
+    };
+
+    // Builds a Body_Part tree from the imap_body_*() parser callbacks.
+    class Body_Structure {
+      private:
+        Body_Part               root_;
+        // the enclosing parts of the current one - stable, because
+        // only the children of the innermost part are appended to
+        std::vector<Body_Part*> stack_;
+        bool                    complete_       {false};
+        bool                    in_disposition_ {false};
+        std::string             name_;
+
+        Body_Part &current();
+      public:
+        void clear();
+
+        void begin();
+        void end();
+        void type(const char *begin, const char *end);
+        void subtype(const char *begin, const char *end);
+        void param_name(const char *begin, const char *end);
+        void param_value(const char *begin, const char *end);
+        void encoding(const char *begin, const char *end);
+        void octets(uint32_t n);
+        void lines(uint32_t n);
+        void disposition(const char *begin, const char *end);
+
+        bool complete() const;
+        const Body_Part &root() const;
+    };
+
+  }
+
+}
+
+#endif
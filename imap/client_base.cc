@@ -39,15 +39,74 @@ namespace IMAP {
         writer_(tags_, std::bind(&Base::to_cmd, this, std::placeholders::_1))
     {
     }
+    void Base::set_validation(Validation v, unsigned n)
+    {
+      writer_.set_validation(v, n);
+    }
+
+
+    void Base::set_max_command_length(size_t n)
+    {
+      writer_.set_max_command_length(n);
+    }
+    void Base::set_authenticated()
+    {
+      writer_.set_authenticated();
+    }
+
+
+    void Base::set_cork(Post_Fn fn)
+    {
+      post_fn_ = std::move(fn);
+      if (!post_fn_)
+        flush();
+    }
+    void Base::flush()
+    {
+      if (cmd_.empty())
+        return;
+      write_fn_(cmd_);
+      cmd_.clear();
+    }
 
 
     void Base::to_cmd(vector<char> &x)
     {
-      std::swap(x, cmd_);
+      // a split command is written in several parts
+      if (cmd_.empty())
+        std::swap(x, cmd_);
+      else
+        cmd_.insert(cmd_.end(), x.begin(), x.end());
+    }
+    void Base::add_fn(std::function<void(void)> &&fn)
+    {
+      const vector<uint32_t> &numbers = writer_.tag_numbers();
+      if (numbers.size() == 1) {
+        tag_to_fn_.insert(numbers.front(), std::move(fn));
+        return;
+      }
+      // fn is called when the last part of a split command is completed
+      auto left = std::make_shared<size_t>(numbers.size());
+      auto f = std::make_shared<std::function<void(void)> >(std::move(fn));
+      for (auto number : numbers)
+        tag_to_fn_.insert(number, [left, f]() {
+            if (!--*left)
+              (*f)();
+          });
     }
     void Base::do_write()
     {
-      write_fn_(cmd_);
+      if (!post_fn_) {
+        flush();
+        return;
+      }
+      if (flush_posted_)
+        return;
+      flush_posted_ = true;
+      post_fn_([this]() {
+          flush_posted_ = false;
+          flush();
+        });
     }
 
     void Base::async_capabilities(std::function<void(void)> fn)
@@ -55,7 +114,7 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.capability(tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Getting CAPABILITIES ..." << " [" << tag << ']';
       do_write();
     }
@@ -66,7 +125,7 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.login(username, password, tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Logging in as |" << username << "| [" << tag << "]";
       BOOST_LOG_SEV(lg_, Log::INSANE) << "Password: |" << password << "|";
       do_write();
@@ -77,7 +136,7 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.list(reference, mailbox, tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG_SEV(lg_, Log::DEBUG) << "Listing: |" << reference << "| |" << mailbox << "|";
       do_write();
     }
@@ -86,7 +145,7 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.select(mailbox, tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Selecting mailbox: |" << mailbox << "|" << " [" << tag << ']';
       do_write();
     }
@@ -99,10 +158,22 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.fetch(set, atts, tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Fetching messages " <<  " ..." << " [" << tag << ']';
       do_write();
     }
+    void Base::async_uid_fetch(
+            const std::vector<std::pair<uint32_t, uint32_t> > &set,
+            const std::vector<IMAP::Client::Fetch_Attribute> &atts,
+            std::function<void(void)> fn, bool concurrent)
+    {
+      BOOST_LOG_FUNCTION();
+      string tag;
+      writer_.uid_fetch(set, atts, tag, concurrent);
+      add_fn(std::move(fn));
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Fetching messages by UID ..." << " [" << tag << ']';
+      do_write();
+    }
 
     void Base::async_store(
             const std::vector<std::pair<uint32_t, uint32_t> > &set,
@@ -112,8 +183,11 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.uid_store(set, flags, tag, IMAP::Client::Store_Mode::REPLACE, true);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Storing DELETED flags ..." << " [" << tag << ']';
+      if (writer_.tag_numbers().size() > 1)
+        BOOST_LOG_SEV(lg_, Log::DEBUG) << "Split into "
+          << writer_.tag_numbers().size() << " commands";
       do_write();
     }
     void Base::async_uid_expunge(const std::vector<std::pair<uint32_t, uint32_t> > &set,
@@ -122,8 +196,11 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.uid_expunge(set, tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Expunging messages ..." << " [" << tag << ']';
+      if (writer_.tag_numbers().size() > 1)
+        BOOST_LOG_SEV(lg_, Log::DEBUG) << "Split into "
+          << writer_.tag_numbers().size() << " commands";
       do_write();
     }
     void Base::async_expunge(std::function<void(void)> fn)
@@ -131,40 +208,58 @@ namespace IMAP {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.expunge(tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Expunging messages (without UIDPLUS) ..." << " [" << tag << ']';
       do_write();
     }
 
+    void Base::async_noop(std::function<void(void)> fn)
+    {
+      BOOST_LOG_FUNCTION();
+      string tag;
+      writer_.noop(tag);
+      add_fn(std::move(fn));
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "NOOP ..." << " [" << tag << ']';
+      do_write();
+    }
     void Base::async_logout(std::function<void(void)> fn)
     {
       BOOST_LOG_FUNCTION();
       string tag;
       writer_.logout(tag);
-      tag_to_fn_[tag] = fn;
+      add_fn(std::move(fn));
       BOOST_LOG(lg_) << "Logging out ..." << " [" << tag << ']';
       //state_ = State::LOGGING_OUT;
       do_write();
     }
+    void Base::imap_tag_number(uint32_t number)
+    {
+      tag_number_ = number;
+      has_tag_number_ = true;
+    }
     void Base::imap_tagged_status_end(IMAP::Server::Response::Status c)
     {
       BOOST_LOG_FUNCTION();
-      string tag(tag_buffer_.begin(), tag_buffer_.end());
-      BOOST_LOG(lg_) << "Got status " << c << " for tag " << tag;
+      BOOST_LOG(lg_) << "Got status " << c << " for tag "
+        << string(tag_buffer_.begin(), tag_buffer_.end());
       if (c != IMAP::Server::Response::Status::OK) {
         stringstream o;
         o << "Command failed: " << c << " - " << string(buffer_.begin(), buffer_.end());
         THROW_MSG(o.str());
       }
-      auto i = tag_to_fn_.find(tag);
-      if (i == tag_to_fn_.end()) {
+      bool has_number = has_tag_number_;
+      has_tag_number_ = false;
+      std::function<void(void)> *f = has_number
+        && tags_.matches(tag_buffer_.begin(), tag_buffer_.end())
+        ? tag_to_fn_.find(tag_number_) : nullptr;
+      if (!f) {
         stringstream o;
-        o << "Got unknown tag: " << tag;
+        o << "Got unknown tag: " << string(tag_buffer_.begin(), tag_buffer_.end());
         THROW_MSG(o.str());
       }
-      tags_.pop(tag);
-      auto fn = i->second;
-      tag_to_fn_.erase(i);
+      tags_.pop(tag_number_);
+      auto fn = std::move(*f);
+      tag_to_fn_.erase(tag_number_);
       fn();
     }
 
@@ -28,9 +28,9 @@
 #include <buffer/buffer.h>
 
 #include <string>
-#include <map>
 #include <vector>
 #include <functional>
+#include <memory>
 #include <utility>
 #include <stdint.h>
 
@@ -41,16 +41,25 @@ namespace IMAP {
     class Base : public IMAP::Client::Callback::Null {
       public:
         using Write_Fn = std::function<void(std::vector<char> &v)>;
+        // e.g. io_service::post()
+        using Post_Fn  = std::function<void(std::function<void(void)>)>;
       private:
         boost::log::sources::severity_logger< Log::Severity > &lg_;
         Write_Fn write_fn_;
+        Post_Fn  post_fn_;
+        bool     flush_posted_ {false};
 
         IMAP::Client::Tag    tags_;
         std::vector<char>    cmd_;
         IMAP::Client::Writer writer_;
-        std::map<std::string, std::function<void(void)> > tag_to_fn_;
+        // completion handlers by tag number
+        Tag_Table<std::function<void(void)> > tag_to_fn_;
+        uint32_t             tag_number_     {0};
+        bool                 has_tag_number_ {false};
 
         void to_cmd(vector<char> &x);
+        // for the tags that were just generated
+        void add_fn(std::function<void(void)> &&fn);
         void do_write();
 
       protected:
@@ -67,6 +76,11 @@ namespace IMAP {
             const std::vector<std::pair<uint32_t, uint32_t> > &set,
             const std::vector<IMAP::Client::Fetch_Attribute> &atts,
             std::function<void(void)> fn);
+        // concurrent: cf. IMAP::Client::Writer::uid_fetch()
+        void async_uid_fetch(
+            const std::vector<std::pair<uint32_t, uint32_t> > &set,
+            const std::vector<IMAP::Client::Fetch_Attribute> &atts,
+            std::function<void(void)> fn, bool concurrent = false);
         void async_store(
             const std::vector<std::pair<uint32_t, uint32_t> > &set,
             const std::vector<IMAP::Flag> &flags,
@@ -74,12 +88,29 @@ namespace IMAP {
         void async_uid_expunge(const std::vector<std::pair<uint32_t, uint32_t> > &set,
             std::function<void(void)> fn);
         void async_expunge(std::function<void(void)> fn);
+        void async_noop(std::function<void(void)> fn);
         void async_logout(std::function<void(void)> fn);
 
+        void imap_tag_number(uint32_t number) override;
         void imap_tagged_status_end(IMAP::Server::Response::Status c) override;
       public:
         Base(Write_Fn write_fn,
             boost::log::sources::severity_logger< Log::Severity > &lg);
+
+        // cf. IMAP::Client::Writer::set_validation()
+        void set_validation(Validation v, unsigned n = 1);
+        // cf. IMAP::Client::Writer::set_max_command_length()
+        void set_max_command_length(size_t n);
+        // cf. IMAP::Client::Writer::set_authenticated()
+        void set_authenticated();
+        // Corking: commands are collected in one buffer until the handler
+        // that is posted with fn runs (i.e. after the current event loop
+        // turn) or until flush() is called - thus, pipelined commands
+        // end up in one network write (and one TLS record).
+        // With nullptr, each command is written immediately.
+        void set_cork(Post_Fn fn);
+        // write the collected commands
+        void flush();
     };
 
   }
@@ -32,7 +32,7 @@ using namespace std;
 namespace IMAP {
 
   namespace Client {
-    class Parser;
+    template <typename Callback_T> class Basic_Parser;
 
     namespace Callback {
 
@@ -40,7 +40,8 @@ namespace IMAP {
 
       class Base {
         private:
-          friend class IMAP::Client::Parser;
+          template <typename Callback_T>
+            friend class IMAP::Client::Basic_Parser;
         protected:
           virtual ~Base();
 
@@ -49,6 +50,9 @@ namespace IMAP {
           //virtual void imap_response_begin(Group g, Kind k) = 0;
 
           // may consult tag_buffer
+          // called before imap_tagged_status_begin() if the tag ends
+          // with 1 to 9 digits, e.g. with 42 for A042
+          virtual void imap_tag_number(uint32_t number) = 0;
           virtual void imap_tagged_status_begin() = 0;
           // may consult buffer
           virtual void imap_tagged_status_end(Status c) = 0;
@@ -67,9 +71,11 @@ namespace IMAP {
           virtual void imap_data_flags_begin() = 0;
           virtual void imap_data_flags_end() = 0;
           virtual void imap_flag(Flag flag) = 0;
+          // keyword or flag extension (including the backslash),
           // may consult buffer
           virtual void imap_atom_flag() = 0;
           virtual void imap_uid(uint32_t number) = 0;
+          virtual void imap_rfc822_size(uint32_t number) = 0;
           virtual void imap_status_code(Status_Code) = 0;
           virtual void imap_status_code_uidnext(uint32_t n) = 0;
           virtual void imap_status_code_uidvalidity(uint32_t n) = 0;
@@ -84,8 +90,38 @@ namespace IMAP {
           virtual void imap_body_section_begin() = 0;
           virtual void imap_body_section_inner() = 0;
           virtual void imap_body_section_end() = 0;
+          // only called when slicing literals, instead of consulting buffer;
+          // the slice points into the input of the current Parser::read()
+          // call or into static storage (for converted CR/LF)
+          virtual void imap_literal_slice(const char *begin, size_t n) = 0;
           virtual void imap_section_empty() = 0;
           virtual void imap_section_header() = 0;
+          // for BODY[1.2.MIME]: imap_section_part(1), imap_section_part(2),
+          // imap_section_mime()
+          virtual void imap_section_part(uint32_t number) = 0;
+          virtual void imap_section_mime() = 0;
+          // BINARY[1.2] (RFC3516): imap_binary_section_begin(),
+          // imap_section_part(1), imap_section_part(2),
+          // imap_binary_section_end() - the latter may consult buffer,
+          // which contains the unconverted (decoded) content
+          virtual void imap_binary_section_begin() = 0;
+          virtual void imap_binary_section_end() = 0;
+          virtual void imap_binary_size(uint32_t number) = 0;
+
+          // BODY/BODYSTRUCTURE, each (nested) body is enclosed in
+          // imap_body_begin()/imap_body_end(), the string valued
+          // callbacks may consult buffer
+          virtual void imap_body_begin() = 0;
+          virtual void imap_body_end() = 0;
+          virtual void imap_body_type() = 0;
+          virtual void imap_body_subtype() = 0;
+          // also called for the parameters of a disposition
+          virtual void imap_body_param_name() = 0;
+          virtual void imap_body_param_value() = 0;
+          virtual void imap_body_encoding() = 0;
+          virtual void imap_body_octets(uint32_t number) = 0;
+          virtual void imap_body_lines(uint32_t number) = 0;
+          virtual void imap_body_disposition() = 0;
 
           virtual void imap_list_begin() = 0;
           virtual void imap_list_end() = 0;
@@ -98,6 +134,7 @@ namespace IMAP {
       class Null : public Base {
         private:
         protected:
+          void imap_tag_number(uint32_t number) override;
           void imap_tagged_status_begin() override;
           void imap_tagged_status_end(Status c) override;
           void imap_untagged_status_begin(Status c) override;
@@ -112,6 +149,7 @@ namespace IMAP {
           void imap_flag(Flag flag) override;
           void imap_atom_flag() override;
           void imap_uid(uint32_t number) override;
+          void imap_rfc822_size(uint32_t number) override;
           void imap_status_code(Status_Code) override;
           void imap_status_code_uidnext(uint32_t n) override;
           void imap_status_code_uidvalidity(uint32_t n) override;
@@ -126,8 +164,25 @@ namespace IMAP {
           void imap_body_section_begin() override;
           void imap_body_section_inner() override;
           void imap_body_section_end() override;
+          void imap_literal_slice(const char *begin, size_t n) override;
           void imap_section_empty() override;
           void imap_section_header() override;
+          void imap_section_part(uint32_t number) override;
+          void imap_section_mime() override;
+          void imap_binary_section_begin() override;
+          void imap_binary_section_end() override;
+          void imap_binary_size(uint32_t number) override;
+
+          void imap_body_begin() override;
+          void imap_body_end() override;
+          void imap_body_type() override;
+          void imap_body_subtype() override;
+          void imap_body_param_name() override;
+          void imap_body_param_value() override;
+          void imap_body_encoding() override;
+          void imap_body_octets(uint32_t number) override;
+          void imap_body_lines(uint32_t number) override;
+          void imap_body_disposition() override;
 
           virtual void imap_list_begin() override;
           virtual void imap_list_end() override;
@@ -138,34 +193,66 @@ namespace IMAP {
       };
     }
 
-    class Parser {
+    // The callback type is a template parameter such that a concrete
+    // (final) handler can be used directly, i.e. without going through
+    // the virtual Callback::Base interface - which allows the compiler
+    // to inline the callbacks. The member definitions are generated
+    // into client_parser_impl.h (from imap/client_parser.rl), i.e. a user
+    // of such a handler has to include it and explicitly instantiate
+    // the parser for it, e.g.:
+    //
+    //     #include "client_parser_impl.h"
+    //     template class IMAP::Client::Basic_Parser<My_Handler>;
+    //
+    // The handler has to befriend the parser if its callbacks aren't public.
+    template <typename Callback_T>
+    class Basic_Parser {
       private:
         int                      cs             {0};
         vector<int>              stack_vector_;
         int                     *stack          {nullptr};
         int                      top            {0};
-        Memory::Buffer::Vector   number_buffer_;
         uint32_t                 number_        {0};
+        uint32_t                 tag_number_    {0};
+        unsigned                 tag_digits_    {0};
         size_t                   literal_pos_   {0};
         bool                     has_imap4rev1_ {false};
 
         Memory::Buffer::Base    &buffer_;
         bool                     convert_crlf_  {true};
         Memory::Buffer::Base    &tag_buffer_;
-        Callback::Base          &cb_;
+        Callback_T              &cb_;
         Server::Response::Status status_        {Server::Response::Status::OK};
+        bool                     slice_literals_ {false};
+        bool                     slice_cont_     {false};
+        const char              *slice_begin_    {nullptr};
+
+        void lit_cont(const char *p);
+        void lit_stop(const char *p);
+        void lit_finish(const char *p);
+        void lit_add(char c);
       public:
-        Parser(Memory::Buffer::Base &buffer,
+        Basic_Parser(Memory::Buffer::Base &buffer,
             Memory::Buffer::Base &tag_buffer,
-            Callback::Base &cb);
+            Callback_T &cb);
         void read(const char *begin, const char *end);
         bool in_start() const;
         bool finished() const;
         void verify_finished() const;
         void set_convert_crlf(bool b);
+        // Report literal content via Callback::Base::imap_literal_slice()
+        // instead of copying it into the buffer, e.g. for directly writing
+        // it out. Only switch it between literals, e.g. in
+        // imap_body_section_inner()/imap_body_section_end().
+        void set_slice_literals(bool b);
 
     };
 
+    // instantiated in imap/client_parser.cc
+    extern template class Basic_Parser<Callback::Base>;
+
+    typedef Basic_Parser<Callback::Base> Parser;
+
   }
 }
 
@@ -18,18 +18,25 @@
     along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
 
 }}} */
+
+// Ragel generates the client_parser_impl.h header from this file,
+// cf. the Basic_Parser comment in imap/client_parser.h
+
+#ifndef IMAP_CLIENT_PARSER_IMPL_H
+#define IMAP_CLIENT_PARSER_IMPL_H
+
 #include <imap/client_parser.h>
 
 #include <stdexcept>
 #include <string>
+#include <limits>
 #include <iomanip>
 #include <sstream>
 
 using namespace std;
 
-#include <boost/lexical_cast.hpp>
-
 #include "lex_util.h"
+#include <imap/literal_scan.h>
 
 %%{
 
@@ -72,6 +79,10 @@ action status_bye
 {
   status_ = Server::Response::Status::BYE;
 }
+action status_preauth
+{
+  status_ = Server::Response::Status::PREAUTH;
+}
 action cb_tagged_status_begin
 {
   cb_.imap_tagged_status_begin();
@@ -148,6 +159,10 @@ action cb_uid
 {
   cb_.imap_uid(number_);
 }
+action cb_rfc822_size
+{
+  cb_.imap_rfc822_size(number_);
+}
 action cb_status_code_alert
 {
   cb_.imap_status_code(Server::Response::Status_Code::ALERT);
@@ -438,23 +453,25 @@ action tag_start
 {
   tag_buffer_.start(p);
 }
-action tag_finish
+# the number of the trailing digits, e.g. 42 for A042
+action tag_char
 {
-  tag_buffer_.finish(p);
+  if (fc >= '0' && fc <= '9') {
+    if (tag_digits_ < 9)
+      tag_number_ = tag_number_ * 10 + (fc - '0');
+    ++tag_digits_;
+  } else {
+    tag_number_ = 0;
+    tag_digits_ = 0;
+  }
 }
-
-#                    ; (0 <= n < 4,294,967,296)
-# the lexical_cast in number_end already does the checking for us ...
-# thus not used
-action check_number
+action tag_finish
 {
-  // check only works for at most 10 digit long strings
-  if (strncmp(number_buffer_.begin(), "4294967296",
-              number_buffer_.end() - number_buffer_.begin()) >= 0) {
-    // fgoto *imap_error;
-    fnext *imap_error;
-    throw overflow_error("number is >= 4,294,967,296");
-  }
+  tag_buffer_.finish(p);
+  if (tag_digits_ && tag_digits_ < 10)
+    cb_.imap_tag_number(tag_number_);
+  tag_number_ = 0;
+  tag_digits_ = 0;
 }
 
 action cb_body_section_begin
@@ -477,6 +494,85 @@ action cb_section_empty
 {
   cb_.imap_section_empty();
 }
+action cb_body_begin
+{
+  cb_.imap_body_begin();
+}
+action call_body
+{
+  fcall body_tail;
+}
+action ret_body
+{
+  cb_.imap_body_end();
+  fret;
+}
+action call_body_extension
+{
+  fcall body_extension_tail;
+}
+action ret_body_extension
+{
+  fret;
+}
+action cb_body_type
+{
+  cb_.imap_body_type();
+}
+action cb_body_subtype
+{
+  cb_.imap_body_subtype();
+}
+action cb_body_param_name
+{
+  cb_.imap_body_param_name();
+}
+action cb_body_param_value
+{
+  cb_.imap_body_param_value();
+}
+action cb_body_encoding
+{
+  cb_.imap_body_encoding();
+}
+action cb_body_octets
+{
+  cb_.imap_body_octets(number_);
+}
+action cb_body_lines
+{
+  cb_.imap_body_lines(number_);
+}
+action cb_body_disposition
+{
+  cb_.imap_body_disposition();
+}
+action cb_section_part
+{
+  cb_.imap_section_part(number_);
+}
+action cb_section_mime
+{
+  cb_.imap_section_mime();
+}
+action cb_binary_section_begin
+{
+  cb_.imap_binary_section_begin();
+}
+action cb_binary_section_end
+{
+  cb_.imap_binary_section_end();
+}
+action cb_binary_size
+{
+  cb_.imap_binary_size(number_);
+}
+action call_literal8_tail
+{
+  // binary content is never CRLF converted
+  if (number_)
+    fcall literal8_tail;
+}
 
 action cb_list_begin
 {
@@ -775,6 +871,14 @@ resp_cond_bye = /BYE/i       >status_bye >cb_untagged_status_begin
 resp_cond_state = ( /OK/i %status_ok | /NO/i %status_no | /BAD/i %status_bad )
                   SP resp_text ;
 
+# resp-cond-auth  = ("OK" / "PREAUTH") SP resp-text
+#                     ; Authentication condition
+#
+# only PREAUTH, OK is already covered by resp_cond_state - i.e. the
+# greeting of a pre-authenticated connection (e.g. a tunnel)
+
+resp_cond_preauth = /PREAUTH/i %status_preauth SP resp_text ;
+
 #response-fatal  = "*" SP resp-cond-bye CRLF
 #                    ; Server closes connection immediately
 
@@ -782,7 +886,7 @@ resp_cond_state = ( /OK/i %status_ok | /NO/i %status_no | /BAD/i %status_bad )
 
 # response-tagged = tag SP resp-cond-state CRLF
 
-response_tagged = tag                  >tag_start %tag_finish
+response_tagged = tag >tag_start $tag_char %tag_finish
                   SP                   @cb_tagged_status_begin
                   resp_cond_state CRLF @cb_tagged_status_end ;
 
@@ -946,8 +1050,53 @@ envelope = '(' env_date   SP env_subject     SP env_from       SP
 
 # body            = "(" (body-type-1part / body-type-mpart) ")"
 
-# XXX parse nested structures body structure
-body = ( '(' | ')' | SP | string | nil | number )+ ;
+# Nested bodies (and body extensions) are parsed via fcall/fret, i.e.
+# body_tail and body_extension_tail are entered after the opening '('.
+# The alternatives of body-type-1part are merged: after the body-fields
+# a number (body-fld-lines), a '(' (envelope) or an nstring
+# (body-fld-md5) follows.
+
+body_fld_param = '(' string %cb_body_param_name SP string %cb_body_param_value
+                     ( SP string %cb_body_param_name
+                       SP string %cb_body_param_value )* ')'
+               | nil ;
+
+body_fld_id     = nstring ;
+body_fld_desc   = nstring ;
+body_fld_enc    = string %cb_body_encoding ;
+body_fld_octets = number %cb_body_octets ;
+body_fld_lines  = number %cb_body_lines ;
+body_fld_md5    = nstring ;
+body_fld_dsp    = '(' string %cb_body_disposition SP body_fld_param ')' | nil ;
+body_fld_lang   = nstring | '(' string (SP string)* ')' ;
+body_fld_loc    = nstring ;
+
+body_extension = nstring | number | '(' @call_body_extension ;
+
+body_extension_tail := body_extension (SP body_extension)* ')'
+                       @ret_body_extension ;
+
+body_ext_tail = SP body_fld_dsp
+                ( SP body_fld_lang
+                  ( SP body_fld_loc ( SP body_extension )* )? )? ;
+
+body_ext_1part = body_fld_md5   body_ext_tail? ;
+body_ext_mpart = body_fld_param body_ext_tail? ;
+
+body_fields = body_fld_param SP body_fld_id SP body_fld_desc SP
+              body_fld_enc SP body_fld_octets ;
+
+body = '(' @cb_body_begin @call_body ;
+
+body_type_1part = string %cb_body_type SP string %cb_body_subtype
+                  SP body_fields
+                  ( SP body_fld_lines
+                    | SP envelope SP body SP body_fld_lines )?
+                  ( SP body_ext_1part )? ;
+
+body_type_mpart = body+ SP string %cb_body_subtype ( SP body_ext_mpart )? ;
+
+body_tail := ( body_type_1part | body_type_mpart ) ')' @ret_body ;
 
 
 
@@ -958,15 +1107,36 @@ body = ( '(' | ')' | SP | string | nil | number )+ ;
 #                   "BODY" section ["<" number ">"] SP nstring /
 #                   "UID" SP uniqueid
 #                     ; MUST NOT change for a message
+#
+# RFC3516:
+#
+# msg-att-static  =/ "BINARY" section-binary SP (nstring / literal8) /
+#                    "BINARY.SIZE" section-binary SP number
+# literal8        = "~{" number "}" CRLF *OCTET
+#                    ; <number> represents the number of OCTETs
+#                    ; in the response string.
+
+literal8_tail := (any*) >literal_tail_begin $literal_tail_cond_return;
+
+literal8 = '~{' number '}' CRLF @buffer_clear @call_literal8_tail ;
+
+# servers may also send the content of a BINARY section as ordinary
+# literal - it isn't CRLF converted, either
+binary_literal = '{' number '}' CRLF @buffer_clear @call_literal8_tail ;
+
+binary_nstring = quoted | binary_literal | nil ;
 
 msg_att_static = /ENVELOPE/i     SP envelope
                | /INTERNALDATE/i SP date_time
                | /RFC822/i ( /.HEADER/i | /.TEXT/i )? SP nstring
-               | /RFC822.SIZE/i SP number
+               | /RFC822.SIZE/i SP number %cb_rfc822_size
                | /BODY/i (/STRUCTURE/i)? SP body
                | /BODY/i section ( '<' number '>' )?
                    SP      @cb_body_section_inner
                    nstring %cb_body_section_end
+               | /BINARY/i section_binary
+                   SP ( binary_nstring | literal8 ) %cb_binary_section_end
+               | /BINARY.SIZE/i section_binary SP number %cb_binary_size
                | /UID/i SP uniqueid %cb_uid ;
 
 # msg-att-dynamic = "FLAGS" SP "(" [flag-fetch *(SP flag-fetch)] ")"
@@ -1064,6 +1234,7 @@ response_data_tail_wolf =  (  resp_cond_state
                          | mailbox_data
                          | message_data
                          | capability_data
+                         | resp_cond_preauth
                          # RFC 2971 - IMAP4 ID extension
                          | id_response
                        #) CRLF ;
@@ -1130,52 +1301,108 @@ namespace IMAP {
 
     %% write data;
 
-    Parser::Parser(Buffer::Base &buffer,
+    template <typename Callback_T>
+    Basic_Parser<Callback_T>::Basic_Parser(Buffer::Base &buffer,
       Buffer::Base &tag_buffer,
-      Callback::Base &cb)
+      Callback_T &cb)
       :
         buffer_(buffer), tag_buffer_(tag_buffer), cb_(cb)
     {
       %% write init;
     }
 
-    void Parser::read(const char *begin, const char *end)
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::read(const char *begin, const char *end)
     {
       const char *p   = begin;
       const char *pe  = end;
       const char *eof = nullptr;
       Buffer::Resume bur(buffer_, p, pe);
       Buffer::Resume tar(tag_buffer_, p, pe);
-      Buffer::Resume nur(number_buffer_, p, pe);
+      if (slice_cont_)
+        slice_begin_ = p;
       %% write exec;
       if (cs == %%{write error;}%%) {
         throw_lex_error("IMAP client automaton in error state", begin, p, pe);
       }
+      // the input is only valid until the next read() call
+      if (slice_cont_ && slice_begin_ != pe)
+        cb_.imap_literal_slice(slice_begin_, pe - slice_begin_);
+    }
+
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::lit_cont(const char *p)
+    {
+      if (slice_literals_) {
+        // a final CR/LF just extends a pending run
+        if (!slice_cont_)
+          slice_begin_ = p;
+        slice_cont_ = true;
+      } else {
+        buffer_.cont(p);
+      }
+    }
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::lit_stop(const char *p)
+    {
+      if (slice_literals_) {
+        if (p != slice_begin_)
+          cb_.imap_literal_slice(slice_begin_, p - slice_begin_);
+        slice_cont_ = false;
+      } else {
+        buffer_.stop(p);
+      }
+    }
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::lit_finish(const char *p)
+    {
+      if (slice_literals_) {
+        lit_stop(p);
+      } else {
+        buffer_.finish(p);
+      }
+    }
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::lit_add(char c)
+    {
+      if (slice_literals_) {
+        static const char cr = '\r';
+        static const char lf = '\n';
+        cb_.imap_literal_slice(c == '\r' ? &cr : &lf, 1);
+      } else {
+        buffer_.cont(&c);
+        buffer_.stop(&c+1);
+      }
     }
 
-    bool Parser::in_start() const
+    template <typename Callback_T>
+    bool Basic_Parser<Callback_T>::in_start() const
     {
       return cs == %%{write start;}%%;
     }
-    bool Parser::finished() const
+    template <typename Callback_T>
+    bool Basic_Parser<Callback_T>::finished() const
     {
       // return cs >= %%{write first_final;}%%;
       // for this machine: start state == final state
       return in_start();
     }
 
-    void Parser::verify_finished() const
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::verify_finished() const
     {
       if (!finished())
         throw runtime_error("IMAP client automaton not in final state");
     }
 
     // e.g. for mailbox/maildir we want to convert - which is the default
-    void Parser::set_convert_crlf(bool b)
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::set_convert_crlf(bool b)
     {
       (void)imap_first_final;
       (void)imap_en_literal_tail;
       (void)imap_en_literal_tail_convert;
+      (void)imap_en_literal8_tail;
       (void)imap_en_capability;
       (void)imap_en_continue_req_tail;
       (void)imap_en_main;
@@ -1183,8 +1410,15 @@ namespace IMAP {
       convert_crlf_ = b;
     }
 
+    template <typename Callback_T>
+    void Basic_Parser<Callback_T>::set_slice_literals(bool b)
+    {
+      slice_literals_ = b;
+      slice_cont_ = false;
+    }
+
   }
 
 }
 
-
+#endif
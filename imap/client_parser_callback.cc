@@ -28,6 +28,9 @@ namespace IMAP {
 
       Base::~Base() =default;
 
+      void Null::imap_tag_number(uint32_t number)
+      {
+      }
       void Null::imap_tagged_status_begin()
       {
       }
@@ -70,6 +73,9 @@ namespace IMAP {
       void Null::imap_uid(uint32_t number)
       {
       }
+      void Null::imap_rfc822_size(uint32_t number)
+      {
+      }
       void Null::imap_status_code(Status_Code)
       {
       }
@@ -106,12 +112,60 @@ namespace IMAP {
       void Null::imap_body_section_end()
       {
       }
+      void Null::imap_literal_slice(const char *begin, size_t n)
+      {
+      }
       void Null::imap_section_empty()
       {
       }
       void Null::imap_section_header()
       {
       }
+      void Null::imap_section_part(uint32_t number)
+      {
+      }
+      void Null::imap_section_mime()
+      {
+      }
+      void Null::imap_binary_section_begin()
+      {
+      }
+      void Null::imap_binary_section_end()
+      {
+      }
+      void Null::imap_binary_size(uint32_t number)
+      {
+      }
+      void Null::imap_body_begin()
+      {
+      }
+      void Null::imap_body_end()
+      {
+      }
+      void Null::imap_body_type()
+      {
+      }
+      void Null::imap_body_subtype()
+      {
+      }
+      void Null::imap_body_param_name()
+      {
+      }
+      void Null::imap_body_param_value()
+      {
+      }
+      void Null::imap_body_encoding()
+      {
+      }
+      void Null::imap_body_octets(uint32_t number)
+      {
+      }
+      void Null::imap_body_lines(uint32_t number)
+      {
+      }
+      void Null::imap_body_disposition()
+      {
+      }
 
       void Null::imap_list_begin()
       {
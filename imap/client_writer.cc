@@ -20,8 +20,11 @@
 }}} */
 #include "client_writer.h"
 
+#include <enum.h>
+
 #include <iomanip>
 #include <limits>
+#include <ctype.h>
 using namespace std;
 
 //#include <boost/interprocess/streams/vectorstream.hpp>
@@ -33,45 +36,133 @@ namespace IMAP {
   namespace Client {
 
     Tag::Tag(const std::string &prefix, unsigned width)
-      : prefix_(prefix), width_(width)
+      :
+        prefix_(prefix),
+        width_(width),
+        active_(static_cast<unsigned>(Command::LAST_))
     {
+      if (!prefix_.empty() && isdigit(static_cast<unsigned char>(prefix_.back())))
+        throw logic_error("tag prefix must not end with a digit");
+      if (width_ > 9)
+        throw logic_error("tag width must not exceed 9 digits");
     }
-    void Tag::next(string &tag, Command command)
+    uint32_t Tag::next(string &tag, Command command, bool concurrent)
     {
-      if (command_set_.find(command) != command_set_.end()) {
+      unsigned &a = active_[static_cast<unsigned>(command)];
+      if (a && !concurrent) {
         ostringstream t;
         t << "Command " << command << " is still active.";
         throw logic_error(t.str());
       }
-      command_set_.insert(command);
-      buffer_.clear();
-      buffer_.seekp(0);
-      buffer_ << prefix_ << setw(width_) << setfill('0') << value_;
-      // no std::move() because it is an r-value
-      tag = buffer_.str();
-      auto p = map_.insert(make_pair(tag, command));
-      if (!p.second) {
+      if (table_.find(value_)) {
         ostringstream t;
-        t << "Tag " << p.first->first << " already inserted.";
+        t << "Tag " << prefix_ << value_ << " already inserted.";
         throw logic_error(t.str());
       }
-      ++value_;
+      // no ostringstream - i.e. no allocation for short tags
+      char digits[10];
+      char *e = digits + sizeof digits;
+      char *b = e;
+      uint32_t v = value_;
+      do {
+        *--b = '0' + v % 10;
+        v /= 10;
+      } while (v);
+      tag.assign(prefix_);
+      if (unsigned(e - b) < width_)
+        tag.append(width_ - (e - b), '0');
+      tag.append(b, e);
+      table_.insert(value_, command);
+      ++a;
+      last_ = value_;
+      value_ = (value_ + 1) % 1000000000u;
+      return last_;
+    }
+    uint32_t Tag::last() const
+    {
+      return last_;
+    }
+    bool Tag::has_prefix(const char *begin, const char *end) const
+    {
+      return size_t(end - begin) > prefix_.size()
+        && !prefix_.compare(0, prefix_.size(), begin, prefix_.size());
+    }
+    bool Tag::matches(const char *begin, const char *end) const
+    {
+      if (!has_prefix(begin, end))
+        return false;
+      const char *b = begin + prefix_.size();
+      size_t n = end - b;
+      if (n < width_ || n > 9)
+        return false;
+      if (n > width_ && *b == '0')
+        return false;
+      for (const char *i = b; i != end; ++i)
+        if (!isdigit(static_cast<unsigned char>(*i)))
+          return false;
+      return true;
+    }
+    uint32_t Tag::number(const char *begin, const char *end) const
+    {
+      if (!matches(begin, end)) {
+        ostringstream t;
+        t << "Unknown tag: " << string(begin, end);
+        throw logic_error(t.str());
+      }
+      uint32_t r = 0;
+      for (const char *i = begin + prefix_.size(); i != end; ++i)
+        r = r * 10 + (*i - '0');
+      return r;
     }
     void Tag::pop(const std::string &tag)
     {
-      auto i = map_.find(tag);
-      if (i == map_.end()) {
+      uint32_t n = 0;
+      try {
+        n = number(tag.data(), tag.data() + tag.size());
+      } catch (const logic_error &) {
         stringstream t;
         t << "Trying to pop unknown tag: " << tag;
         throw logic_error(t.str());
       }
-      size_t r = command_set_.erase(i->second);
-      if (!r) {
+      pop(n);
+    }
+    void Tag::pop(uint32_t number)
+    {
+      Command *c = table_.find(number);
+      if (!c) {
+        stringstream t;
+        t << "Trying to pop unknown tag number: " << number;
+        throw logic_error(t.str());
+      }
+      unsigned &a = active_[static_cast<unsigned>(*c)];
+      if (!a) {
         stringstream t;
-        t << "Command " << i->second << " for tag " << tag << " unknown";
+        t << "Command " << *c << " for tag number " << number << " unknown";
         throw logic_error(t.str());
       }
-      map_.erase(i);
+      --a;
+      table_.erase(number);
+    }
+
+
+    static const char * const validation_map[] = {
+      "always",
+      "first",
+      "debug"
+    };
+    std::ostream &operator<<(std::ostream &o, Validation v)
+    {
+      o << enum_str(validation_map, v);
+      return o;
+    }
+    Validation to_validation(const std::string &s)
+    {
+      for (unsigned i = 0; i < sizeof(validation_map)/sizeof(validation_map[0]);
+          ++i)
+        if (s == validation_map[i])
+          return static_cast<Validation>(i + 1);
+      throw runtime_error("Unknown validation mode: " + s
+          + " (expected: always, first or debug)");
     }
 
 
@@ -79,28 +170,100 @@ namespace IMAP {
       :
         parser_(buffer_, tag_buffer_, null_cb_),
         generate_(tag),
-        write_fn_(write_fn)
+        write_fn_(write_fn),
+        validated_(static_cast<unsigned>(Command::LAST_))
+    {
+    }
+    void Writer::set_validation(Validation v, unsigned n)
     {
+      if (!(v > Validation::FIRST_ && v < Validation::LAST_))
+        throw logic_error("unknown validation mode");
+      validation_ = v;
+      validate_n_ = n;
+    }
+    void Writer::set_max_command_length(size_t n)
+    {
+      max_command_length_ = n;
+    }
+    void Writer::set_authenticated()
+    {
+      parser_.set_authenticated();
+    }
+    const std::vector<uint32_t> &Writer::tag_numbers() const
+    {
+      return tag_numbers_;
+    }
+    // the server parser tracks the connection state, thus these
+    // commands are always validated
+    static bool changes_state(Command c)
+    {
+      switch (c) {
+        case Command::LOGIN:
+        case Command::AUTHENTICATE:
+        case Command::LOGOUT:
+        case Command::SELECT:
+        case Command::EXAMINE:
+        case Command::CLOSE:
+          return true;
+        default:
+          ;
+      }
+      return false;
+    }
+    bool Writer::validate()
+    {
+      switch (validation_) {
+        case Validation::ALWAYS:
+          return true;
+        case Validation::FIRST_N:
+          {
+            if (changes_state(command_))
+              return true;
+            // skipping is fine because each write() is a complete command,
+            // i.e. the parser is always in its start state afterwards
+            unsigned &n = validated_[static_cast<unsigned>(command_)];
+            if (n >= validate_n_)
+              return false;
+            ++n;
+            return true;
+          }
+        case Validation::DEBUG:
+#ifdef NDEBUG
+          return false;
+#else
+          return true;
+#endif
+        default:
+          ;
+      }
+      return true;
     }
     void Writer::write(std::vector<char> &v)
     {
       // to verify that we send conforming IMAP commands
-      parser_.read(v.data(), v.data()+v.size());
+      if (validate())
+        parser_.read(v.data(), v.data()+v.size());
       if (write_fn_)
         write_fn_(v);
     }
     void Writer::nullary(Command c, string &tag)
     {
-      generate_.next(tag, c);
+      tag_numbers_.clear();
+      tag_numbers_.push_back(generate_.next(tag, c));
+      command_ = c;
       v_.clear();
       stream_.swap_vector(v_);
       stream_ << tag << ' ' << c << "\r\n";
       stream_.swap_vector(v_);
       write(v_);
     }
-    void Writer::command_start(Command c, string &tag)
+    void Writer::command_start(Command c, string &tag, bool concurrent,
+        bool continued)
     {
-      generate_.next(tag, c);
+      if (!continued)
+        tag_numbers_.clear();
+      tag_numbers_.push_back(generate_.next(tag, c, concurrent || continued));
+      command_ = c;
       v_.clear();
       stream_.swap_vector(v_);
       stream_ << tag << ' ' << c << ' ';
@@ -205,13 +368,54 @@ namespace IMAP {
         write_sequence(*i);
       }
     }
+    static size_t sequence_nr_length(uint32_t nz)
+    {
+      if (nz == numeric_limits<uint32_t>::max())
+        return 1;
+      size_t r = 1;
+      for (; nz >= 10; nz /= 10)
+        ++r;
+      return r;
+    }
+    static size_t sequence_length(const std::pair<uint32_t, uint32_t> &seq)
+    {
+      if (seq.first == seq.second)
+        return sequence_nr_length(seq.first);
+      return sequence_nr_length(seq.first) + 1
+        + sequence_nr_length(seq.second);
+    }
+    void Writer::write_split(Command c,
+        const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
+        const std::string &suffix, string &tag, bool concurrent)
+    {
+      if (sequence_set.empty())
+        throw logic_error("sequence must not be empty");
+      auto i = sequence_set.begin();
+      bool continued = false;
+      while (i != sequence_set.end()) {
+        command_start(c, tag, concurrent, continued);
+        continued = true;
+        size_t n = size_t(stream_.tellp()) + suffix.size() + 2;
+        write_sequence(*i);
+        n += sequence_length(*i);
+        ++i;
+        for (; i != sequence_set.end(); ++i) {
+          size_t l = 1 + sequence_length(*i);
+          if (max_command_length_ && n + l > max_command_length_)
+            break;
+          stream_ << ',';
+          write_sequence(*i);
+          n += l;
+        }
+        stream_ << suffix;
+        command_finish();
+      }
+    }
     void Writer::uid_expunge(
         const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
         string &tag)
     {
-      command_start(Command::UID_EXPUNGE, tag);
-      write_sequence_set(sequence_set);
-      command_finish();
+      write_split(Command::UID_EXPUNGE, sequence_set, string(), tag);
     }
     void Writer::fetch(const vector<std::pair<uint32_t, uint32_t> > &sequence_set,
             const std::vector<Fetch_Attribute> &as, string &tag)
@@ -221,29 +425,46 @@ namespace IMAP {
       command_start(Command::FETCH, tag);
       write_sequence_set(sequence_set);
       stream_ << ' ';
+      write_fetch_attributes(stream_, as);
+      command_finish();
+    }
+    void Writer::uid_fetch(
+        const vector<std::pair<uint32_t, uint32_t> > &sequence_set,
+        const std::vector<Fetch_Attribute> &as, string &tag, bool concurrent)
+    {
+      if (as.empty())
+        throw logic_error("empty fetch attribute list not allowed");
+      ostringstream o;
+      o << ' ';
+      write_fetch_attributes(o, as);
+      write_split(Command::UID_FETCH, sequence_set, o.str(), tag, concurrent);
+    }
+    void Writer::write_fetch_attributes(std::ostream &o,
+        const std::vector<Fetch_Attribute> &as)
+    {
       if (as.size() == 1) {
-        stream_ << as.front();
+        o << as.front();
       } else {
-        stream_ << '(';
+        o << '(';
         auto i = as.begin();
-        stream_ << *i;
+        o << *i;
         ++i;
         for (; i != as.end(); ++i) {
-          stream_ << ' ' << *i;
+          o << ' ' << *i;
         }
-        stream_ << ')';
+        o << ')';
       }
-      command_finish();
     }
-    void Writer::write_flags(const std::vector<IMAP::Flag> &flags)
+    void Writer::write_flags(std::ostream &o,
+        const std::vector<IMAP::Flag> &flags)
     {
       if (flags.empty())
         throw std::runtime_error("empty flag list not allowed");
       auto i = flags.begin();
-      stream_ << '\\' << *i;
+      o << '\\' << *i;
       ++i;
       for (; i != flags.end(); ++i)
-        stream_ << " \\" << *i;
+        o << " \\" << *i;
     }
     void Writer::uid_store(
         const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
@@ -253,16 +474,13 @@ namespace IMAP {
         bool silent
         )
     {
-      command_start(Command::UID_STORE, tag);
-      write_sequence_set(sequence_set);
-      stream_ << ' ';
-      stream_ << mode;
-      stream_ << "FLAGS";
+      ostringstream o;
+      o << ' ' << mode << "FLAGS";
       if (silent)
-        stream_ << ".SILENT";
-      stream_ << ' ';
-      write_flags(flags);
-      command_finish();
+        o << ".SILENT";
+      o << ' ';
+      write_flags(o, flags);
+      write_split(Command::UID_STORE, sequence_set, o.str(), tag);
     }
 
   }
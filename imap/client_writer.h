@@ -27,6 +27,7 @@
 #include <sstream>
 #include <map>
 #include <set>
+#include <ostream>
 #include <stdint.h>
 #include <stddef.h> 
 
@@ -35,28 +36,66 @@
 
 #include "imap.h"
 #include "server_parser.h"
+#include "tag_table.h"
 
 namespace IMAP {
 
   namespace Client {
 
+    // Generates the tags, i.e. prefix + zero padded counter (e.g. A042),
+    // and tracks the outstanding ones by number - the client parser
+    // reports the number of a tagged response via imap_tag_number(),
+    // thus no string has to be formatted or compared per command.
     class Tag {
       private:
-        std::string        prefix_    ;
-        unsigned           width_  {3};
-        size_t             value_  {0};
-        std::ostringstream buffer_    ;
-
-        std::map<std::string, IMAP::Client::Command> map_;
-        std::set<IMAP::Client::Command>              command_set_;
+        std::string          prefix_;
+        unsigned             width_  {3};
+        // wraps at 10^9, i.e. the number of a tag fits into 9 digits
+        uint32_t             value_  {0};
+        uint32_t             last_   {0};
+
+        Tag_Table<Command>   table_;
+        // outstanding commands per command type
+        std::vector<unsigned> active_;
       public:
         Tag(const std::string &prefix = "A", unsigned width = 3);
 
-        // also store in map
-        void next(std::string &tag, Command command);
-        // pop tag from map
+        // also store in table, returns the number of the tag;
+        // only one command per command type may be outstanding, unless
+        // concurrent is set (e.g. for the parts of a split command)
+        uint32_t next(std::string &tag, Command command,
+            bool concurrent = false);
+        // the number of the tag last returned by next()
+        uint32_t last() const;
+        // pop tag from table
         void pop(const std::string &tag);
+        void pop(uint32_t number);
+        // e.g. 42 for A042, throws unless matches()
+        uint32_t number(const char *begin, const char *end) const;
+        bool has_prefix(const char *begin, const char *end) const;
+        // prefix + digits as generated by next(), i.e. zero padded
+        // only up to the width - A042 but not A0042 or A42
+        bool matches(const char *begin, const char *end) const;
+    };
+
+    // Which outgoing commands are run through IMAP::Server::Parser,
+    // i.e. are checked against the server side of the grammar.
+    enum class Validation : unsigned {
+      FIRST_,
+      // every command
+      ALWAYS,
+      // only the first n commands of each command type - e.g. a long
+      // UID STORE sequence set costs as much to parse as to generate;
+      // commands that change the connection state (LOGIN, SELECT etc.)
+      // are always validated
+      FIRST_N,
+      // every command in debug builds, none if NDEBUG is defined
+      DEBUG,
+      LAST_
     };
+    std::ostream &operator<<(std::ostream &o, Validation v);
+    // "always", "first" or "debug"
+    Validation to_validation(const std::string &s);
 
     class Writer {
       public:
@@ -71,13 +110,28 @@ namespace IMAP {
         Tag      &generate_;
         Write_Fn  write_fn_;
 
+        // 0 means unlimited
+        size_t                max_command_length_ {0};
+        // of the commands written by the last call
+        std::vector<uint32_t> tag_numbers_;
+
+        Validation            validation_ {Validation::ALWAYS};
+        unsigned              validate_n_ {1};
+        // per command type
+        std::vector<unsigned> validated_;
+        Command               command_    {Command::FIRST_};
+
         std::vector<char> v_;
         using VectorStream =
           boost::interprocess::basic_vectorstream<std::vector<char> >;
         VectorStream stream_;
 
+        bool validate();
         void write(std::vector<char> &v);
-        void command_start(Command c, std::string &tag);
+        // concurrent: other commands of that type may still be active,
+        // continued: the next part of a split command
+        void command_start(Command c, std::string &tag,
+            bool concurrent = false, bool continued = false);
         void command_finish();
         void nullary(Command c, std::string &tag);
         void write_literal(const std::string &s);
@@ -86,10 +140,34 @@ namespace IMAP {
         void write_sequence(const std::pair<uint32_t, uint32_t> &seq);
         void write_sequence_set(
             const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set);
-        void write_flags(const std::vector<IMAP::Flag> &flags);
+        // splits the set into several commands if necessary, each
+        // ending with suffix
+        void write_split(Command c,
+            const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
+            const std::string &suffix, std::string &tag,
+            bool concurrent = false);
+        static void write_flags(std::ostream &o,
+            const std::vector<IMAP::Flag> &flags);
+        static void write_fetch_attributes(std::ostream &o,
+            const std::vector<Fetch_Attribute> &as);
       public:
         Writer(Tag &tag, Write_Fn write_fn = nullptr);
 
+        // n is only used with Validation::FIRST_N
+        void set_validation(Validation v, unsigned n = 1);
+        // Limits the length of UID STORE, UID EXPUNGE and UID FETCH commands
+        // (including the CRLF) by splitting the sequence set into several
+        // commands, 0 means unlimited. Single sequence elements are never
+        // split, i.e. a command may still exceed n if n is very small.
+        void set_max_command_length(size_t n);
+        // the connection is already authenticated, i.e. commands are
+        // validated as in the authenticated state
+        // (cf. IMAP::Server::Parser::set_authenticated())
+        void set_authenticated();
+        // numbers of the tags generated by the last call,
+        // i.e. more than one if a command was split
+        const std::vector<uint32_t> &tag_numbers() const;
+
         void capability(std::string &tag);
         void noop      (std::string &tag);
         void logout    (std::string &tag);
@@ -105,6 +183,7 @@ namespace IMAP {
 
         void close  (std::string &tag);
         void expunge(std::string &tag);
+        // tag is set to the tag of the last command if the set is split
         void uid_expunge(
             const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
             std::string &tag);
@@ -119,6 +198,14 @@ namespace IMAP {
             const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
             const std::vector<Fetch_Attribute> &as, std::string &tag
             );
+        // concurrent: pipelined, i.e. other UID FETCH commands
+        // may still be active - tag is set to the tag of the last
+        // command if the set is split
+        void uid_fetch(
+            const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
+            const std::vector<Fetch_Attribute> &as, std::string &tag,
+            bool concurrent = false
+            );
 
     };
 
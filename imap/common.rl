@@ -90,19 +90,25 @@ action buffer_add_char
 }
 action number_start
 {
-  number_buffer_.start(p);
   number_ = 0;
 }
+# accumulate in place - no copy of the digits, no lexical_cast
+action number_digit
+{
+  {
+    uint64_t n = uint64_t(number_) * 10u + uint64_t(fc - '0');
+    if (n > std::numeric_limits<uint32_t>::max())
+      throw std::overflow_error("number is >= 4,294,967,296");
+    number_ = n;
+  }
+}
 action number_finish
 {
-  number_buffer_.finish(p);
-  number_ = boost::lexical_cast<uint32_t>(
-      string(number_buffer_.begin(), number_buffer_.end()));
   literal_pos_ = 0;
 }
 action literal_tail_begin
 {
-  buffer_.cont(p);
+  lit_cont(p);
 }
 action call_literal_tail
 {
@@ -117,7 +123,7 @@ action literal_tail_cond_return
 {
   ++literal_pos_;
   if (literal_pos_ == number_) {
-    buffer_.finish(p+1);
+    lit_finish(p+1);
     fret;
   }
 }
@@ -162,13 +168,13 @@ atom = ATOM_CHAR+ ;
 #                    ; Unsigned 32-bit integer
 #                    ; (0 <= n < 4,294,967,296)
 
-number = DIGIT{1,10} >number_start %number_finish ;
+number = DIGIT{1,10} >number_start $number_digit %number_finish ;
 
 # nz-number       = digit-nz *DIGIT
 #                    ; Non-zero unsigned 32-bit integer
 #                    ; (0 < n < 4,294,967,296)
 
-nz_number = (digit_nz DIGIT {0,10} ) >number_start %number_finish ;
+nz_number = (digit_nz DIGIT {0,10} ) >number_start $number_digit %number_finish ;
 
 # literal         = "{" number "}" CRLF *CHAR8
 #                    ; Number represents the number of CHAR8s
@@ -180,7 +186,7 @@ literal_tail := (CHAR8*) >literal_tail_begin $literal_tail_cond_return;
 # convert_literal_tail is defined in imap/literal_converter.rl
 literal_tail_convert := convert_literal_tail;
 
-literal = '{' number >number_start %number_finish '}' CRLF @buffer_clear  @call_literal_tail ;
+literal = '{' number '}' CRLF @buffer_clear  @call_literal_tail ;
 
 # QUOTED-CHAR     = <any TEXT-CHAR except quoted-specials> /
 #                   "\" quoted-specials
@@ -313,7 +319,7 @@ flag = (
               | (atom - non_extensions) %buffer_finish %cb_flag_atom
               )
        )
-     | flag_keyword >buffer_start %buffer_finish )
+     | flag_keyword >buffer_start %buffer_finish %cb_flag_atom )
      ;
 
 
@@ -360,13 +366,13 @@ section_msgtext = /HEADER/i %cb_section_header
 # section-part    = nz-number *("." nz-number)
 #                    ; body part nesting
 
-section_part = nz_number ( '.' nz_number )* ;
+section_part = nz_number %cb_section_part ( '.' nz_number %cb_section_part )* ;
 
 # section-text    = section-msgtext / "MIME"
 #                    ; text other than actual body part (headers, etc.)
 
 section_text = section_msgtext
-             | /MIME/i ;
+             | /MIME/i %cb_section_mime ;
 
 # section-spec    = section-msgtext / (section-part ["." section-text])
 
@@ -378,6 +384,12 @@ section_spec = section_msgtext
 section = '[' @cb_body_section_begin
              ( section_spec ']' | ']' @cb_section_empty ) ;
 
+# RFC 3516 - IMAP4 Binary Content Extension
+
+# section-binary  = "[" [section-part] "]"
+
+section_binary = '[' @cb_binary_section_begin section_part? ']' ;
+
 # RFC 2971 - IMAP4 ID extension
 
 # id_params_list ::= "(" #(string SPACE nstring) ")" / nil
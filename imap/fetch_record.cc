@@ -0,0 +1,223 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "fetch_record.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace IMAP {
+
+  namespace Client {
+
+    namespace Record {
+
+      Arena::Arena(size_t block_size)
+        :
+          block_size_(block_size)
+      {
+      }
+
+      void *Arena::allocate(size_t n, size_t align)
+      {
+        for (;;) {
+          if (block_ < blocks_.size()) {
+            Block &b = blocks_[block_];
+            size_t off = (pos_ + align - 1) & ~(align - 1);
+            if (off + n <= b.size) {
+              pos_ = off + n;
+              used_ += n;
+              return b.data.get() + off;
+            }
+            // reuse the next block if it is large enough
+            if (block_ + 1 < blocks_.size() && blocks_[block_ + 1].size >= n) {
+              ++block_;
+              pos_ = 0;
+              continue;
+            }
+          }
+          Block b;
+          // new[] returns memory suitably aligned for any fundamental type
+          b.size = std::max(block_size_, n);
+          b.data.reset(new char[b.size]);
+          size_t i = blocks_.empty() ? 0 : std::min(block_ + 1, blocks_.size());
+          blocks_.insert(blocks_.begin() + i, std::move(b));
+          block_ = i;
+          pos_   = 0;
+        }
+      }
+
+      const char *Arena::copy(const char *begin, const char *end)
+      {
+        size_t n = end - begin;
+        char *r = static_cast<char*>(allocate(n, 1));
+        if (n)
+          memcpy(r, begin, n);
+        return r;
+      }
+
+      void Arena::reset()
+      {
+        block_ = 0;
+        pos_   = 0;
+        used_  = 0;
+      }
+
+      size_t Arena::used() const
+      {
+        return used_;
+      }
+
+      size_t Arena::capacity() const
+      {
+        size_t r = 0;
+        for (auto &b : blocks_)
+          r += b.size;
+        return r;
+      }
+
+      bool Fetch::has(Flag flag) const
+      {
+        return flags & (uint32_t(1) << unsigned(flag));
+      }
+
+      Batch::Batch(const Fetch *begin, const Fetch *end)
+        :
+          begin_(begin),
+          end_(end)
+      {
+      }
+
+      Builder::Builder(Batch_Fn batch_fn, size_t batch_size,
+          size_t arena_block_size)
+        :
+          batch_fn_(batch_fn),
+          batch_size_(std::max(batch_size, size_t(1))),
+          arena_(arena_block_size)
+      {
+        records_.reserve(batch_size_);
+      }
+
+      Memory::Buffer::Vector &Builder::buffer()
+      {
+        return buffer_;
+      }
+      Memory::Buffer::Vector &Builder::tag_buffer()
+      {
+        return tag_buffer_;
+      }
+      const Arena &Builder::arena() const
+      {
+        return arena_;
+      }
+
+      void Builder::flush()
+      {
+        if (!records_.empty()) {
+          batch_fn_(Batch(records_.data(), records_.data() + records_.size()));
+          records_.clear();
+        }
+        arena_.reset();
+      }
+
+      void Builder::imap_data_fetch_begin(uint32_t number)
+      {
+        records_.emplace_back();
+        records_.back().number = number;
+        keywords_.clear();
+        sections_.clear();
+        in_fetch_ = true;
+      }
+      void Builder::imap_data_fetch_end()
+      {
+        Fetch &r = records_.back();
+        if (!keywords_.empty()) {
+          Slice *v = arena_.allocate_array<Slice>(keywords_.size());
+          std::copy(keywords_.begin(), keywords_.end(), v);
+          r.keywords      = v;
+          r.keyword_count = keywords_.size();
+        }
+        if (!sections_.empty()) {
+          Section *v = arena_.allocate_array<Section>(sections_.size());
+          std::copy(sections_.begin(), sections_.end(), v);
+          r.sections      = v;
+          r.section_count = sections_.size();
+        }
+        in_fetch_ = false;
+        if (records_.size() >= batch_size_)
+          flush();
+      }
+      void Builder::imap_flag(Flag flag)
+      {
+        if (!in_fetch_)
+          return;
+        records_.back().has_flags = true;
+        records_.back().flags |= uint32_t(1) << unsigned(flag);
+      }
+      void Builder::imap_atom_flag()
+      {
+        if (!in_fetch_)
+          return;
+        records_.back().has_flags = true;
+        Slice s;
+        s.begin = arena_.copy(buffer_.begin(), buffer_.end());
+        s.size  = buffer_.end() - buffer_.begin();
+        keywords_.push_back(s);
+      }
+      void Builder::imap_uid(uint32_t number)
+      {
+        if (in_fetch_)
+          records_.back().uid = number;
+      }
+      void Builder::imap_rfc822_size(uint32_t number)
+      {
+        if (!in_fetch_)
+          return;
+        records_.back().rfc822_size     = number;
+        records_.back().has_rfc822_size = true;
+      }
+      void Builder::imap_body_section_begin()
+      {
+        sections_.emplace_back();
+      }
+      void Builder::imap_section_empty()
+      {
+        sections_.back().kind = Section_Kind::FULL;
+      }
+      void Builder::imap_section_header()
+      {
+        sections_.back().kind = Section_Kind::HEADER;
+      }
+      void Builder::imap_body_section_end()
+      {
+        Slice &s = sections_.back().content;
+        s.begin = arena_.copy(buffer_.begin(), buffer_.end());
+        s.size  = buffer_.end() - buffer_.begin();
+      }
+      void Builder::imap_tagged_status_end(Server::Response::Status c)
+      {
+        flush();
+      }
+
+    }
+
+  }
+
+}
@@ -0,0 +1,177 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef IMAP_FETCH_RECORD_H
+#define IMAP_FETCH_RECORD_H
+
+#include <imap/client_parser.h>
+#include <buffer/buffer.h>
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstddef>
+#include <stdint.h>
+
+namespace IMAP {
+
+  namespace Client {
+
+    // Optional layer on top of the fine grained parser callbacks:
+    // each '* n FETCH' response is assembled into a compact Record::Fetch
+    // whose variable sized parts (keywords, section contents) live
+    // in an arena.
+    //
+    // The records are handed out in batches - they (and everything they
+    // point to) are valid until the batch function returns, afterwards
+    // the arena is reset and its memory reused for the next batch.
+    namespace Record {
+
+      // Bump allocator - reset() just rewinds, i.e. after warming up
+      // no heap allocations happen anymore.
+      class Arena {
+        private:
+          struct Block {
+            std::unique_ptr<char[]> data;
+            size_t                  size {0};
+          };
+          std::vector<Block> blocks_;
+          size_t             block_size_ {0};
+          size_t             block_      {0};
+          size_t             pos_        {0};
+          size_t             used_       {0};
+        public:
+          explicit Arena(size_t block_size = 64 * 1024);
+          Arena(const Arena &) =delete;
+          Arena &operator=(const Arena &) =delete;
+
+          void *allocate(size_t n, size_t align = alignof(std::max_align_t));
+          template <typename T> T *allocate_array(size_t n)
+          {
+            return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+          }
+          const char *copy(const char *begin, const char *end);
+          void reset();
+          // bytes handed out since the last reset()
+          size_t used() const;
+          // bytes allocated from the heap
+          size_t capacity() const;
+      };
+
+      struct Slice {
+        const char *begin {nullptr};
+        size_t      size  {0};
+
+        const char *end() const { return begin + size; }
+      };
+
+      enum class Section_Kind {
+        FULL,   // BODY[]
+        HEADER, // BODY[HEADER]
+        OTHER   // e.g. BODY[TEXT], BODY[1.2]
+      };
+
+      struct Section {
+        Section_Kind kind {Section_Kind::OTHER};
+        Slice        content;
+      };
+
+      struct Fetch {
+        uint32_t       number          {0};
+        // UIDs are non-zero, i.e. 0 means not fetched
+        uint32_t       uid             {0};
+        uint32_t       rfc822_size     {0};
+        bool           has_rfc822_size {false};
+        bool           has_flags       {false};
+        // bit (1 << unsigned(Flag::X)) is set for each system flag
+        uint32_t       flags           {0};
+        const Slice   *keywords        {nullptr};
+        size_t         keyword_count   {0};
+        const Section *sections        {nullptr};
+        size_t         section_count   {0};
+
+        bool has(Flag flag) const;
+      };
+
+      class Batch {
+        private:
+          const Fetch *begin_ {nullptr};
+          const Fetch *end_   {nullptr};
+        public:
+          Batch(const Fetch *begin, const Fetch *end);
+          const Fetch *begin() const { return begin_; }
+          const Fetch *end()   const { return end_; }
+          size_t size()        const { return end_ - begin_; }
+          bool empty()         const { return begin_ == end_; }
+      };
+
+      // Usage:
+      //
+      //     Record::Builder b(fn);
+      //     Parser p(b.buffer(), b.tag_buffer(), b);
+      //
+      // A batch is completed after batch_size records and at the end
+      // of each tagged response. Literal slicing must not be enabled on
+      // the parser, the section contents are copied from the buffer.
+      class Builder : public Callback::Null {
+        public:
+          using Batch_Fn = std::function<void(const Batch &batch)>;
+        private:
+          Batch_Fn               batch_fn_;
+          size_t                 batch_size_ {0};
+          Memory::Buffer::Vector buffer_;
+          Memory::Buffer::Vector tag_buffer_;
+          Arena                  arena_;
+          std::vector<Fetch>     records_;
+          // collected per record, copied into the arena at its end
+          std::vector<Slice>     keywords_;
+          std::vector<Section>   sections_;
+          bool                   in_fetch_ {false};
+
+        protected:
+          void imap_data_fetch_begin(uint32_t number) override;
+          void imap_data_fetch_end() override;
+          void imap_flag(Flag flag) override;
+          void imap_atom_flag() override;
+          void imap_uid(uint32_t number) override;
+          void imap_rfc822_size(uint32_t number) override;
+          void imap_body_section_begin() override;
+          void imap_section_empty() override;
+          void imap_section_header() override;
+          void imap_body_section_end() override;
+          void imap_tagged_status_end(Server::Response::Status c) override;
+        public:
+          Builder(Batch_Fn batch_fn, size_t batch_size = 64,
+              size_t arena_block_size = 64 * 1024);
+
+          Memory::Buffer::Vector &buffer();
+          Memory::Buffer::Vector &tag_buffer();
+          const Arena &arena() const;
+          // hand out the pending records (if any) and reset the arena
+          void flush();
+      };
+
+    }
+
+  }
+
+}
+
+#endif
@@ -46,7 +46,8 @@ namespace IMAP {
     "HEADER",
     "HEADER.FIELDS",
     "HEADER.FIELDS.NOT",
-    "TEXT"
+    "TEXT",
+    "MIME"
   };
   std::ostream &operator<<(std::ostream &o, Section section)
   {
@@ -63,6 +64,8 @@ namespace IMAP {
     if (   section_ == Section::HEADER_FIELDS
         || section_ == Section::HEADER_FIELDS_NOT)
       throw logic_error("HEADER_FIELDS has empty field list");
+    if (section_ == Section::MIME)
+      throw logic_error("MIME is only allowed with a section part");
   }
   Section_Attribute::Section_Attribute(Section section, const std::vector<string> &headers)
     :
@@ -87,8 +90,36 @@ namespace IMAP {
     if (headers_.empty())
       throw logic_error("empty field list not allowed");
   }
+  Section_Attribute::Section_Attribute(const std::vector<uint32_t> &part,
+      Section section)
+    :
+      section_(section),
+      part_(part)
+  {
+    if (part_.empty())
+      throw logic_error("empty section part");
+    for (auto i : part_)
+      if (!i)
+        throw logic_error("section part numbers must be non-zero");
+    if (   section_ == Section::HEADER_FIELDS
+        || section_ == Section::HEADER_FIELDS_NOT)
+      throw logic_error("HEADER_FIELDS has empty field list");
+  }
+  Section Section_Attribute::section() const
+  {
+    return section_;
+  }
   std::ostream &Section_Attribute::print(ostream &o) const
   {
+    if (!part_.empty()) {
+      auto i = part_.begin();
+      o << *i;
+      ++i;
+      for (; i != part_.end(); ++i)
+        o << '.' << *i;
+      if (section_ != Section::FIRST_)
+        o << '.';
+    }
     if (section_ == Section::FIRST_)
       return o;
     o << section_;
@@ -167,6 +198,9 @@ namespace IMAP {
       "UID",
       "BODY",
       "BODY.PEEK",
+      "BINARY",
+      "BINARY.PEEK",
+      "BINARY.SIZE"
     };
     std::ostream &operator<<(std::ostream &o, Fetch fetch)
     {
@@ -183,8 +217,7 @@ namespace IMAP {
         fetch_(fetch),
         section_(section)
     {
-      if (!(fetch_ == Fetch::BODY || fetch_ == Fetch::BODY_PEEK))
-        throw logic_error("sections only allowed with BODY/BODY_PEEK attributes");
+      check_section();
     }
     Fetch_Attribute::Fetch_Attribute(Fetch fetch,
         Section_Attribute &&section)
@@ -192,13 +225,28 @@ namespace IMAP {
         fetch_(fetch),
         section_(std::move(section))
     {
+      check_section();
+    }
+    static bool is_binary(Fetch fetch)
+    {
+      return fetch == Fetch::BINARY || fetch == Fetch::BINARY_PEEK
+        || fetch == Fetch::BINARY_SIZE;
+    }
+    void Fetch_Attribute::check_section() const
+    {
+      if (is_binary(fetch_)) {
+        if (section_.section() != Section::FIRST_)
+          throw logic_error("BINARY sections only consist of a section part");
+        return;
+      }
       if (!(fetch_ == Fetch::BODY || fetch_ == Fetch::BODY_PEEK))
-        throw logic_error("sections only allowed with BODY/BODY_PEEK attributes");
+        throw logic_error("sections only allowed with BODY/BODY_PEEK/BINARY attributes");
     }
     std::ostream &Fetch_Attribute::print(std::ostream &o) const
     {
       o << fetch_;
-      if (fetch_ == Fetch::BODY || fetch_ == Fetch::BODY_PEEK) {
+      if (fetch_ == Fetch::BODY || fetch_ == Fetch::BODY_PEEK
+          || is_binary(fetch_)) {
         o << '[';
         o << section_;
         o << ']';
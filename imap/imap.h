@@ -24,6 +24,7 @@
 #include <ostream>
 #include <vector>
 #include <string>
+#include <stdint.h>
 
 namespace IMAP {
 
@@ -49,6 +50,7 @@ namespace IMAP {
     HEADER_FIELDS,
     HEADER_FIELDS_NOT,
     TEXT,
+    MIME,
     LAST_
   };
   std::ostream &operator<<(std::ostream &o, Section &s);
@@ -57,11 +59,16 @@ namespace IMAP {
     private:
       Section section_ { Section::FIRST_ };
       std::vector<std::string> headers_;
+      // section-part, e.g. {1, 2} for BODY[1.2]
+      std::vector<uint32_t> part_;
     public:
       Section_Attribute();
       Section_Attribute(Section section);
       Section_Attribute(Section section, const std::vector<std::string> &headers);
       Section_Attribute(Section section, std::vector<std::string> &&headers);
+      Section_Attribute(const std::vector<uint32_t> &part,
+          Section section = Section::FIRST_);
+      Section section() const;
       std::ostream &print(std::ostream &o) const;
   };
   std::ostream &operator<<(std::ostream &o, const Section_Attribute &a);
@@ -133,6 +140,10 @@ namespace IMAP {
       UID,
       BODY,
       BODY_PEEK,
+      // RFC3516, only with a section part (or an empty section)
+      BINARY,
+      BINARY_PEEK,
+      BINARY_SIZE,
       LAST_
     };
     std::ostream &operator<<(std::ostream &o, Fetch &s);
@@ -140,6 +151,7 @@ namespace IMAP {
       private:
         Fetch fetch_ { Fetch::FIRST_ };
         Section_Attribute section_;
+        void check_section() const;
       public:
         Fetch_Attribute(Fetch fetch);
         Fetch_Attribute(Fetch fetch,
@@ -30,46 +30,79 @@ machine literal_converter;
 #
 # This is e.g. needed while storing maildir messages
 # that are retrieved via (IMAP).
+#
+# Runs of characters that don't need any conversion are skipped
+# in bulk (cf. lit_skip and imap/literal_scan.h), i.e. the includer
+# has to include imap/literal_scan.h.
 
-action lit_ret
+# The literal content is passed via the lit_cont()/lit_stop()/lit_finish()/
+# lit_add() members of the includer - which either forward to buffer_
+# or report slices of the input (cf. Client::Parser::set_slice_literals()).
+# Same for the literal_tail actions in imap/common.rl.
+
+action lit_count
 {
   ++literal_pos_;
+}
+# executed as the last action of a transition, i.e. a pending CR
+# was already added and a run already continued
+action lit_ret
+{
   if (literal_pos_ == number_) {
-    if (*p == '\n' || *p == '\r') {
-      buffer_.cont(p);
-      buffer_.stop(p+1);
-    } else {
-      buffer_.finish(p+1);
+    if (*p == '\r') {
+      lit_cont(p);
+      lit_stop(p+1);
+    } else if (*p != '\n') {
+      lit_finish(p+1);
     }
     fret;
   }
 }
+action lit_cont
+{
+  lit_cont(p);
+}
+action lit_stop
+{
+  lit_stop(p);
+}
+# skip over the following clean run, i.e. over the characters
+# that are neither CR nor LF (nor NUL, which is an error) - while in s2
+# the buffer is in cont mode, thus the run is just part of it;
+# the last character of the literal is always left to lit_ret
+action lit_skip
+{
+  size_t left = number_ - literal_pos_;
+  if (left > 1) {
+    const char *b = p + 1;
+    const char *e = b + min(size_t(pe - b), left - 1);
+    const char *q = Literal::find_special(b, e);
+    literal_pos_ += q - b;
+    fexec q;
+  }
+}
 action add_cr
 {
-  char c = '\r';
-  buffer_.cont(&c);
-  buffer_.stop(&c+1);
+  lit_add('\r');
 }
 action add_lf
 {
-  char c = '\n';
-  buffer_.cont(&c);
-  buffer_.stop(&c+1);
+  lit_add('\n');
 }
 
 convert_literal_tail =
   start: (
-    (CHAR8 - (CR|LF)) @lit_ret @buffer_cont         -> s2    |
-    CR                @lit_ret                      -> s3
+    (CHAR8 - (CR|LF)) @lit_count @lit_cont @lit_skip @lit_ret         -> s2    |
+    CR                @lit_count @lit_ret                             -> s3
   ),
   s2: (
-    (CHAR8 - (CR|LF)) @lit_ret                      -> s2    |
-    CR                @lit_ret @buffer_stop         -> s3
+    (CHAR8 - (CR|LF)) @lit_count @lit_skip @lit_ret                   -> s2    |
+    CR                @lit_count @lit_stop @lit_ret                   -> s3
   ),
   s3: (
-    LF                @lit_ret @add_lf              -> start |
-    (CHAR8 - (CR|LF)) @lit_ret @add_cr @buffer_cont -> s2    |
-    CR                @lit_ret @add_cr              -> s3
+    LF                @lit_count @add_lf @lit_ret                     -> start |
+    (CHAR8 - (CR|LF)) @lit_count @add_cr @lit_cont @lit_skip @lit_ret -> s2    |
+    CR                @lit_count @add_cr @lit_ret                     -> s3
   );
 
 }%%
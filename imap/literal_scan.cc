@@ -0,0 +1,151 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "literal_scan.h"
+
+#if defined(__SSE2__)
+  #define IMAP_LITERAL_SCAN_SSE2
+  #include <emmintrin.h>
+#endif
+
+// AVX2 is selected at runtime, unless the compiler is already told
+// to target it
+#if defined(__AVX2__)
+  #define IMAP_LITERAL_SCAN_AVX2
+  #include <immintrin.h>
+#elif defined(IMAP_LITERAL_SCAN_SSE2) && defined(__GNUC__) \
+    && (defined(__x86_64__) || defined(__i386__))
+  #define IMAP_LITERAL_SCAN_AVX2
+  #define IMAP_LITERAL_SCAN_AVX2_DISPATCH
+  #include <immintrin.h>
+#endif
+
+namespace IMAP {
+
+  namespace Literal {
+
+    static inline bool is_special(char c)
+    {
+      return c == '\r' || c == '\n' || c == '\0';
+    }
+
+    const char *find_special_scalar(const char *begin, const char *end)
+    {
+      const char *p = begin;
+      for (; p < end; ++p)
+        if (is_special(*p))
+          break;
+      return p;
+    }
+
+#if defined(IMAP_LITERAL_SCAN_SSE2)
+    static const char *find_special_sse2(const char *begin, const char *end)
+    {
+      const __m128i cr  = _mm_set1_epi8('\r');
+      const __m128i lf  = _mm_set1_epi8('\n');
+      const __m128i nul = _mm_setzero_si128();
+      const char *p = begin;
+      for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)),
+            _mm_cmpeq_epi8(v, nul));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+          return p + __builtin_ctz(unsigned(mask));
+      }
+      return find_special_scalar(p, end);
+    }
+#endif
+
+#if defined(IMAP_LITERAL_SCAN_AVX2)
+  #if defined(IMAP_LITERAL_SCAN_AVX2_DISPATCH)
+    __attribute__((target("avx2")))
+  #endif
+    static const char *find_special_avx2(const char *begin, const char *end)
+    {
+      const __m256i cr  = _mm256_set1_epi8('\r');
+      const __m256i lf  = _mm256_set1_epi8('\n');
+      const __m256i nul = _mm256_setzero_si256();
+      const char *p = begin;
+      for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)),
+            _mm256_cmpeq_epi8(v, nul));
+        unsigned mask = unsigned(_mm256_movemask_epi8(m));
+        if (mask)
+          return p + __builtin_ctz(mask);
+      }
+      return find_special_sse2(p, end);
+    }
+#endif
+
+    typedef const char *(*Find_Fn)(const char *, const char *);
+
+    struct Kernel {
+      Find_Fn     fn;
+      const char *name;
+    };
+
+    static Kernel select_kernel()
+    {
+#if defined(IMAP_LITERAL_SCAN_AVX2)
+  #if defined(IMAP_LITERAL_SCAN_AVX2_DISPATCH)
+      // we are possibly called before any constructors are executed
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return Kernel{find_special_avx2, "avx2"};
+  #else
+      return Kernel{find_special_avx2, "avx2"};
+  #endif
+#endif
+#if defined(IMAP_LITERAL_SCAN_SSE2)
+      return Kernel{find_special_sse2, "sse2"};
+#else
+      return Kernel{find_special_scalar, "scalar"};
+#endif
+    }
+
+    // selected on first use - find_special() might be called
+    // from static initializers of other translation units
+    static const Kernel &kernel()
+    {
+      static const Kernel k = select_kernel();
+      return k;
+    }
+
+    const char *find_special(const char *begin, const char *end)
+    {
+      // most runs in mail bodies are shorter than a typical line
+      // thus, don't bother the vector units for tiny ones
+      if (end - begin < 16)
+        return find_special_scalar(begin, end);
+      return kernel().fn(begin, end);
+    }
+
+    const char *kernel_name()
+    {
+      return kernel().name;
+    }
+
+  }
+
+}
@@ -0,0 +1,45 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef IMAP_LITERAL_SCAN_H
+#define IMAP_LITERAL_SCAN_H
+
+namespace IMAP {
+
+  namespace Literal {
+
+    // Returns a pointer to the first CR, LF or NUL character
+    // in [begin, end) - or end if there is none.
+    //
+    // Used by the literal converter to skip over clean runs
+    // in bulk. Uses AVX2 or SSE2 where available.
+    const char *find_special(const char *begin, const char *end);
+
+    // byte-by-byte reference implementation
+    const char *find_special_scalar(const char *begin, const char *end);
+
+    // name of the kernel selected by find_special(), e.g. for logging
+    const char *kernel_name();
+
+  }
+
+}
+
+#endif
@@ -59,7 +59,6 @@ namespace IMAP {
         vector<int>              stack_vector_;
         int                     *stack          {nullptr};
         int                      top            {0};
-        Memory::Buffer::Vector   number_buffer_;
         uint32_t                 number_        {0};
         size_t                   literal_pos_   {0};
         bool                     convert_crlf_  {false};
@@ -71,6 +70,11 @@ namespace IMAP {
         Memory::Buffer::Base    &buffer_;
         Memory::Buffer::Base    &tag_buffer_;
         Callback::Base          &cb_;
+
+        void lit_cont(const char *p);
+        void lit_stop(const char *p);
+        void lit_finish(const char *p);
+        void lit_add(char c);
       public:
         Parser(Memory::Buffer::Base &buffer,
             Memory::Buffer::Base &tag_buffer,
@@ -79,6 +83,10 @@ namespace IMAP {
         bool in_start() const;
         bool finished() const;
         void verify_finished() const;
+        // e.g. after a PREAUTH greeting, i.e. the next command is parsed
+        // as in the authenticated state - only allowed between commands
+        // of the not authenticated state
+        void set_authenticated();
 
     };
 
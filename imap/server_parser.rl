@@ -22,13 +22,13 @@
 
 #include <stdexcept>
 #include <string>
+#include <limits>
 #include <iomanip>
 
 using namespace std;
 
-#include <boost/lexical_cast.hpp>
-
 #include "lex_util.h"
+#include <imap/literal_scan.h>
 
 %%{
 
@@ -84,6 +84,15 @@ action cb_section_empty
 action cb_section_header
 {
 }
+action cb_section_part
+{
+}
+action cb_section_mime
+{
+}
+action cb_binary_section_begin
+{
+}
 
 action userid_begin
 {
@@ -414,6 +423,12 @@ copy = /COPY/i SP sequence_set SP mailbox
 #                  "BODY" ["STRUCTURE"] / "UID" /
 #                  "BODY" section ["<" number "." nz-number ">"] /
 #                  "BODY.PEEK" section ["<" number "." nz-number ">"]
+#
+# RFC3516:
+#
+#fetch-att       =/ "BINARY" [".PEEK"] section-binary [partial] /
+#                   "BINARY.SIZE" section-binary
+#partial         = "<" number "." nz-number ">"
 
 fetch_att = /ENVELOPE/i
           | /FLAGS/i
@@ -423,6 +438,8 @@ fetch_att = /ENVELOPE/i
           | /UID/i
           | /BODY/i      section ('<' number '.' nz_number '>')?
           | /BODY.PEEK/i section ('<' number '.' nz_number '>')?
+          | /BINARY/i (/.PEEK/i)? section_binary ('<' number '.' nz_number '>')?
+          | /BINARY.SIZE/i section_binary
   ;
 
 #fetch           = "FETCH" SP sequence-set SP ("ALL" / "FULL" / "FAST" /
@@ -626,6 +643,24 @@ namespace IMAP {
       }
     }
 
+    void Parser::lit_cont(const char *p)
+    {
+      buffer_.cont(p);
+    }
+    void Parser::lit_stop(const char *p)
+    {
+      buffer_.stop(p);
+    }
+    void Parser::lit_finish(const char *p)
+    {
+      buffer_.finish(p);
+    }
+    void Parser::lit_add(char c)
+    {
+      buffer_.cont(&c);
+      buffer_.stop(&c+1);
+    }
+
     bool Parser::in_start() const
     {
       return cs == %%{write start;}%%;
@@ -635,6 +670,16 @@ namespace IMAP {
       return cs >= %%{write first_final;}%%;
     }
 
+    void Parser::set_authenticated()
+    {
+      if (state_ != IMAP::Connection::State::NOT_AUTHENTICATED
+          || !(in_start() || cs == imapd_en_main_requests_not_authenticated))
+        throw logic_error("can only authenticate between commands"
+            " of the not authenticated state");
+      state_ = IMAP::Connection::State::AUTHENTICATED;
+      cs = imapd_en_authenticated;
+    }
+
     void Parser::verify_finished() const
     {
       (void)imapd_error;
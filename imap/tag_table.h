@@ -0,0 +1,137 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef IMAP_TAG_TABLE_H
+#define IMAP_TAG_TABLE_H
+
+#include <vector>
+#include <stdexcept>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace IMAP {
+
+  namespace Client {
+
+    // Maps the numbers of the outstanding tags to T.
+    //
+    // Tags are numbered consecutively and complete roughly in order, thus
+    // a flat ring indexed by the low bits of the number suffices - no
+    // hashing, no allocation per command. On a collision (i.e. when more
+    // than capacity() tags are outstanding) the ring is doubled.
+    template <typename T>
+    class Tag_Table {
+      private:
+        struct Slot {
+          uint32_t number {0};
+          bool     used   {false};
+          T        value;
+        };
+        std::vector<Slot> slots_;
+        size_t            size_ {0};
+
+        size_t index(uint32_t number) const
+        {
+          return number & (slots_.size() - 1);
+        }
+        void grow()
+        {
+          // the outstanding numbers usually form a window, i.e. doubling
+          // once suffices - but they may be arbitrary
+          size_t capacity = slots_.size() * 2;
+          for (;; capacity *= 2) {
+            std::vector<bool> taken(capacity);
+            bool ok = true;
+            for (auto &s : slots_) {
+              if (!s.used)
+                continue;
+              size_t i = s.number & (capacity - 1);
+              if (taken[i]) {
+                ok = false;
+                break;
+              }
+              taken[i] = true;
+            }
+            if (ok)
+              break;
+          }
+          std::vector<Slot> old(capacity);
+          std::swap(old, slots_);
+          for (auto &s : old)
+            if (s.used)
+              slots_[index(s.number)] = std::move(s);
+        }
+      public:
+        // capacity has to be a power of 2
+        Tag_Table(size_t capacity = 16)
+          : slots_(capacity)
+        {
+          if (!capacity || (capacity & (capacity - 1)))
+            throw std::logic_error("tag table capacity must be a power of 2");
+        }
+        void insert(uint32_t number, T value)
+        {
+          for (;;) {
+            Slot &s = slots_[index(number)];
+            if (!s.used) {
+              s.number = number;
+              s.used   = true;
+              s.value  = std::move(value);
+              ++size_;
+              return;
+            }
+            if (s.number == number)
+              throw std::logic_error("tag number already inserted");
+            grow();
+          }
+        }
+        // nullptr if not present
+        T *find(uint32_t number)
+        {
+          Slot &s = slots_[index(number)];
+          return s.used && s.number == number ? &s.value : nullptr;
+        }
+        const T *find(uint32_t number) const
+        {
+          const Slot &s = slots_[index(number)];
+          return s.used && s.number == number ? &s.value : nullptr;
+        }
+        // returns false if not present
+        bool erase(uint32_t number)
+        {
+          Slot &s = slots_[index(number)];
+          if (!(s.used && s.number == number))
+            return false;
+          s.used  = false;
+          s.value = T();
+          --size_;
+          return true;
+        }
+        size_t size()     const { return size_;         }
+        bool   empty()    const { return !size_;        }
+        size_t capacity() const { return slots_.size(); }
+    };
+
+  }
+
+}
+
+#endif
@@ -31,12 +31,24 @@
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/drop_on_overflow.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/make_shared.hpp>
 
 // needed for attributes::timer()
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <iomanip>
 #include <iostream>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <vector>
 //using namespace std;
 
 
@@ -44,6 +56,12 @@ BOOST_LOG_ATTRIBUTE_KEYWORD(severity, "Severity", Log::Severity)
 //BOOST_LOG_ATTRIBUTE_KEYWORD(scope, "Scope", boost::log::attributes::named_scope::value_type)
 BOOST_LOG_ATTRIBUTE_KEYWORD(timeline, "Timeline", boost::log::attributes::timer::value_type)
 
+static const char * const overflow_map[] = {
+  "drop",
+  "block",
+  "count"
+};
+
 static const char * const severity_map[] = {
   "FTL",
   "ERR",
@@ -63,6 +81,100 @@ namespace Log {
     return o;
   }
 
+  Overflow to_overflow(const std::string &s)
+  {
+    for (unsigned i = 0; i < sizeof(overflow_map)/sizeof(overflow_map[0]); ++i)
+      if (s == overflow_map[i])
+        return static_cast<Overflow>(i);
+    throw std::runtime_error("Unknown log overflow policy: " + s
+        + " (expected: drop, block or count)");
+  }
+
+  static bool     async_    {false};
+  static Overflow overflow_ {Overflow::BLOCK};
+  static std::atomic<size_t> dropped_ {0};
+  // set up before any session thread is started
+  static std::vector<boost::shared_ptr<boost::log::sinks::sink> > async_sinks_;
+  static std::vector<std::function<void(void)> > stop_fns_;
+
+  // like drop_on_overflow, but counts the dropped records
+  class Count_On_Overflow {
+    public:
+      template <typename Lock>
+      static bool on_overflow(boost::log::record_view const &, Lock &)
+      {
+        ++dropped_;
+        return false;
+      }
+      static void on_queue_space_available() {}
+      static void interrupt() {}
+      static void reset() {}
+  };
+
+  template <typename Strategy, typename Backend, typename Formatter>
+  static void add_async(const boost::shared_ptr<Backend> &backend,
+      const Formatter &formatter, Severity severity_threshold)
+  {
+    using Sink = boost::log::sinks::asynchronous_sink<Backend,
+          boost::log::sinks::bounded_fifo_queue<queue_size, Strategy> >;
+    // starts the logging thread
+    auto sink = boost::make_shared<Sink>(backend);
+    sink->set_formatter(formatter);
+    sink->set_filter(severity <= severity_threshold);
+    boost::log::core::get()->add_sink(sink);
+    async_sinks_.push_back(sink);
+    stop_fns_.push_back([sink]() {
+        boost::log::core::get()->remove_sink(sink);
+        sink->stop();
+        sink->flush();
+        });
+  }
+  template <typename Backend, typename Formatter>
+  static void add_async(const boost::shared_ptr<Backend> &backend,
+      const Formatter &formatter, Severity severity_threshold)
+  {
+    using namespace boost::log::sinks;
+    switch (overflow_) {
+      case Overflow::DROP:
+        add_async<drop_on_overflow>(backend, formatter, severity_threshold);
+        break;
+      case Overflow::BLOCK:
+        add_async<block_on_overflow>(backend, formatter, severity_threshold);
+        break;
+      case Overflow::COUNT:
+        add_async<Count_On_Overflow>(backend, formatter, severity_threshold);
+        break;
+    }
+  }
+
+  void setup_async(Overflow overflow)
+  {
+    async_    = true;
+    overflow_ = overflow;
+  }
+  void flush()
+  {
+    for (auto &sink : async_sinks_)
+      sink->flush();
+    size_t n = dropped_.exchange(0);
+    if (n) {
+      boost::log::sources::severity_logger<Severity> lg;
+      BOOST_LOG_SEV(lg, WARN) << "Dropped " << n
+        << " log records because of a full queue";
+      for (auto &sink : async_sinks_)
+        sink->flush();
+    }
+  }
+  void stop()
+  {
+    flush();
+    for (auto &fn : stop_fns_)
+      fn();
+    stop_fns_.clear();
+    async_sinks_.clear();
+    async_ = false;
+  }
+
   static void format_console(boost::log::record_view const& rec,
       boost::log::formatting_ostream& strm)
   {
@@ -74,6 +186,14 @@ namespace Log {
 
   static void setup_console(Severity severity_threshold)
   {
+    if (async_) {
+      auto backend = boost::make_shared<
+        boost::log::sinks::text_ostream_backend>();
+      backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog,
+            [](std::ostream *) {}));
+      add_async(backend, &format_console, severity_threshold);
+      return;
+    }
     auto clog = boost::log::add_console_log();
     clog->set_formatter(&format_console);
     clog->set_filter(severity <= severity_threshold);
@@ -82,11 +202,7 @@ namespace Log {
   {
     if (filename.empty())
       return;
-    auto flog = boost::log::add_file_log(
-      boost::log::keywords::file_name = filename
-      //, boost::log::keywords::open_mode = std::ios_base::app | std::ios_base::out
-      );
-    flog->set_formatter(
+    boost::log::formatter formatter =
         boost::log::expressions::stream
         << std::setw(5) << std::setfill('0')
         << boost::log::expressions::attr< unsigned >("LineID")
@@ -98,8 +214,18 @@ namespace Log {
         << boost::log::expressions::format_named_scope("Scope",
           boost::log::keywords::format = "%n@%f:%l")
         << "> "
-        << boost::log::expressions::smessage
-        );
+        << boost::log::expressions::smessage;
+    if (async_) {
+      add_async(boost::make_shared<boost::log::sinks::text_file_backend>(
+            boost::log::keywords::file_name = filename), formatter,
+          severity_threshold);
+      return;
+    }
+    auto flog = boost::log::add_file_log(
+      boost::log::keywords::file_name = filename
+      //, boost::log::keywords::open_mode = std::ios_base::app | std::ios_base::out
+      );
+    flog->set_formatter(formatter);
     flog->set_filter(severity <= severity_threshold);
   }
   void setup_vanilla_file(Severity severity_threshold, const std::string &filename)
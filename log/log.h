@@ -22,6 +22,8 @@
 #define LOG_H
 
 #include <ostream>
+#include <string>
+#include <stddef.h>
 
 #include <boost/log/sources/severity_logger.hpp>
 
@@ -41,11 +43,29 @@ namespace Log {
   };
   std::ostream &operator<<(std::ostream &o, Severity s);
 
+  // what an asynchronous sink does when its queue is full
+  enum class Overflow {
+    DROP,  // discard the record
+    BLOCK, // wait until the logging thread has made room
+    COUNT  // discard it, flush() reports how many were discarded
+  };
+  Overflow to_overflow(const std::string &s);
+
   boost::log::sources::severity_logger< Severity > 
     create(Severity severity, Severity file_severity,
         const std::string &logfile = std::string());
   void setup_file(Severity severity_threshold, const std::string &filename);
   void setup_vanilla_file(Severity severity_threshold, const std::string &filename);
+
+  // The sinks that are set up afterwards queue the records (up to
+  // queue_size) and a dedicated thread per sink formats and writes them.
+  void setup_async(Overflow overflow);
+  static const size_t queue_size = 4096;
+  // write all queued records, i.e. blocks until the queues are empty
+  void flush();
+  // flush and stop the logging threads - sinks that are set up
+  // afterwards are synchronous again
+  void stop();
 }
 
 #endif
@@ -24,6 +24,7 @@
 #include <sstream>
 #include <random>
 #include <array>
+#include <atomic>
 #include <exception>
 #include <stdexcept>
 using namespace std;
@@ -94,11 +95,14 @@ void Maildir::add_time(ostream &o)
   o << t;
 }
 
+// process wide, such that concurrent sessions that deliver
+// into the same maildir don't generate the same names
+static atomic<size_t> delivery {0};
+
 void Maildir::add_delivery_id(ostream &o)
 {
   boost::io::ios_flags_saver ifs(o);
-  o << "P" << ::getpid() << "Q" << delivery_ << "R" << hex << g();
-  ++delivery_;
+  o << "P" << ::getpid() << "Q" << delivery++ << "R" << hex << g();
 }
 
 void Maildir::add_hostname(ostream &o)
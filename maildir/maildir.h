@@ -35,7 +35,6 @@ class Maildir {
     int          tmp_dir_fd_   {-1};
     int          new_dir_fd_   {-1};
     int          cur_dir_fd_   {-1};
-    size_t       delivery_     {0};
     std::mt19937 g;
 
     void add_time       (std::ostream &o);
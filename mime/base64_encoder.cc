@@ -0,0 +1,97 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "base64_encoder.h"
+
+#include <stdint.h>
+
+namespace MIME {
+  namespace Base64 {
+
+    static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    static size_t encoded_length(size_t n)
+    {
+      return (n + 2) / 3 * 4;
+    }
+
+    void encode(const char *begin, const char *end, std::string &out,
+        size_t line_length, bool crlf)
+    {
+      const unsigned char *p = reinterpret_cast<const unsigned char*>(begin);
+      const unsigned char *pe = reinterpret_cast<const unsigned char*>(end);
+      size_t e = encoded_length(pe - p);
+      // line lengths that aren't a multiple of 4 are rounded down
+      size_t quads_per_line = line_length / 4;
+      size_t lines = quads_per_line ? (e / 4 + quads_per_line - 1) / quads_per_line
+                                    : 0;
+      size_t off = out.size();
+      // write into a presized string instead of appending char by char
+      out.resize(off + e + (crlf ? 2 : 1) * lines);
+      char *o = &out[0] + off;
+      size_t quads = 0;
+      for (; pe - p >= 3; p += 3) {
+        uint32_t v = uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2];
+        *o++ = alphabet[ v >> 18        ];
+        *o++ = alphabet[(v >> 12) & 0x3f];
+        *o++ = alphabet[(v >>  6) & 0x3f];
+        *o++ = alphabet[ v        & 0x3f];
+        if (++quads == quads_per_line) {
+          if (crlf)
+            *o++ = '\r';
+          *o++ = '\n';
+          quads = 0;
+        }
+      }
+      if (p != pe) {
+        uint32_t v = uint32_t(p[0]) << 16;
+        if (pe - p == 2)
+          v |= uint32_t(p[1]) << 8;
+        *o++ = alphabet[ v >> 18        ];
+        *o++ = alphabet[(v >> 12) & 0x3f];
+        *o++ = pe - p == 2 ? alphabet[(v >> 6) & 0x3f] : '=';
+        *o++ = '=';
+        ++quads;
+      }
+      if (quads && quads_per_line) {
+        if (crlf)
+          *o++ = '\r';
+        *o++ = '\n';
+      }
+    }
+
+    size_t line_length(size_t decoded_size, size_t encoded_size)
+    {
+      size_t e = encoded_length(decoded_size);
+      if (!e || encoded_size <= e || (encoded_size - e) % 2)
+        return 76;
+      size_t lines = (encoded_size - e) / 2;
+      size_t quads = e / 4;
+      size_t quads_per_line = (quads + lines - 1) / lines;
+      if ((76 / 4 + quads - 1) / (76 / 4) == lines)
+        return 76;
+      if ((quads + quads_per_line - 1) / quads_per_line == lines)
+        return quads_per_line * 4;
+      return 76;
+    }
+
+  }
+}
@@ -0,0 +1,44 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef MIME_BASE64_ENCODER_H
+#define MIME_BASE64_ENCODER_H
+
+#include <string>
+#include <stddef.h>
+
+namespace MIME {
+  namespace Base64 {
+
+    // Appends the base64 encoding of [begin, end) to out. With a non-zero
+    // line_length every line (including the last one) is terminated
+    // with CRLF (or just LF), as in a MIME body part.
+    void encode(const char *begin, const char *end, std::string &out,
+        size_t line_length = 76, bool crlf = true);
+
+    // Guesses the line length the sender used, given the size of the decoded
+    // content and the size of the encoded body part (e.g. from BODYSTRUCTURE).
+    // Returns 76 if no line length reproduces encoded_size.
+    size_t line_length(size_t decoded_size, size_t encoded_size);
+
+  }
+}
+
+#endif
@@ -22,6 +22,7 @@
 
 #include <exception.h>
 #include <utility>
+#include <algorithm>
 
 #include <boost/log/sources/record_ostream.hpp>
 
@@ -36,7 +37,7 @@ namespace Net {
       :
         io_service_(io_service),
         opts_(opts),
-        input_(4 * 1024),
+        input_(opts_.min_input_size),
         lg_(lg),
         trace_writer_(opts_.tracefile)
     {
@@ -52,8 +53,32 @@ namespace Net {
     {
       return input_;
     }
+    void Base::adapt_input()
+    {
+      size_t n = input_.size();
+      if (last_read_ == n && n < opts_.max_input_size) {
+        small_reads_ = 0;
+        n = std::min(2 * n, opts_.max_input_size);
+      } else if (last_read_ < n / 4 && n > opts_.min_input_size) {
+        // i.e. less than 1/4 of the buffer used by 8 reads in a row
+        if (++small_reads_ < 8)
+          return;
+        small_reads_ = 0;
+        n = std::max(n / 2, opts_.min_input_size);
+      } else {
+        small_reads_ = 0;
+        return;
+      }
+      if (n == input_.size())
+        return;
+      BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Resizing receive buffer from "
+        << input_.size() << " to " << n << " bytes";
+      // no need to copy the old content
+      vector<char>(n).swap(input_);
+    }
     void Base::log_read(size_t size)
     {
+      last_read_ = size;
       bytes_read_ += size;
       trace_writer_.push(Trace::Type::RECEIVED, input_, size);
       if (opts_.severity < Log::DEBUG && opts_.file_severity < Log::DEBUG)
@@ -64,13 +89,25 @@ namespace Net {
     }
     void Base::log_write()
     {
-      trace_writer_.push(Trace::Type::SENT, write_queue_.front());
       if (opts_.severity < Log::DEBUG && opts_.file_severity < Log::DEBUG)
         return;
-      BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Schedule " << write_queue_.front().size()
-        << " bytes to write to host";
-      string s(write_queue_.front().data(), write_queue_.front().size());
-      BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Schedule write |" << s << "|";
+      for (size_t i = 0; i < write_count_; ++i) {
+        const vector<char> &v = write_queue_[i];
+        BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Schedule " << v.size()
+          << " bytes to write to host";
+        string s(v.data(), v.size());
+        BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Schedule write |" << s << "|";
+      }
+    }
+    // size might be less than the scheduled bytes if the write failed
+    void Base::log_written(size_t size)
+    {
+      bytes_written_ += size;
+      for (size_t i = 0; i < write_count_ && size; ++i) {
+        const vector<char> &v = write_queue_[i];
+        trace_writer_.push(Trace::Type::SENT, v, size);
+        size -= std::min(size, v.size());
+      }
     }
     void Base::log_shutdown()
     {
@@ -80,12 +117,12 @@ namespace Net {
     {
       bool write_in_progress = !write_queue_.empty();
       if (write_free_stack_.empty()) {
-        write_queue_.push(std::move(v));
+        write_queue_.push_back(std::move(v));
       } else {
         vector<char> t(std::move(write_free_stack_.top()));
         write_free_stack_.pop();
         std::swap(v, t);
-        write_queue_.push(std::move(t));
+        write_queue_.push_back(std::move(t));
       }
       if (!write_in_progress)
         do_write();
@@ -95,19 +132,29 @@ namespace Net {
       if (write_queue_.empty())
         THROW_LOGIC_MSG("do_write() called with empty queue");
 
+      // everything that is queued goes into one gather write
+      write_count_ = write_queue_.size();
+      write_buffers_.clear();
+      for (auto &v : write_queue_)
+        write_buffers_.push_back(boost::asio::buffer(v));
       log_write();
-      async_write(write_queue_.front(), [this](
+      async_write(write_buffers_, [this](
           const boost::system::error_code &ec, size_t size
             )
           {
+            log_written(size);
             if (ec) {
               THROW_ERROR(ec);
             } else {
-              bytes_written_ += size;
               BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Wrote " << size << " bytes.";
-              write_free_stack_.push(std::move(write_queue_.front()));
-              write_free_stack_.top().clear();
-              write_queue_.pop();
+              for (; write_count_; --write_count_) {
+                write_free_stack_.push(std::move(write_queue_.front()));
+                write_free_stack_.top().clear();
+                write_queue_.pop_front();
+              }
+              // pushed while the write was in progress
+              if (!write_queue_.empty())
+                do_write();
             }
           });
     }
@@ -23,15 +23,18 @@
 
 #include <log/log.h>
 #include <trace/trace.h>
+#include <net/handler_memory.h>
 
 #include <functional>
+#include <memory>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <stack>
 #include <string>
 #include <stddef.h>
 
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/buffer.hpp>
 namespace boost { namespace asio { class io_service; } }
 namespace boost { namespace system { class error_code; } }
 
@@ -44,6 +47,16 @@ namespace Net {
         unsigned file_severity {0};
 
         std::string tracefile;
+
+        // the receive buffer grows while reads fill it completely
+        // and shrinks after a series of small reads
+        size_t   min_input_size {4 * 1024};
+        size_t   max_input_size {256 * 1024};
+        // how many bytes a client may read via read_some() after a
+        // completed async_read_some(), 0 means no draining;
+        // over TLS without kTLS only the records that were already
+        // received are drained
+        size_t   drain_size     {1024 * 1024};
     };
 
     class Base {
@@ -51,11 +64,24 @@ namespace Net {
         boost::asio::io_service       &io_service_;
         const Options                 &opts_;
         std::vector<char>              input_;
+        size_t                         last_read_   {0};
+        unsigned                       small_reads_ {0};
         std::stack<std::vector<char> > write_free_stack_;
-        std::queue<std::vector<char> > write_queue_;
+        // the first write_count_ buffers are currently written
+        std::deque<std::vector<char> > write_queue_;
+        size_t                         write_count_ {0};
+        std::vector<boost::asio::const_buffer> write_buffers_;
+        // at most one read and one write are in progress
+        std::shared_ptr<Handler_Memory> read_memory_
+          {std::make_shared<Handler_Memory>()};
+        std::shared_ptr<Handler_Memory> write_memory_
+          {std::make_shared<Handler_Memory>()};
 
         void log_read(size_t size);
+        // call before each read, i.e. when input_ isn't referenced anymore
+        void adapt_input();
         void log_write();
+        void log_written(size_t size);
         void log_shutdown();
       protected:
         size_t bytes_read_    {0};
@@ -104,8 +130,14 @@ namespace Net {
         virtual void async_handshake(Handshake_Fn fn) = 0;
 
         virtual void async_read_some(Read_Fn fn) = 0;
+        // non-blocking read into input(), i.e. sets ec to would_block
+        // if no data is available
+        virtual size_t read_some(boost::system::error_code &ec) = 0;
         virtual void async_write(const char *c, size_t size, Write_Fn fn) = 0;
         virtual void async_write(const std::vector<char> &v, Write_Fn fn) = 0;
+        // gather write, the buffers have to stay valid until fn is called
+        virtual void async_write(
+            const std::vector<boost::asio::const_buffer> &bs, Write_Fn fn) = 0;
         virtual void async_shutdown(Shutdown_Fn fn) = 0;
 
         virtual void cancel() = 0;
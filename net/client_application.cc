@@ -45,13 +45,29 @@ namespace Net {
     }
     void Application::async_start(std::function<void(void)> fn)
     {
-      async_resolve(fn);
+      async_resolve([fn](const boost::system::error_code &ec) {
+            if (ec)
+              THROW_ERROR(ec);
+            fn();
+          });
     }
     void Application::async_finish(std::function<void(void)> fn)
+    {
+      async_quit([fn](const boost::system::error_code &ec) {
+            if (ec)
+              THROW_ERROR(ec);
+            fn();
+          });
+    }
+    void Application::async_open(Error_Fn fn)
+    {
+      async_resolve(fn);
+    }
+    void Application::async_close(Error_Fn fn)
     {
       async_quit(fn);
     }
-    void Application::async_resolve(std::function<void(void)> fn)
+    void Application::async_resolve(Error_Fn fn)
     {
       BOOST_LOG_FUNCTION();
       BOOST_LOG(lg_) << "Resolving " << host_ << "...";
@@ -60,7 +76,7 @@ namespace Net {
           {
             BOOST_LOG_FUNCTION();
             if (ec) {
-              THROW_ERROR(ec);
+              fn(ec);
             } else {
               BOOST_LOG(lg_) << host_ << " resolved.";
               async_connect(iterator, fn);
@@ -69,7 +85,7 @@ namespace Net {
     }
 
     void Application::async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
-        std::function<void(void)> fn)
+        Error_Fn fn)
     {
       BOOST_LOG_FUNCTION();
       BOOST_LOG(lg_) << "Connecting to " << host_ << "...";
@@ -77,7 +93,7 @@ namespace Net {
           {
             BOOST_LOG_FUNCTION();
             if (ec) {
-              THROW_ERROR(ec);
+              fn(ec);
             } else {
               BOOST_LOG(lg_) << host_ << " connected.";
               async_handshake(fn);
@@ -85,7 +101,7 @@ namespace Net {
           });
     }
 
-    void Application::async_handshake(std::function<void(void)> fn)
+    void Application::async_handshake(Error_Fn fn)
     {
       BOOST_LOG_FUNCTION();
       BOOST_LOG(lg_) << "Shaking hands with " << host_ << "...";
@@ -93,15 +109,15 @@ namespace Net {
           {
             BOOST_LOG_FUNCTION();
             if (ec) {
-              THROW_ERROR(ec);
+              fn(ec);
             } else {
               BOOST_LOG(lg_) << "Handshake completed.";
-              fn();
+              fn(ec);
             }
           });
     }
 
-    void Application::async_quit(std::function<void(void)> fn)
+    void Application::async_quit(Error_Fn fn)
     {
       BOOST_LOG_FUNCTION();
       BOOST_LOG_SEV(lg_, Log::DEBUG) << "async_quit()";
@@ -109,7 +125,7 @@ namespace Net {
       async_shutdown(fn);
     }
 
-    void Application::async_shutdown(std::function<void(void)> fn)
+    void Application::async_shutdown(Error_Fn fn)
     {
       BOOST_LOG_FUNCTION();
       client_.async_shutdown([this, fn](
@@ -143,12 +159,14 @@ namespace Net {
                     << " reason " << ERR_GET_REASON(ec.value());
                 }
                 BOOST_LOG_SEV(lg_, Log::DEBUG) << "do_shutdown() fail: " << ec.message();
-                THROW_ERROR(ec);
+                client_.close();
+                fn(ec);
+                return;
               }
             } else {
             }
             client_.close();
-            fn();
+            fn(boost::system::error_code());
           });
     }
 
@@ -29,32 +29,40 @@
 #include <log/log.h>
 
 namespace Net { namespace Client { class Base; } }
+namespace boost { namespace system { class error_code; } }
 
 namespace Net {
 
   namespace Client {
 
     class Application {
+      public:
+        using Error_Fn = std::function<void(const boost::system::error_code &ec)>;
       private:
         const std::string                                     &host_;
         Net::Client::Base                                     &client_;
         boost::log::sources::severity_logger< Log::Severity > &lg_;
 
-        void async_resolve(std::function<void(void)> fn);
+        void async_resolve(Error_Fn fn);
         void async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
-            std::function<void(void)> fn);
-        void async_handshake(std::function<void(void)> fn);
+            Error_Fn fn);
+        void async_handshake(Error_Fn fn);
 
-        void async_quit(std::function<void(void)> fn);
-        void async_shutdown(std::function<void(void)> fn);
+        void async_quit(Error_Fn fn);
+        void async_shutdown(Error_Fn fn);
       public:
         Application(
             const std::string &host,
             Net::Client::Base &client,
             boost::log::sources::severity_logger<Log::Severity> &lg
             );
+        // errors are thrown
         void async_start (std::function<void(void)> fn);
         void async_finish(std::function<void(void)> fn);
+        // errors are passed to fn instead, e.g. for a connection that
+        // is opened ahead of time
+        void async_open  (Error_Fn fn);
+        void async_close (Error_Fn fn);
     };
 
   }
@@ -0,0 +1,327 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "client_pool.h"
+
+#include <net/client.h>
+#include <exception.h>
+
+#include <algorithm>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+
+using namespace std;
+
+namespace Net {
+
+  namespace Client {
+
+    Connection::Connection(const std::string &key, const std::string &host,
+        std::unique_ptr<Base> &&client,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+      :
+        key_(key),
+        host_(host),
+        client_(std::move(client)),
+        app_(host_, *client_, lg),
+        timer_(client_->io_service())
+    {
+    }
+    const std::string &Connection::key() const
+    {
+      return key_;
+    }
+    Base &Connection::client()
+    {
+      return *client_;
+    }
+    bool Connection::authenticated() const
+    {
+      return authenticated_;
+    }
+    void Connection::set_authenticated(bool b)
+    {
+      authenticated_ = b;
+    }
+
+
+    Pool::Pool(boost::asio::io_service &io_service,
+        boost::log::sources::severity_logger<Log::Severity> &lg,
+        std::chrono::milliseconds keepalive_interval)
+      :
+        io_service_(io_service),
+        lg_(lg),
+        keepalive_interval_(keepalive_interval)
+    {
+    }
+
+    void Pool::set_login(Session_Fn fn)
+    {
+      login_fn_ = std::move(fn);
+    }
+    void Pool::set_keepalive(Session_Fn fn)
+    {
+      keepalive_fn_ = std::move(fn);
+    }
+    void Pool::set_logout(Session_Fn fn)
+    {
+      logout_fn_ = std::move(fn);
+    }
+
+    std::shared_ptr<Connection> Pool::find(const Connection &c) const
+    {
+      auto i = std::find_if(connections_.begin(), connections_.end(),
+          [&c](const shared_ptr<Connection> &x) { return x.get() == &c; });
+      if (i == connections_.end())
+        THROW_LOGIC_MSG("connection isn't part of the pool");
+      return *i;
+    }
+
+    std::shared_ptr<Connection> Pool::create(const std::string &key,
+        const std::string &host, const Factory &factory)
+    {
+      auto c = make_shared<Connection>(key, host, factory(), lg_);
+      connections_.push_back(c);
+      return c;
+    }
+
+    void Pool::open(const std::string &key, const std::string &host,
+        const Factory &factory, Acquire_Fn fn)
+    {
+      auto c = create(key, host, factory);
+      c->state_ = Connection::State::ACQUIRED;
+      c->app_.async_start([c, fn]() { fn(*c); });
+    }
+
+    void Pool::async_acquire(const std::string &key, const std::string &host,
+        const Factory &factory, Acquire_Fn fn)
+    {
+      BOOST_LOG_FUNCTION();
+      if (closing_)
+        THROW_LOGIC_MSG("acquiring a connection of a closing pool");
+      for (auto &c : connections_) {
+        if (c->key_ != key || c->waiter_)
+          continue;
+        switch (c->state_) {
+          case Connection::State::IDLE:
+            // i.e. the timer handler doesn't start a keepalive
+            c->timer_.cancel();
+            hand_over(c, [fn](Connection *c) { fn(*c); });
+            return;
+          case Connection::State::OPENING:
+          case Connection::State::KEEPING:
+            BOOST_LOG_SEV(lg_, Log::DEBUG) << "Waiting for the connection to "
+              << c->host_ << " ...";
+            c->waiter_ = [this, key, host, factory, fn](Connection *c) {
+              if (c)
+                fn(*c);
+              else
+                open(key, host, factory, fn);
+            };
+            return;
+          default:
+            ;
+        }
+      }
+      open(key, host, factory, fn);
+    }
+
+    void Pool::prepare(const std::string &key, const std::string &host,
+        const Factory &factory)
+    {
+      BOOST_LOG_FUNCTION();
+      if (closing_ || has(key))
+        return;
+      auto c = create(key, host, factory);
+      BOOST_LOG(lg_) << "Opening a spare connection to " << host << " ...";
+      c->app_.async_open([this, c](const boost::system::error_code &ec) {
+          if (ec) {
+            BOOST_LOG_SEV(lg_, Log::WARN) << "Spare connection to "
+              << c->host_ << " failed: " << ec.message();
+            settle(c, false);
+            return;
+          }
+          if (!login_fn_) {
+            settle(c, true);
+            return;
+          }
+          login_fn_(*c, [this, c](bool ok) {
+              c->authenticated_ = ok;
+              settle(c, ok);
+            });
+        });
+    }
+
+    void Pool::hand_over(std::shared_ptr<Connection> c,
+        std::function<void(Connection *c)> fn)
+    {
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Reusing the connection to " << c->host_;
+      c->state_ = Connection::State::ACQUIRED;
+      // i.e. not from within the handler that completed the keepalive
+      io_service_.post([c, fn]() { fn(c.get()); });
+    }
+
+    void Pool::settle(std::shared_ptr<Connection> c, bool ok)
+    {
+      auto waiter = std::move(c->waiter_);
+      c->waiter_ = nullptr;
+      if (!ok) {
+        drop(c);
+        if (waiter)
+          waiter(nullptr);
+        return;
+      }
+      if (waiter)
+        hand_over(c, std::move(waiter));
+      else
+        make_idle(c);
+    }
+
+    void Pool::make_idle(std::shared_ptr<Connection> c)
+    {
+      c->state_ = Connection::State::IDLE;
+      if (closing_) {
+        do_close(c);
+        return;
+      }
+      if (!keepalive_fn_ || !keepalive_interval_.count())
+        return;
+      c->timer_.expires_from_now(keepalive_interval_);
+      c->timer_.async_wait([this, c](const boost::system::error_code &ec) {
+          // i.e. cancelled or acquired in the meantime
+          if (ec || c->state_ != Connection::State::IDLE)
+            return;
+          do_keepalive(c);
+        });
+    }
+
+    void Pool::do_keepalive(std::shared_ptr<Connection> c)
+    {
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Keeping the connection to "
+        << c->host_ << " alive";
+      c->state_ = Connection::State::KEEPING;
+      keepalive_fn_(*c, [this, c](bool ok) {
+          if (!ok)
+            BOOST_LOG_SEV(lg_, Log::WARN) << "Idle connection to "
+              << c->host_ << " is gone";
+          settle(c, ok);
+        });
+    }
+
+    void Pool::release(Connection &c)
+    {
+      auto x = find(c);
+      if (!c.client_->is_open()) {
+        drop(x);
+        return;
+      }
+      make_idle(x);
+    }
+
+    void Pool::discard(Connection &c)
+    {
+      drop(find(c));
+    }
+
+    void Pool::drop(std::shared_ptr<Connection> c)
+    {
+      connections_.erase(std::remove(connections_.begin(), connections_.end(), c),
+          connections_.end());
+      c->timer_.cancel();
+      if (c->client_->is_open())
+        c->client_->close();
+      // the cancelled handlers (that are already queued)
+      // may still reference the connection
+      io_service_.post([c]() {});
+      cond_finish_close();
+    }
+
+    void Pool::do_close(std::shared_ptr<Connection> c)
+    {
+      c->state_ = Connection::State::CLOSING;
+      c->timer_.cancel();
+      auto close_fn = [this, c](bool ok) {
+        if (!ok) {
+          drop(c);
+          return;
+        }
+        c->app_.async_close([this, c](const boost::system::error_code &ec) {
+            if (ec)
+              BOOST_LOG_SEV(lg_, Log::DEBUG) << "Closing the connection to "
+                << c->host_ << " failed: " << ec.message();
+            drop(c);
+          });
+      };
+      if (logout_fn_)
+        logout_fn_(*c, close_fn);
+      else
+        close_fn(true);
+    }
+
+    bool Pool::has(const std::string &key) const
+    {
+      return std::any_of(connections_.begin(), connections_.end(),
+          [&key](const shared_ptr<Connection> &c) {
+            return c->key_ == key && !c->waiter_
+              && (   c->state_ == Connection::State::OPENING
+                  || c->state_ == Connection::State::IDLE
+                  || c->state_ == Connection::State::KEEPING);
+          });
+    }
+    size_t Pool::size() const
+    {
+      return connections_.size();
+    }
+
+    void Pool::async_close(std::function<void(void)> fn)
+    {
+      BOOST_LOG_FUNCTION();
+      closing_ = true;
+      close_fn_ = std::move(fn);
+      // do_close() might drop a connection immediately
+      auto cs = connections_;
+      for (auto &c : cs) {
+        switch (c->state_) {
+          case Connection::State::IDLE:
+            do_close(c);
+            break;
+          case Connection::State::ACQUIRED:
+            THROW_LOGIC_MSG("closing a pool with an acquired connection");
+          default:
+            // i.e. closed after the login or keepalive
+            ;
+        }
+      }
+      cond_finish_close();
+    }
+
+    void Pool::cond_finish_close()
+    {
+      if (!closing_ || !connections_.empty() || !close_fn_)
+        return;
+      auto fn = std::move(close_fn_);
+      close_fn_ = nullptr;
+      io_service_.post(fn);
+    }
+
+  }
+
+}
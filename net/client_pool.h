@@ -0,0 +1,160 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef NET_CLIENT_POOL_H
+#define NET_CLIENT_POOL_H
+
+#include <net/client_application.h>
+#include <log/log.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/steady_timer.hpp>
+
+namespace Net { namespace Client { class Base; } }
+
+namespace Net {
+
+  namespace Client {
+
+    class Pool;
+
+    // A pooled client together with its Application.
+    class Connection {
+      private:
+        friend class Pool;
+        enum class State {
+          OPENING,
+          IDLE,
+          // the keepalive command is running
+          KEEPING,
+          ACQUIRED,
+          CLOSING
+        };
+        // e.g. host, port and user - only connections with the same key
+        // are reused
+        std::string                  key_;
+        std::string                  host_;
+        std::unique_ptr<Base>        client_;
+        Application                  app_;
+        boost::asio::steady_timer    timer_;
+        State                        state_         {State::OPENING};
+        bool                         authenticated_ {false};
+        // acquired while it was opened or kept alive,
+        // called with nullptr if that failed
+        std::function<void(Connection *c)> waiter_;
+      public:
+        Connection(const std::string &key, const std::string &host,
+            std::unique_ptr<Base> &&client,
+            boost::log::sources::severity_logger<Log::Severity> &lg);
+
+        const std::string &key() const;
+        Base &client();
+        // i.e. the protocol session is already logged in
+        bool authenticated() const;
+        void set_authenticated(bool b);
+    };
+
+    // Keeps established connections above Net::Client::Application,
+    // such that a session can be reused by the next task with the same
+    // key - i.e. connect, handshake and login are done only once.
+    //
+    // The protocol specific parts are callbacks that run on connections
+    // nobody has acquired: login (of a connection that is opened ahead
+    // of time via prepare()), keepalive (each keepalive interval on an
+    // idle connection, e.g. an IMAP NOOP) and logout (when the pool is
+    // closed). They report with fn(false) that the connection is
+    // unusable, which is then dropped.
+    //
+    // Errors while opening an acquired connection are thrown as usual,
+    // errors of prepared connections just drop them. All handlers
+    // capture this, i.e. the pool has to outlive its io_service run.
+    class Pool {
+      public:
+        using Factory    = std::function<std::unique_ptr<Base>(void)>;
+        using Acquire_Fn = std::function<void(Connection &c)>;
+        using Done_Fn    = std::function<void(bool ok)>;
+        using Session_Fn = std::function<void(Connection &c, Done_Fn fn)>;
+      private:
+        boost::asio::io_service                              &io_service_;
+        boost::log::sources::severity_logger<Log::Severity> &lg_;
+        // zero disables the keepalive
+        std::chrono::milliseconds                             keepalive_interval_;
+        Session_Fn                                            login_fn_;
+        Session_Fn                                            keepalive_fn_;
+        Session_Fn                                            logout_fn_;
+        std::vector<std::shared_ptr<Connection> >             connections_;
+        std::function<void(void)>                             close_fn_;
+        bool                                                  closing_ {false};
+
+        std::shared_ptr<Connection> find(const Connection &c) const;
+        std::shared_ptr<Connection> create(const std::string &key,
+            const std::string &host, const Factory &factory);
+        void open(const std::string &key, const std::string &host,
+            const Factory &factory, Acquire_Fn fn);
+        void hand_over(std::shared_ptr<Connection> c,
+            std::function<void(Connection *c)> fn);
+        // after the login or keepalive of c completed
+        void settle(std::shared_ptr<Connection> c, bool ok);
+        void make_idle(std::shared_ptr<Connection> c);
+        void do_keepalive(std::shared_ptr<Connection> c);
+        void do_close(std::shared_ptr<Connection> c);
+        void drop(std::shared_ptr<Connection> c);
+        void cond_finish_close();
+      public:
+        Pool(boost::asio::io_service &io_service,
+            boost::log::sources::severity_logger<Log::Severity> &lg,
+            std::chrono::milliseconds keepalive_interval);
+
+        void set_login    (Session_Fn fn);
+        void set_keepalive(Session_Fn fn);
+        void set_logout   (Session_Fn fn);
+
+        // an idle (or prepared) connection with key, otherwise a new one
+        // is created via factory and established - fn is called after
+        // the handshake
+        void async_acquire(const std::string &key, const std::string &host,
+            const Factory &factory, Acquire_Fn fn);
+        // opens a spare connection ahead of time, i.e. including the login,
+        // unless there is already one with key
+        void prepare(const std::string &key, const std::string &host,
+            const Factory &factory);
+        // c becomes idle, i.e. it's kept alive until it's acquired again
+        void release(Connection &c);
+        // e.g. after the session was logged out, closes c
+        void discard(Connection &c);
+
+        // i.e. an idle or prepared connection with key
+        bool has(const std::string &key) const;
+        size_t size() const;
+
+        // logs out and closes all connections, none may be acquired
+        void async_close(std::function<void(void)> fn);
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,244 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "connector.h"
+
+#include "socket_options.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+#include <boost/log/sources/record_ostream.hpp>
+
+using namespace std;
+namespace asio = boost::asio;
+
+namespace Net {
+
+  namespace TCP {
+
+    static mutex winners_mutex;
+    static map<string, asio::ip::tcp::endpoint> &winners()
+    {
+      static map<string, asio::ip::tcp::endpoint> m;
+      return m;
+    }
+
+    Connector::Connector(asio::io_service &io_service,
+        asio::ip::tcp::socket &socket,
+        const Client::Options &opts,
+        boost::log::sources::severity_logger<Log::Severity> &lg,
+        Connect_Fn fn)
+      :
+        io_service_(io_service),
+        socket_(socket),
+        opts_(opts),
+        lg_(lg),
+        key_(opts.host + ' ' + opts.service),
+        delay_timer_(io_service),
+        timeout_timer_(io_service),
+        fn_(std::move(fn))
+    {
+    }
+
+    void Connector::async_connect(asio::io_service &io_service,
+        asio::ip::tcp::socket &socket,
+        asio::ip::tcp::resolver::iterator iterator,
+        const Client::Options &opts,
+        boost::log::sources::severity_logger<Log::Severity> &lg,
+        Connect_Fn fn)
+    {
+      Endpoints endpoints;
+      for (asio::ip::tcp::resolver::iterator end; iterator != end; ++iterator)
+        endpoints.push_back(iterator->endpoint());
+      auto c = make_shared<Connector>(io_service, socket, opts, lg, std::move(fn));
+      c->async_connect(endpoints);
+    }
+
+    void Connector::async_connect(const Endpoints &endpoints)
+    {
+      Endpoints v(endpoints);
+      if (!opts_.local_address.empty()) {
+        // only endpoints we are able to bind to
+        bool v4 = asio::ip::address::from_string(opts_.local_address).is_v4();
+        v.erase(remove_if(v.begin(), v.end(),
+              [v4](const asio::ip::tcp::endpoint &e) {
+                return e.address().is_v4() != v4; }), v.end());
+      }
+      endpoints_ = order(v, key_, opts_.ip);
+      // i.e. reverse order for pop_back()
+      reverse(endpoints_.begin(), endpoints_.end());
+      if (endpoints_.empty()) {
+        auto self = shared_from_this();
+        io_service_.post([self]() {
+            self->finish(asio::error::address_family_not_supported); });
+        return;
+      }
+      if (opts_.connect_timeout) {
+        auto self = shared_from_this();
+        timeout_timer_.expires_from_now(
+            chrono::seconds(opts_.connect_timeout));
+        timeout_timer_.async_wait([self](const boost::system::error_code &ec) {
+            if (ec || self->done_)
+              return;
+            BOOST_LOG_SEV(self->lg_, Log::WARN) << "Connect to "
+              << self->opts_.host << " timed out";
+            self->finish(asio::error::timed_out);
+            });
+      }
+      start_next();
+    }
+
+    void Connector::start_next()
+    {
+      if (done_ || endpoints_.empty())
+        return;
+      auto self = shared_from_this();
+      asio::ip::tcp::endpoint endpoint = endpoints_.back();
+      endpoints_.pop_back();
+
+      attempts_.emplace_back(new asio::ip::tcp::socket(io_service_));
+      asio::ip::tcp::socket &socket = *attempts_.back();
+      ++pending_;
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Connecting to " << endpoint << " ...";
+      boost::system::error_code ec;
+      socket.open(endpoint.protocol(), ec);
+      if (!ec) {
+        apply_socket_options(socket, opts_, lg_);
+        if (!opts_.local_address.empty())
+          socket.bind(asio::ip::tcp::endpoint(
+                asio::ip::address::from_string(opts_.local_address),
+                opts_.local_port), ec);
+      }
+      if (ec) {
+        io_service_.post([self, &socket, endpoint, ec]() {
+            --self->pending_;
+            self->failed(socket, endpoint, ec);
+            });
+        return;
+      }
+      socket.async_connect(endpoint, [self, &socket, endpoint](
+            const boost::system::error_code &ec) {
+          --self->pending_;
+          if (self->done_)
+            return;
+          if (!ec) {
+            self->socket_ = std::move(socket);
+            remember(self->key_, endpoint);
+            BOOST_LOG(self->lg_) << "Connected to " << endpoint;
+            log_socket_options(self->socket_, self->lg_);
+            self->finish(ec);
+            return;
+          }
+          self->failed(socket, endpoint, ec);
+          });
+
+      if (!endpoints_.empty()) {
+        delay_timer_.expires_from_now(
+            chrono::milliseconds(opts_.connect_delay));
+        delay_timer_.async_wait([self](const boost::system::error_code &ec) {
+            if (!ec)
+              self->start_next();
+            });
+      }
+    }
+
+    void Connector::failed(asio::ip::tcp::socket &socket,
+        const asio::ip::tcp::endpoint &endpoint,
+        const boost::system::error_code &ec)
+    {
+      if (done_)
+        return;
+      boost::system::error_code ignored;
+      socket.close(ignored);
+      ec_ = ec;
+      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Connect to " << endpoint
+        << " failed: " << ec.message();
+      // don't wait for the delay
+      delay_timer_.cancel();
+      start_next();
+      if (!pending_ && endpoints_.empty())
+        finish(ec_);
+    }
+
+    void Connector::finish(const boost::system::error_code &ec)
+    {
+      if (done_)
+        return;
+      done_ = true;
+      delay_timer_.cancel();
+      timeout_timer_.cancel();
+      for (auto &socket : attempts_) {
+        boost::system::error_code ignored;
+        socket->close(ignored);
+      }
+      fn_(ec);
+    }
+
+    Connector::Endpoints Connector::order(const Endpoints &endpoints,
+        const std::string &key, unsigned ip)
+    {
+      Endpoints r;
+      r.reserve(endpoints.size());
+      {
+        lock_guard<mutex> lock(winners_mutex);
+        auto i = winners().find(key);
+        if (i != winners().end()
+            && find(endpoints.begin(), endpoints.end(), i->second)
+               != endpoints.end())
+          r.push_back(i->second);
+      }
+      bool v4 = r.empty() ? ip != 6 : r.front().address().is_v4();
+      Endpoints a, b;
+      for (auto &e : endpoints) {
+        if (!r.empty() && e == r.front())
+          continue;
+        (e.address().is_v4() == v4 ? a : b).push_back(e);
+      }
+      if (!r.empty())
+        // i.e. the other family comes next
+        swap(a, b);
+      for (size_t i = 0; i < max(a.size(), b.size()); ++i) {
+        if (i < a.size())
+          r.push_back(a[i]);
+        if (i < b.size())
+          r.push_back(b[i]);
+      }
+      return r;
+    }
+
+    void Connector::remember(const std::string &key,
+        const asio::ip::tcp::endpoint &endpoint)
+    {
+      lock_guard<mutex> lock(winners_mutex);
+      winners()[key] = endpoint;
+    }
+
+    void Connector::forget()
+    {
+      lock_guard<mutex> lock(winners_mutex);
+      winners().clear();
+    }
+
+  }
+
+}
@@ -0,0 +1,103 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef NET_CONNECTOR_H
+#define NET_CONNECTOR_H
+
+#include <net/tcp_client.h>
+
+#include <log/log.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace Net {
+
+  namespace TCP {
+
+    // Happy Eyeballs (RFC 8305) style connect: the endpoints are tried
+    // with alternating address families, the next attempt is started
+    // after opts.connect_delay or as soon as the previous one failed.
+    // The first established connection wins and is moved into the
+    // target socket, the other attempts are closed.
+    //
+    // The winning endpoint is remembered per host/service, i.e. a
+    // reconnect of the same process tries it first.
+    class Connector : public std::enable_shared_from_this<Connector> {
+      public:
+        using Endpoints = std::vector<boost::asio::ip::tcp::endpoint>;
+        using Connect_Fn = std::function<void(
+            const boost::system::error_code &ec)>;
+      private:
+        boost::asio::io_service                                    &io_service_;
+        boost::asio::ip::tcp::socket                               &socket_;
+        const Client::Options                                      &opts_;
+        boost::log::sources::severity_logger<Log::Severity>        &lg_;
+        std::string                                                 key_;
+        Endpoints                                                   endpoints_;
+        std::vector<std::unique_ptr<boost::asio::ip::tcp::socket> > attempts_;
+        size_t                                                      pending_ {0};
+        bool                                                        done_    {false};
+        boost::system::error_code                                   ec_;
+        boost::asio::steady_timer                                   delay_timer_;
+        boost::asio::steady_timer                                   timeout_timer_;
+        Connect_Fn                                                  fn_;
+
+        void start_next();
+        void failed(boost::asio::ip::tcp::socket &socket,
+            const boost::asio::ip::tcp::endpoint &endpoint,
+            const boost::system::error_code &ec);
+        void finish(const boost::system::error_code &ec);
+      public:
+        Connector(boost::asio::io_service &io_service,
+            boost::asio::ip::tcp::socket &socket,
+            const Client::Options &opts,
+            boost::log::sources::severity_logger<Log::Severity> &lg,
+            Connect_Fn fn);
+        // has to be called on a shared_ptr, fn is called exactly once
+        void async_connect(const Endpoints &endpoints);
+
+        static void async_connect(boost::asio::io_service &io_service,
+            boost::asio::ip::tcp::socket &socket,
+            boost::asio::ip::tcp::resolver::iterator iterator,
+            const Client::Options &opts,
+            boost::log::sources::severity_logger<Log::Severity> &lg,
+            Connect_Fn fn);
+
+        // the remembered winner first, then alternating address families,
+        // starting with ip (4 or 6)
+        static Endpoints order(const Endpoints &endpoints,
+            const std::string &key, unsigned ip);
+        static void remember(const std::string &key,
+            const boost::asio::ip::tcp::endpoint &endpoint);
+        static void forget();
+    };
+
+  }
+
+}
+
+#endif
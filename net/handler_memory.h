@@ -0,0 +1,160 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef NET_HANDLER_MEMORY_H
+#define NET_HANDLER_MEMORY_H
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stddef.h>
+
+#include <boost/version.hpp>
+
+namespace Net {
+
+  // Recycled memory for the operation that ASIO allocates for each
+  // asynchronous call, i.e. one block for a chain of operations where
+  // the next one is started from the completion of the previous one
+  // (ASIO frees an operation before it calls its handler). If the block
+  // is in use or too small, it falls back to the heap.
+  //
+  // The handlers share the ownership, since an aborted operation may
+  // be destroyed by the io_service after the owner of the memory.
+  class Handler_Memory {
+    private:
+      typename std::aligned_storage<1024>::type storage_;
+      bool in_use_ {false};
+    public:
+      Handler_Memory() =default;
+      Handler_Memory(const Handler_Memory &) =delete;
+      Handler_Memory &operator=(const Handler_Memory &) =delete;
+
+      void *allocate(size_t size)
+      {
+        if (!in_use_ && size <= sizeof storage_) {
+          in_use_ = true;
+          return &storage_;
+        }
+        return ::operator new(size);
+      }
+      void deallocate(void *p)
+      {
+        if (p == &storage_)
+          in_use_ = false;
+        else
+          ::operator delete(p);
+      }
+      bool in_use() const
+      {
+        return in_use_;
+      }
+  };
+
+  // for the associated_allocator of newer ASIO versions
+  template <typename T>
+  class Handler_Allocator {
+    private:
+      template <typename U> friend class Handler_Allocator;
+      std::shared_ptr<Handler_Memory> memory_;
+    public:
+      using value_type = T;
+
+      explicit Handler_Allocator(std::shared_ptr<Handler_Memory> memory)
+        :
+          memory_(std::move(memory))
+      {
+      }
+      template <typename U>
+      Handler_Allocator(const Handler_Allocator<U> &other)
+        :
+          memory_(other.memory_)
+      {
+      }
+      T *allocate(size_t n)
+      {
+        return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+      }
+      void deallocate(T *p, size_t)
+      {
+        memory_->deallocate(p);
+      }
+      template <typename U>
+      bool operator==(const Handler_Allocator<U> &other) const
+      {
+        return memory_ == other.memory_;
+      }
+      template <typename U>
+      bool operator!=(const Handler_Allocator<U> &other) const
+      {
+        return memory_ != other.memory_;
+      }
+  };
+
+  // wraps a completion handler such that ASIO allocates its
+  // operation from the memory
+  template <typename Handler>
+  class Alloc_Handler {
+    private:
+      std::shared_ptr<Handler_Memory> memory_;
+      Handler                         handler_;
+    public:
+      using allocator_type = Handler_Allocator<Handler>;
+
+      Alloc_Handler(std::shared_ptr<Handler_Memory> memory, Handler handler)
+        :
+          memory_(std::move(memory)),
+          handler_(std::move(handler))
+      {
+      }
+      allocator_type get_allocator() const
+      {
+        return allocator_type(memory_);
+      }
+      template <typename... Args>
+      void operator()(Args&&... args)
+      {
+        handler_(std::forward<Args>(args)...);
+      }
+#if BOOST_VERSION < 106600
+      friend void *asio_handler_allocate(size_t size, Alloc_Handler *h)
+      {
+        return h->memory_->allocate(size);
+      }
+      friend void asio_handler_deallocate(void *p, size_t, Alloc_Handler *h)
+      {
+        h->memory_->deallocate(p);
+      }
+#endif
+  };
+
+  template <typename Handler>
+  Alloc_Handler<typename std::decay<Handler>::type>
+    make_alloc_handler(const std::shared_ptr<Handler_Memory> &memory,
+        Handler &&handler)
+  {
+    return Alloc_Handler<typename std::decay<Handler>::type>(memory,
+        std::forward<Handler>(handler));
+  }
+
+}
+
+#endif
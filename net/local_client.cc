@@ -0,0 +1,391 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "local_client.h"
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+using namespace std;
+namespace asio = boost::asio;
+
+namespace Net {
+
+  namespace Pipe {
+
+    Reaper::Reaper(boost::asio::io_service &io_service, pid_t pid,
+        boost::log::sources::severity_logger<Log::Severity> &lg,
+        std::chrono::milliseconds grace)
+      :
+        pid_(pid),
+        timer_(io_service),
+        grace_(grace),
+        lg_(lg)
+    {
+    }
+    Reaper::~Reaper()
+    {
+      if (!pid_)
+        return;
+      BOOST_LOG_SEV(lg_, Log::WARN) << "Killing tunnel command " << pid_;
+      kill(pid_, SIGKILL);
+      int status = 0;
+      if (waitpid(pid_, &status, 0) > 0)
+        log_status(status);
+    }
+    void Reaper::async_reap()
+    {
+      start_ = chrono::steady_clock::now();
+      poll();
+    }
+    bool Reaper::try_wait()
+    {
+      int status = 0;
+      pid_t r = waitpid(pid_, &status, WNOHANG);
+      if (!r)
+        return false;
+      if (r > 0)
+        log_status(status);
+      pid_ = 0;
+      return true;
+    }
+    void Reaper::poll()
+    {
+      if (try_wait())
+        return;
+      // the command should exit after reading EOF
+      auto waited = chrono::steady_clock::now() - start_;
+      if (!signal_ && waited >= grace_) {
+        BOOST_LOG_SEV(lg_, Log::WARN) << "Terminating tunnel command "
+          << pid_;
+        signal_ = SIGTERM;
+        kill(pid_, signal_);
+      } else if (signal_ == SIGTERM && waited >= 2 * grace_) {
+        BOOST_LOG_SEV(lg_, Log::WARN) << "Killing tunnel command " << pid_;
+        signal_ = SIGKILL;
+        kill(pid_, signal_);
+      }
+      timer_.expires_from_now(chrono::milliseconds(20));
+      auto self = shared_from_this();
+      timer_.async_wait([self](const boost::system::error_code &) {
+          self->poll();
+          });
+    }
+    void Reaper::log_status(int status)
+    {
+      if (WIFEXITED(status) && !WEXITSTATUS(status))
+        BOOST_LOG_SEV(lg_, Log::DEBUG) << "Tunnel command exited";
+      else if (WIFEXITED(status))
+        BOOST_LOG_SEV(lg_, Log::WARN) << "Tunnel command exited with "
+          << WEXITSTATUS(status);
+      else if (WIFSIGNALED(status))
+        BOOST_LOG_SEV(lg_, Log::WARN) << "Tunnel command killed by signal "
+          << WTERMSIG(status);
+    }
+
+    namespace Client {
+
+      static boost::system::error_code last_error()
+      {
+        return boost::system::error_code(errno,
+            boost::system::system_category());
+      }
+
+      Base::Base(boost::asio::io_service &io_service,
+          const Net::Client::Options &opts,
+          const std::string &command,
+          boost::log::sources::severity_logger<Log::Severity> &lg
+          )
+        :
+          Net::Client::Base(io_service, opts, lg),
+          command_(command),
+          in_(io_service),
+          out_(io_service)
+      {
+        // otherwise, writing to an exited command kills us
+        signal(SIGPIPE, SIG_IGN);
+      }
+      Base::~Base()
+      {
+        boost::system::error_code ec;
+        in_.close(ec);
+        out_.close(ec);
+        reap();
+      }
+
+      void Base::spawn()
+      {
+        // [0] is the read end
+        int to_child[2];
+        int from_child[2];
+        if (pipe(to_child))
+          throw boost::system::system_error(last_error(), "pipe");
+        if (pipe(from_child)) {
+          boost::system::error_code ec(last_error());
+          ::close(to_child[0]);
+          ::close(to_child[1]);
+          throw boost::system::system_error(ec, "pipe");
+        }
+        for (int fd : { to_child[0], to_child[1], from_child[0], from_child[1] })
+          fcntl(fd, F_SETFD, FD_CLOEXEC);
+        // dup2() clears FD_CLOEXEC on the new descriptors
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, to_child[0], 0);
+        posix_spawn_file_actions_adddup2(&actions, from_child[1], 1);
+        const char *argv[] = { "/bin/sh", "-c", command_.c_str(), nullptr };
+        int r = posix_spawn(&pid_, "/bin/sh", &actions, nullptr,
+            const_cast<char * const *>(argv), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(to_child[0]);
+        ::close(from_child[1]);
+        if (r) {
+          pid_ = 0;
+          ::close(to_child[1]);
+          ::close(from_child[0]);
+          throw boost::system::system_error(boost::system::error_code(r,
+                boost::system::system_category()), "posix_spawn");
+        }
+        in_.assign(from_child[0]);
+        out_.assign(to_child[1]);
+      }
+      void Base::reap()
+      {
+        if (!pid_)
+          return;
+        make_shared<Reaper>(io_service_, pid_, lg_)->async_reap();
+        pid_ = 0;
+      }
+
+      void Base::async_resolve(Resolve_Fn fn)
+      {
+        io_service_.post([fn]() {
+            fn(boost::system::error_code(),
+              asio::ip::tcp::resolver::iterator());
+            });
+      }
+      void Base::async_resolve(const boost::asio::ip::tcp::resolver::query &,
+          Resolve_Fn fn)
+      {
+        async_resolve(fn);
+      }
+      void Base::async_connect(boost::asio::ip::tcp::resolver::iterator,
+          Connect_Fn fn)
+      {
+        BOOST_LOG(lg_) << "Executing tunnel: " << command_;
+        boost::system::error_code ec;
+        try {
+          spawn();
+        } catch (const boost::system::system_error &e) {
+          ec = e.code();
+        }
+        io_service_.post([fn, ec]() { fn(ec); });
+      }
+      void Base::async_handshake(Handshake_Fn fn)
+      {
+        boost::system::error_code ec;
+        fn(ec);
+      }
+      void Base::async_read_some(Read_Fn fn)
+      {
+        adapt_input();
+        in_.async_read_some(asio::buffer(input_),
+            make_alloc_handler(read_memory_, [this, fn](
+            const boost::system::error_code &ec,
+            size_t size)
+          {
+            if (!ec)
+              log_read(size);
+            fn(ec, size);
+          }));
+      }
+      size_t Base::read_some(boost::system::error_code &ec)
+      {
+        if (!in_.non_blocking())
+          in_.non_blocking(true, ec);
+        if (ec)
+          return 0;
+        adapt_input();
+        size_t size = in_.read_some(asio::buffer(input_), ec);
+        if (!ec)
+          log_read(size);
+        return size;
+      }
+      void Base::async_write(const char *c, size_t size, Write_Fn fn)
+      {
+        asio::async_write(out_, asio::buffer(c, size),
+            make_alloc_handler(write_memory_, fn));
+      }
+      void Base::async_write(const std::vector<char> &v, Write_Fn fn)
+      {
+        asio::async_write(out_, asio::buffer(v),
+            make_alloc_handler(write_memory_, fn));
+      }
+      void Base::async_write(const std::vector<asio::const_buffer> &bs,
+          Write_Fn fn)
+      {
+        asio::async_write(out_, bs,
+            make_alloc_handler(write_memory_, fn));
+      }
+      void Base::async_shutdown(Shutdown_Fn fn)
+      {
+        log_shutdown();
+        // i.e. the command reads EOF
+        boost::system::error_code ec;
+        out_.close(ec);
+        fn(ec);
+      }
+      void Base::cancel()
+      {
+        boost::system::error_code ec;
+        in_.cancel(ec);
+        out_.cancel(ec);
+      }
+      void Base::close()
+      {
+        boost::system::error_code ec;
+        in_.close(ec);
+        out_.close(ec);
+        reap();
+      }
+      bool Base::is_open() const
+      {
+        return in_.is_open();
+      }
+
+    }
+
+  }
+
+  namespace Local {
+
+    namespace Client {
+
+      Base::Base(boost::asio::io_service &io_service,
+          const Net::Client::Options &opts,
+          const std::string &path,
+          boost::log::sources::severity_logger<Log::Severity> &lg
+          )
+        :
+          Net::Client::Base(io_service, opts, lg),
+          path_(path),
+          socket_(io_service)
+      {
+      }
+
+      void Base::async_resolve(Resolve_Fn fn)
+      {
+        io_service_.post([fn]() {
+            fn(boost::system::error_code(),
+              asio::ip::tcp::resolver::iterator());
+            });
+      }
+      void Base::async_resolve(const boost::asio::ip::tcp::resolver::query &,
+          Resolve_Fn fn)
+      {
+        async_resolve(fn);
+      }
+      void Base::async_connect(boost::asio::ip::tcp::resolver::iterator,
+          Connect_Fn fn)
+      {
+        BOOST_LOG(lg_) << "Connecting to " << path_;
+        socket_.async_connect(asio::local::stream_protocol::endpoint(path_), fn);
+      }
+      void Base::async_handshake(Handshake_Fn fn)
+      {
+        boost::system::error_code ec;
+        fn(ec);
+      }
+      void Base::async_read_some(Read_Fn fn)
+      {
+        adapt_input();
+        socket_.async_read_some(asio::buffer(input_),
+            make_alloc_handler(read_memory_, [this, fn](
+            const boost::system::error_code &ec,
+            size_t size)
+          {
+            if (!ec)
+              log_read(size);
+            fn(ec, size);
+          }));
+      }
+      size_t Base::read_some(boost::system::error_code &ec)
+      {
+        if (!socket_.non_blocking())
+          socket_.non_blocking(true, ec);
+        if (ec)
+          return 0;
+        adapt_input();
+        size_t size = socket_.read_some(asio::buffer(input_), ec);
+        if (!ec)
+          log_read(size);
+        return size;
+      }
+      void Base::async_write(const char *c, size_t size, Write_Fn fn)
+      {
+        asio::async_write(socket_, asio::buffer(c, size),
+            make_alloc_handler(write_memory_, fn));
+      }
+      void Base::async_write(const std::vector<char> &v, Write_Fn fn)
+      {
+        asio::async_write(socket_, asio::buffer(v),
+            make_alloc_handler(write_memory_, fn));
+      }
+      void Base::async_write(const std::vector<asio::const_buffer> &bs,
+          Write_Fn fn)
+      {
+        asio::async_write(socket_, bs,
+            make_alloc_handler(write_memory_, fn));
+      }
+      void Base::async_shutdown(Shutdown_Fn fn)
+      {
+        log_shutdown();
+        boost::system::error_code ec;
+        fn(ec);
+      }
+      void Base::cancel()
+      {
+        socket_.cancel();
+      }
+      void Base::close()
+      {
+        socket_.close();
+      }
+      bool Base::is_open() const
+      {
+        return socket_.is_open();
+      }
+
+    }
+
+  }
+
+}
@@ -0,0 +1,164 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef NET_LOCAL_CLIENT_H
+#define NET_LOCAL_CLIENT_H
+
+#include <net/client.h>
+
+#include <log/log.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <sys/types.h>
+
+// Clients for servers that are reached without TCP/TLS, e.g. on the same
+// host - thus, the resolve/handshake steps are no-ops and the connect
+// step starts the command or connects to the socket.
+
+namespace Net {
+
+  namespace Pipe {
+
+    // Waits for a command without blocking the io_service, i.e. it polls
+    // waitpid() on a timer. A command that hasn't exited after grace gets
+    // a SIGTERM, after another grace period a SIGKILL.
+    class Reaper : public std::enable_shared_from_this<Reaper> {
+      private:
+        pid_t                                                pid_;
+        boost::asio::steady_timer                            timer_;
+        std::chrono::milliseconds                            grace_;
+        boost::log::sources::severity_logger<Log::Severity> &lg_;
+        std::chrono::steady_clock::time_point                start_;
+        int                                                  signal_ {0};
+
+        bool try_wait();
+        void poll();
+        void log_status(int status);
+      public:
+        Reaper(boost::asio::io_service &io_service, pid_t pid,
+            boost::log::sources::severity_logger<Log::Severity> &lg,
+            std::chrono::milliseconds grace = std::chrono::seconds(1));
+        // i.e. when the io_service is destroyed before the command
+        // exited, it's killed and waited for
+        ~Reaper();
+        // has to be called on a shared_ptr
+        void async_reap();
+    };
+
+    namespace Client {
+
+      // talks to stdin/stdout of a command that is executed via /bin/sh,
+      // e.g. 'ssh host /usr/libexec/dovecot/imap' - such a server usually
+      // sends a PREAUTH greeting
+      class Base : public Net::Client::Base {
+        private:
+          std::string                              command_;
+          // the command's stdout
+          boost::asio::posix::stream_descriptor    in_;
+          // the command's stdin
+          boost::asio::posix::stream_descriptor    out_;
+          pid_t                                    pid_ {0};
+
+          void spawn();
+          void reap();
+        public:
+          void async_resolve(Resolve_Fn fn) override;
+          void async_resolve(const boost::asio::ip::tcp::resolver::query &query,
+              Resolve_Fn fn) override;
+          void async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
+              Connect_Fn fn) override;
+          void async_handshake(Handshake_Fn fn) override;
+          void async_read_some(Read_Fn fn) override;
+          size_t read_some(boost::system::error_code &ec) override;
+          void async_write(const char *c, size_t size, Write_Fn fn) override;
+          void async_write(const std::vector<char> &v, Write_Fn fn) override;
+          void async_write(const std::vector<boost::asio::const_buffer> &bs,
+              Write_Fn fn) override;
+          void async_shutdown(Shutdown_Fn fn) override;
+
+          void cancel() override;
+          void close() override;
+          bool is_open() const override;
+
+        public:
+          Base(boost::asio::io_service &io_service,
+              const Net::Client::Options &opts,
+              const std::string &command,
+              boost::log::sources::severity_logger<Log::Severity> &lg
+              );
+          ~Base();
+      };
+
+    }
+
+  }
+
+  namespace Local {
+
+    namespace Client {
+
+      // connects to a Unix domain socket
+      class Base : public Net::Client::Base {
+        private:
+          std::string                                  path_;
+          boost::asio::local::stream_protocol::socket  socket_;
+
+        public:
+          void async_resolve(Resolve_Fn fn) override;
+          void async_resolve(const boost::asio::ip::tcp::resolver::query &query,
+              Resolve_Fn fn) override;
+          void async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
+              Connect_Fn fn) override;
+          void async_handshake(Handshake_Fn fn) override;
+          void async_read_some(Read_Fn fn) override;
+          size_t read_some(boost::system::error_code &ec) override;
+          void async_write(const char *c, size_t size, Write_Fn fn) override;
+          void async_write(const std::vector<char> &v, Write_Fn fn) override;
+          void async_write(const std::vector<boost::asio::const_buffer> &bs,
+              Write_Fn fn) override;
+          void async_shutdown(Shutdown_Fn fn) override;
+
+          void cancel() override;
+          void close() override;
+          bool is_open() const override;
+
+        public:
+          Base(boost::asio::io_service &io_service,
+              const Net::Client::Options &opts,
+              const std::string &path,
+              boost::log::sources::severity_logger<Log::Severity> &lg
+              );
+      };
+
+    }
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "session_cache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/algorithm/hex.hpp>
+#include <boost/filesystem.hpp>
+
+#include <ixxx/ixxx.h>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace Net {
+
+  namespace SSL {
+
+    Session_Cache::Session_Cache(const std::string &filename, unsigned ttl)
+      :
+        filename_(filename),
+        ttl_(ttl)
+    {
+      read();
+    }
+
+    // line format: expires hex-der key
+    // a missing or corrupt file just means that there are no sessions
+    void Session_Cache::read()
+    {
+      ifstream f(filename_, ifstream::in | ifstream::binary);
+      if (!f)
+        return;
+      time_t now = time(nullptr);
+      string line;
+      while (getline(f, line)) {
+        istringstream l(line);
+        Entry e;
+        string hex, key;
+        if (!(l >> e.expires >> hex))
+          continue;
+        l.get();
+        if (!getline(l, key))
+          continue;
+        if (e.expires <= now || key.empty())
+          continue;
+        try {
+          boost::algorithm::unhex(hex, back_inserter(e.der));
+        } catch (const std::exception &) {
+          continue;
+        }
+        entries_[key] = std::move(e);
+      }
+    }
+    void Session_Cache::write() const
+    {
+      ostringstream o;
+      for (auto &i : entries_) {
+        o << i.second.expires << ' ';
+        boost::algorithm::hex(i.second.der, ostream_iterator<char>(o));
+        o << ' ' << i.first << '\n';
+      }
+      string s(o.str());
+
+      string tmp(filename_ + ".tmp");
+      // e.g. left over by a crash
+      ::unlink(tmp.c_str());
+      // the sessions contain the master secrets, i.e. the file must not
+      // be readable by others - not even for a moment
+      int fd = ixxx::posix::open(tmp, O_CREAT | O_EXCL | O_WRONLY, 0600);
+      const char *p = s.data();
+      const char *e = p + s.size();
+      while (p != e) {
+        ssize_t r = ::write(fd, p, e - p);
+        if (r == -1) {
+          if (errno == EINTR)
+            continue;
+          int err = errno;
+          ::close(fd);
+          throw system_error(err, system_category(), "write session cache");
+        }
+        p += r;
+      }
+      ixxx::posix::close(fd);
+      fs::rename(tmp, filename_);
+    }
+
+    SSL_SESSION *Session_Cache::get(const std::string &key) const
+    {
+      auto i = entries_.find(key);
+      if (i == entries_.end() || i->second.expires <= time(nullptr))
+        return nullptr;
+      const unsigned char *p =
+        reinterpret_cast<const unsigned char*>(i->second.der.data());
+      return d2i_SSL_SESSION(nullptr, &p, i->second.der.size());
+    }
+    void Session_Cache::put(const std::string &key, SSL_SESSION *session)
+    {
+      if (key.find('\n') != string::npos)
+        throw logic_error("session cache key must not contain a newline");
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+      if (!SSL_SESSION_is_resumable(session))
+        return;
+#endif
+      int n = i2d_SSL_SESSION(session, nullptr);
+      if (n <= 0)
+        throw runtime_error("Could not serialize TLS session");
+      Entry e;
+      e.der.resize(n);
+      unsigned char *p = reinterpret_cast<unsigned char*>(&e.der[0]);
+      i2d_SSL_SESSION(session, &p);
+      time_t now = time(nullptr);
+      e.expires = std::min<time_t>(now + ttl_,
+          SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session));
+      if (e.expires <= now)
+        return;
+      entries_[key] = std::move(e);
+      write();
+    }
+
+  }
+
+}
@@ -0,0 +1,68 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef NET_SESSION_CACHE_H
+#define NET_SESSION_CACHE_H
+
+#include <map>
+#include <string>
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+namespace Net {
+
+  namespace SSL {
+
+    // Persists TLS sessions (i.e. also TLS 1.3 session tickets) in a
+    // small text file, such that the next process can resume the
+    // session instead of doing a full handshake.
+    //
+    // The key should include everything the session was verified
+    // against (e.g. host, port, certificate host, fingerprint and
+    // CA file/path).
+    class Session_Cache {
+      private:
+        struct Entry {
+          time_t      expires {0};
+          std::string der;
+        };
+        std::string                   filename_;
+        unsigned                      ttl_;
+        std::map<std::string, Entry>  entries_;
+
+        void read();
+        void write() const;
+      public:
+        // ttl in seconds, a session also expires with its server side timeout
+        Session_Cache(const std::string &filename, unsigned ttl);
+
+        // nullptr if there is no unexpired session,
+        // otherwise the caller has to SSL_SESSION_free() it
+        SSL_SESSION *get(const std::string &key) const;
+        // updates the file, throws on errors
+        void put(const std::string &key, SSL_SESSION *session);
+    };
+
+  }
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "socket_options.h"
+
+#include <boost/asio/socket_base.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <errno.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+using namespace std;
+namespace asio = boost::asio;
+
+namespace Net {
+
+  namespace TCP {
+
+    template <typename Option>
+      static void set(asio::ip::tcp::socket &socket, const Option &option,
+          const char *name,
+          boost::log::sources::severity_logger<Log::Severity> &lg)
+      {
+        boost::system::error_code ec;
+        socket.set_option(option, ec);
+        if (ec)
+          BOOST_LOG_SEV(lg, Log::WARN) << "Could not set " << name << ": "
+            << ec.message();
+      }
+
+    // i.e. setsockopt() takes an int
+    static int int_value(unsigned v)
+    {
+      return int(min<unsigned>(v, unsigned(numeric_limits<int>::max())));
+    }
+
+#if !defined(TCP_KEEPIDLE) || !defined(TCP_QUICKACK) \
+    || !defined(TCP_CONGESTION)
+    static void unsupported(const char *name,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+    {
+      BOOST_LOG_SEV(lg, Log::WARN) << name << " isn't supported on this system";
+    }
+#endif
+
+    void apply_socket_options(asio::ip::tcp::socket &socket,
+        const Client::Options &opts,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+    {
+      if (opts.rcvbuf)
+        set(socket, asio::socket_base::receive_buffer_size(
+              int_value(opts.rcvbuf)), "SO_RCVBUF", lg);
+      if (opts.sndbuf)
+        set(socket, asio::socket_base::send_buffer_size(
+              int_value(opts.sndbuf)), "SO_SNDBUF", lg);
+      if (opts.nodelay)
+        set(socket, asio::ip::tcp::no_delay(true), "TCP_NODELAY", lg);
+      if (opts.keepalive_idle) {
+        set(socket, asio::socket_base::keep_alive(true), "SO_KEEPALIVE", lg);
+#ifdef TCP_KEEPIDLE
+        set(socket, Integer_Option<IPPROTO_TCP, TCP_KEEPIDLE>(
+              int_value(opts.keepalive_idle)), "TCP_KEEPIDLE", lg);
+        if (opts.keepalive_interval)
+          set(socket, Integer_Option<IPPROTO_TCP, TCP_KEEPINTVL>(
+                int_value(opts.keepalive_interval)), "TCP_KEEPINTVL", lg);
+        if (opts.keepalive_count)
+          set(socket, Integer_Option<IPPROTO_TCP, TCP_KEEPCNT>(
+                int_value(opts.keepalive_count)), "TCP_KEEPCNT", lg);
+#else
+        unsupported("TCP_KEEPIDLE", lg);
+#endif
+      }
+      if (opts.quickack) {
+#ifdef TCP_QUICKACK
+        // the kernel may leave the quickack mode again, later
+        set(socket, Integer_Option<IPPROTO_TCP, TCP_QUICKACK>(1),
+            "TCP_QUICKACK", lg);
+#else
+        unsupported("TCP_QUICKACK", lg);
+#endif
+      }
+      if (!opts.congestion.empty()) {
+#ifdef TCP_CONGESTION
+        if (setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_CONGESTION,
+              opts.congestion.data(), opts.congestion.size()))
+          BOOST_LOG_SEV(lg, Log::WARN) << "Could not set TCP_CONGESTION to "
+            << opts.congestion << ": "
+            << boost::system::error_code(errno,
+                boost::system::system_category()).message();
+#else
+        unsupported("TCP_CONGESTION", lg);
+#endif
+      }
+    }
+
+    void log_socket_options(asio::ip::tcp::socket &socket,
+        boost::log::sources::severity_logger<Log::Severity> &lg)
+    {
+      // ignoring errors, i.e. unavailable values are just 0
+      boost::system::error_code ec;
+      asio::socket_base::receive_buffer_size rcvbuf;
+      socket.get_option(rcvbuf, ec);
+      asio::socket_base::send_buffer_size sndbuf;
+      socket.get_option(sndbuf, ec);
+      asio::ip::tcp::no_delay nodelay;
+      socket.get_option(nodelay, ec);
+      asio::socket_base::keep_alive keepalive;
+      socket.get_option(keepalive, ec);
+      ostringstream o;
+      o << "Socket options: SO_RCVBUF " << rcvbuf.value()
+        << ", SO_SNDBUF " << sndbuf.value()
+        << ", TCP_NODELAY " << nodelay.value()
+        << ", SO_KEEPALIVE " << keepalive.value();
+#ifdef TCP_KEEPIDLE
+      if (keepalive.value()) {
+        Integer_Option<IPPROTO_TCP, TCP_KEEPIDLE> idle;
+        socket.get_option(idle, ec);
+        Integer_Option<IPPROTO_TCP, TCP_KEEPINTVL> interval;
+        socket.get_option(interval, ec);
+        Integer_Option<IPPROTO_TCP, TCP_KEEPCNT> count;
+        socket.get_option(count, ec);
+        o << " (" << idle.value() << " s/" << interval.value() << " s/"
+          << count.value() << ')';
+      }
+#endif
+#ifdef TCP_QUICKACK
+      Integer_Option<IPPROTO_TCP, TCP_QUICKACK> quickack;
+      socket.get_option(quickack, ec);
+      o << ", TCP_QUICKACK " << quickack.value();
+#endif
+#ifdef TCP_CONGESTION
+      char congestion[16] = {0};
+      socklen_t n = sizeof congestion - 1;
+      if (!getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_CONGESTION,
+            congestion, &n))
+        o << ", TCP_CONGESTION " << congestion;
+#endif
+      BOOST_LOG(lg) << o.str();
+    }
+
+  }
+
+}
@@ -0,0 +1,84 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef NET_SOCKET_OPTIONS_H
+#define NET_SOCKET_OPTIONS_H
+
+#include <net/tcp_client.h>
+
+#include <log/log.h>
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include <cstddef>
+#include <stdexcept>
+
+namespace Net {
+
+  namespace TCP {
+
+    // An int valued socket option like TCP_KEEPIDLE that asio doesn't
+    // provide, i.e. it models the GettableSocketOption and
+    // SettableSocketOption concepts.
+    template <int Level, int Name>
+    class Integer_Option {
+      private:
+        int value_ {0};
+      public:
+        Integer_Option() = default;
+        explicit Integer_Option(int value) : value_(value) {}
+
+        int value() const { return value_; }
+
+        template <typename Protocol>
+        int level(const Protocol &) const { return Level; }
+        template <typename Protocol>
+        int name(const Protocol &) const { return Name; }
+        template <typename Protocol>
+        int *data(const Protocol &) { return &value_; }
+        template <typename Protocol>
+        const int *data(const Protocol &) const { return &value_; }
+        template <typename Protocol>
+        size_t size(const Protocol &) const { return sizeof value_; }
+        template <typename Protocol>
+        void resize(const Protocol &, size_t size)
+        {
+          if (size != sizeof value_)
+            throw std::length_error("Unexpected socket option size");
+        }
+    };
+
+    // Sets the tuning options on an open socket, i.e. before the connect,
+    // such that the buffer sizes are already used for the window scaling.
+    // Failures (e.g. an unavailable congestion control algorithm)
+    // are only logged as warnings.
+    void apply_socket_options(boost::asio::ip::tcp::socket &socket,
+        const Client::Options &opts,
+        boost::log::sources::severity_logger<Log::Severity> &lg);
+
+    // logs the effective values, e.g. Linux doubles SO_RCVBUF
+    void log_socket_options(boost::asio::ip::tcp::socket &socket,
+        boost::log::sources::severity_logger<Log::Severity> &lg);
+
+  }
+
+}
+
+#endif
@@ -22,11 +22,21 @@
 
 #include "ssl_util.h"
 #include "ssl_verification.h"
+#include "session_cache.h"
+#include "connector.h"
 #include "exception.h"
+#include "config.h"
 
 #include <boost/asio/ssl.hpp>
 #include <boost/log/sources/record_ostream.hpp>
 
+#include <openssl/err.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <errno.h>
+
 using namespace std;
 namespace asio = boost::asio;
 
@@ -35,88 +45,123 @@ namespace Net {
 
   namespace TCP {
 
+    static asio::ip::tcp::socket &lowest(asio::ip::tcp::socket &s)
+    {
+      return s;
+    }
+    static asio::ip::tcp::socket &lowest(
+        asio::ssl::stream<asio::ip::tcp::socket> &s)
+    {
+      return s.next_layer();
+    }
+
+    template <typename Stream>
+    asio::ip::tcp::socket &Stream_Client<Stream>::socket()
+    {
+      return lowest(stream_);
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::async_resolve(Resolve_Fn fn)
+    {
+      asio::ip::tcp::resolver::query query(opts_.host, opts_.service);
+      async_resolve(query, fn);
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::async_resolve(
+        const boost::asio::ip::tcp::resolver::query &query, Resolve_Fn fn)
+    {
+      resolver_.async_resolve(query, fn);
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::async_connect(
+        boost::asio::ip::tcp::resolver::iterator iterator, Connect_Fn fn)
+    {
+      Connector::async_connect(io_service_, socket(), iterator, opts_, lg_, fn);
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::async_read_some(Read_Fn fn)
+    {
+      async_read_some_impl(std::move(fn));
+    }
+    // the socket is only non-blocking during the drain, i.e. it yields
+    // would_block if nothing is available (TLS overrides this,
+    // cf. SSL::Client::Base::read_some())
+    template <typename Stream>
+    size_t Stream_Client<Stream>::read_some(boost::system::error_code &ec)
+    {
+      bool blocking = !socket().non_blocking();
+      if (blocking)
+        socket().non_blocking(true, ec);
+      if (ec)
+        return 0;
+      adapt_input();
+      size_t size = stream_.read_some(asio::buffer(input_), ec);
+      if (!ec)
+        log_read(size);
+      if (blocking) {
+        boost::system::error_code e;
+        socket().non_blocking(false, e);
+      }
+      return size;
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::async_write(const char *c, size_t size,
+        Write_Fn fn)
+    {
+      async_write_impl(asio::buffer(c, size), std::move(fn));
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::async_write(const std::vector<char> &v,
+        Write_Fn fn)
+    {
+      async_write_impl(asio::buffer(v), std::move(fn));
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::async_write(
+        const std::vector<asio::const_buffer> &bs, Write_Fn fn)
+    {
+      async_write_impl(bs, std::move(fn));
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::cancel()
+    {
+      stream_.lowest_layer().cancel();
+    }
+    template <typename Stream>
+    void Stream_Client<Stream>::close()
+    {
+      stream_.lowest_layer().close();
+    }
+    template <typename Stream>
+    bool Stream_Client<Stream>::is_open() const
+    {
+      return stream_.lowest_layer().is_open();
+    }
+
+    template class Stream_Client<asio::ip::tcp::socket>;
+    template class Stream_Client<asio::ssl::stream<asio::ip::tcp::socket> >;
+
     namespace Client {
 
       Base::Base(boost::asio::io_service &io_service, const Options &opts,
           boost::log::sources::severity_logger<Log::Severity> &lg
           )
         :
-          Net::Client::Base(io_service, opts, lg),
-          opts_(opts),
-          socket_(io_service),
-          resolver_(io_service)
+          Stream_Client(io_service, opts, lg, io_service)
       {
       }
 
-      void Base::async_resolve(Resolve_Fn fn)
-      {
-        asio::ip::tcp::resolver::query query(opts_.host, opts_.service);
-        async_resolve(query, fn);
-      }
-      void Base::async_resolve(const boost::asio::ip::tcp::resolver::query &query,
-          Resolve_Fn fn)
-      {
-        resolver_.async_resolve(query, fn);
-      }
-      void Base::async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
-          Connect_Fn fn)
-      {
-        if (!opts_.local_address.empty()) {
-          if (opts_.ip == 4)
-            socket_.open(asio::ip::tcp::v4());
-          else
-            socket_.open(asio::ip::tcp::v6());
-
-          asio::ip::tcp::endpoint local_endpoint(
-              asio::ip::address::from_string(opts_.local_address),
-              opts_.local_port
-              );
-          socket_.bind(local_endpoint);
-        }
-        socket_.async_connect(iterator->endpoint(), fn);
-      }
       void Base::async_handshake(Handshake_Fn fn)
       {
         boost::system::error_code ec;
         fn(ec);
       }
-      void Base::async_read_some(Read_Fn fn)
-      {
-        socket_.async_read_some(asio::buffer(input_), [this, fn](
-            const boost::system::error_code &ec,
-            size_t size)
-          {
-            if (!ec)
-              log_read(size);
-            fn(ec, size);
-          });
-      }
-      void Base::async_write(const char *c, size_t size, Write_Fn fn)
-      {
-        asio::async_write(socket_, asio::buffer(c, size), fn);
-      }
-      void Base::async_write(const std::vector<char> &v, Write_Fn fn)
-      {
-        asio::async_write(socket_, asio::buffer(v), fn);
-      }
       void Base::async_shutdown(Shutdown_Fn fn)
       {
         log_shutdown();
         boost::system::error_code ec;
         fn(ec);
       }
-      void Base::cancel()
-      {
-        socket_.cancel();
-      }
-      void Base::close()
-      {
-        socket_.close();
-      }
-      bool Base::is_open() const
-      {
-        return socket_.is_open();
-      }
 
     }
 
@@ -139,16 +184,23 @@ namespace Net {
           return context;
         }
 
+        // for finding the client object in the new session callback
+        static int ex_index()
+        {
+          static int i = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+              nullptr);
+          return i;
+        }
+
         Base::Base(boost::asio::io_service &io_service,
             boost::asio::ssl::context &context, const Options &opts,
           boost::log::sources::severity_logger<Log::Severity> &lg
             )
           :
-            Net::Client::Base(io_service, opts, lg),
+            Stream_Client(io_service, opts, lg, io_service, opts.apply(context)),
             opts_(opts),
-            context_(opts_.apply(context)),
-            stream_(io_service, context_),
-            resolver_(io_service)
+            context_(context),
+            handshake_timer_(io_service)
         {
           using namespace Net::SSL;
           stream_.set_verify_mode(asio::ssl::verify_peer);
@@ -156,77 +208,311 @@ namespace Net {
               Verification(lg_, opts_.cert_host, opts_.fingerprint));
           if (!opts_.cipher.empty())
             SSL_set_cipher_list(stream_.native_handle(), opts_.cipher.c_str());
+          if (!opts_.session_cache.empty() && opts_.session_ttl) {
+            session_cache_.reset(new Net::SSL::Session_Cache(opts_.session_cache,
+                  opts_.session_ttl));
+            // a session is only resumed for the same verification settings
+            session_key_ = opts_.host + ' ' + opts_.service + ' '
+              + opts_.cert_host + ' ' + opts_.fingerprint + ' '
+              + opts_.ca_file + ' ' + opts_.ca_path;
+            SSL_CTX *ctx = context_.native_handle();
+            SSL_CTX_set_session_cache_mode(ctx,
+                SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(ctx, &Base::new_session);
+            SSL_set_ex_data(stream_.native_handle(), ex_index(), this);
+          }
+          if (opts_.ktls) {
+#if !defined(IMAPDL_USE_KTLS)
+            BOOST_LOG_SEV(lg_, Log::WARN)
+              << "kTLS support wasn't enabled at build time";
+#elif defined(SSL_OP_ENABLE_KTLS)
+            direct_ = true;
+            SSL_set_options(stream_.native_handle(), SSL_OP_ENABLE_KTLS);
+#else
+            BOOST_LOG_SEV(lg_, Log::WARN)
+              << "kTLS isn't supported by this OpenSSL version";
+#endif
+          }
         }
-
-        void Base::async_resolve(Resolve_Fn fn)
+        Base::~Base()
         {
-          asio::ip::tcp::resolver::query query(opts_.host, opts_.service);
-          async_resolve(query, fn);
         }
-        void Base::async_resolve(const boost::asio::ip::tcp::resolver::query &query,
-            Resolve_Fn fn)
+        // i.e. also called for TLS 1.3 tickets that arrive
+        // after the handshake
+        int Base::new_session(::SSL *ssl, SSL_SESSION *session)
         {
-          resolver_.async_resolve(query, fn);
+          Base *b = static_cast<Base*>(SSL_get_ex_data(ssl, ex_index()));
+          if (b)
+            b->store_session(session);
+          // i.e. we don't keep a reference
+          return 0;
         }
-        void Base::async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
-            Connect_Fn fn)
+        void Base::store_session(SSL_SESSION *session)
         {
-          if (!opts_.local_address.empty()) {
-            if (opts_.ip == 4)
-              stream_.lowest_layer().open(asio::ip::tcp::v4());
-            else
-              stream_.lowest_layer().open(asio::ip::tcp::v6());
-
-            asio::ip::tcp::endpoint local_endpoint(
-                asio::ip::address::from_string(opts_.local_address),
-                opts_.local_port
-                );
-            stream_.lowest_layer().bind(local_endpoint);
+          try {
+            session_cache_->put(session_key_, session);
+            BOOST_LOG_SEV(lg_, Log::DEBUG) << "Stored TLS session in "
+              << opts_.session_cache;
+          } catch (const std::exception &e) {
+            BOOST_LOG_SEV(lg_, Log::WARN) << "Could not store TLS session: "
+              << e.what();
           }
-          stream_.lowest_layer().async_connect(iterator->endpoint(), fn);
         }
+
         void Base::async_handshake(Handshake_Fn fn)
         {
           BOOST_LOG_SEV(lg_, Log::DEBUG) << "Handshaking - Cipher list: " << opts_.cipher;
-          stream_.async_handshake(asio::ssl::stream_base::client, fn);
+          if (session_cache_) {
+            SSL_SESSION *session = session_cache_->get(session_key_);
+            if (session) {
+              BOOST_LOG_SEV(lg_, Log::DEBUG) << "Offering cached TLS session";
+              SSL_set_session(stream_.native_handle(), session);
+              SSL_SESSION_free(session);
+            }
+          }
+          if (opts_.handshake_timeout) {
+            handshake_timed_out_ = false;
+            handshake_timer_.expires_from_now(
+                std::chrono::seconds(opts_.handshake_timeout));
+            handshake_timer_.async_wait([this](
+                  const boost::system::error_code &ec) {
+                if (ec)
+                  return;
+                handshake_timed_out_ = true;
+                // i.e. the pending handshake operation is aborted
+                boost::system::error_code ignored;
+                stream_.lowest_layer().cancel(ignored);
+                });
+          }
+          auto done = [this, fn](boost::system::error_code ec)
+              {
+                handshake_timer_.cancel();
+                if (ec && handshake_timed_out_) {
+                  BOOST_LOG_SEV(lg_, Log::WARN) << "Handshake with "
+                    << opts_.host << " timed out";
+                  ec = asio::error::timed_out;
+                }
+                if (!ec) {
+                  BOOST_LOG(lg_) << (SSL_session_reused(stream_.native_handle())
+                      ? "Resumed TLS session" : "Full TLS handshake");
+                  if (direct_)
+                    log_ktls();
+                }
+                fn(ec);
+              };
+          if (!direct_) {
+            stream_.async_handshake(asio::ssl::stream_base::client, done);
+            return;
+          }
+          ::SSL *ssl = stream_.native_handle();
+          auto &socket = stream_.next_layer();
+          boost::system::error_code ec;
+          socket.non_blocking(true, ec);
+          if (!ec && SSL_set_fd(ssl, socket.native_handle()) != 1)
+            ec = direct_error(SSL_ERROR_SSL);
+          if (ec) {
+            io_service_.post([done, ec]() { done(ec); });
+            return;
+          }
+          SSL_set_connect_state(ssl);
+          io_service_.post([this, ssl, done]() {
+              direct_op([ssl]() { return SSL_do_handshake(ssl); },
+                [done](const boost::system::error_code &ec, size_t) {
+                  done(ec);
+                });
+              });
         }
-        void Base::async_read_some(Read_Fn fn)
+        bool Base::ktls_active()
         {
-          stream_.async_read_some(asio::buffer(input_), [this, fn](
-            const boost::system::error_code &ec,
-            size_t size)
-          {
-            if (!ec)
-              log_read(size);
-            fn(ec, size);
-          });
+#ifdef SSL_OP_ENABLE_KTLS
+          return direct_ && BIO_get_ktls_recv(
+              SSL_get_rbio(stream_.native_handle()));
+#else
+          return false;
+#endif
         }
-        void Base::async_write(const char *c, size_t size, Write_Fn fn)
+        void Base::log_ktls()
         {
-          asio::async_write(stream_, asio::buffer(c, size), fn);
+#ifdef SSL_OP_ENABLE_KTLS
+          ::SSL *ssl = stream_.native_handle();
+          bool send = BIO_get_ktls_send(SSL_get_wbio(ssl));
+          bool recv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+          BOOST_LOG(lg_) << "kTLS send: " << (send ? "on" : "off")
+            << ", receive: " << (recv ? "on" : "off");
+          if (!send && !recv)
+            BOOST_LOG_SEV(lg_, Log::WARN) << "kTLS not available (kernel tls "
+              "module/cipher), using the userspace record layer";
+#endif
         }
-        void Base::async_write(const std::vector<char> &v, Write_Fn fn)
+        boost::system::error_code Base::direct_error(int e)
         {
-          asio::async_write(stream_, asio::buffer(v), fn);
+          switch (e) {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+              return asio::error::would_block;
+            case SSL_ERROR_ZERO_RETURN:
+              return asio::error::eof;
+            case SSL_ERROR_SYSCALL:
+              if (ERR_peek_error())
+                break;
+              if (errno)
+                return boost::system::error_code(errno,
+                    boost::system::system_category());
+              // i.e. unexpected EOF with OpenSSL < 3
+              return asio::error::eof;
+            default:
+              ;
+          }
+          unsigned long err = ERR_get_error();
+#if defined(SSL_R_UNEXPECTED_EOF_WHILE_READING) && BOOST_VERSION >= 106300
+          if (ERR_GET_REASON(err) == SSL_R_UNEXPECTED_EOF_WHILE_READING)
+            return asio::ssl::error::stream_truncated;
+#endif
+          return boost::system::error_code(static_cast<int>(err),
+              asio::error::get_ssl_category());
         }
-        void Base::async_shutdown(Shutdown_Fn fn)
+        // completes synchronously if op doesn't have to wait,
+        // i.e. initiating functions have to post the first call
+        void Base::direct_op(std::function<int(void)> op, Direct_Fn fn)
         {
-          log_shutdown();
-          stream_.async_shutdown(fn);
+          ERR_clear_error();
+          errno = 0;
+          int r = op();
+          if (r > 0) {
+            fn(boost::system::error_code(), size_t(r));
+            return;
+          }
+          int e = SSL_get_error(stream_.native_handle(), r);
+          if (e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) {
+            stream_.next_layer().async_wait(e == SSL_ERROR_WANT_READ
+                ? asio::ip::tcp::socket::wait_read
+                : asio::ip::tcp::socket::wait_write,
+                [this, op, fn](const boost::system::error_code &ec) {
+                  if (ec)
+                    fn(ec, 0);
+                  else
+                    direct_op(op, fn);
+                });
+            return;
+          }
+          fn(direct_error(e), 0);
         }
-        void Base::cancel()
+        struct Base::Direct_Write {
+          std::vector<asio::const_buffer> bs;
+          size_t   i      {0};
+          size_t   offset {0};
+          size_t   total  {0};
+          Write_Fn fn;
+        };
+        void Base::direct_write(std::shared_ptr<Direct_Write> w)
         {
-          stream_.lowest_layer().cancel();
+          while (w->i < w->bs.size()
+              && w->offset == asio::buffer_size(w->bs[w->i])) {
+            ++w->i;
+            w->offset = 0;
+          }
+          if (w->i == w->bs.size()) {
+            w->fn(boost::system::error_code(), w->total);
+            return;
+          }
+          ::SSL *ssl = stream_.native_handle();
+          const char *p = asio::buffer_cast<const char*>(w->bs[w->i])
+            + w->offset;
+          int n = int(std::min<size_t>(asio::buffer_size(w->bs[w->i])
+                - w->offset, std::numeric_limits<int>::max()));
+          direct_op([ssl, p, n]() { return SSL_write(ssl, p, n); },
+              [this, w](const boost::system::error_code &ec, size_t size) {
+                if (ec) {
+                  w->fn(ec, w->total);
+                  return;
+                }
+                w->offset += size;
+                w->total  += size;
+                direct_write(w);
+              });
         }
-        void Base::close()
+        void Base::direct_write(const std::vector<asio::const_buffer> &bs,
+            Write_Fn fn)
         {
-          stream_.lowest_layer().close();
+          auto w = std::make_shared<Direct_Write>();
+          w->bs = bs;
+          w->fn = fn;
+          io_service_.post([this, w]() { direct_write(w); });
         }
-        bool Base::is_open() const
+        void Base::direct_read(Read_Fn fn)
         {
-          return stream_.lowest_layer().is_open();
+          adapt_input();
+          io_service_.post([this, fn]() {
+              direct_op([this]() {
+                  return SSL_read(stream_.native_handle(), input_.data(),
+                      int(std::min<size_t>(input_.size(),
+                          std::numeric_limits<int>::max())));
+                },
+                [this, fn](const boost::system::error_code &ec, size_t size) {
+                  if (!ec)
+                    log_read(size);
+                  fn(ec, size);
+                });
+            });
+        }
+        void Base::async_read_some(Read_Fn fn)
+        {
+          async_read_some_impl(std::move(fn));
+        }
+        size_t Base::read_some(boost::system::error_code &ec)
+        {
+          // An async_write() might still be in progress, thus this
+          // bypasses the stream's engine (and its shared output buffer).
+          // Without kTLS, SSL_read() consumes what the engine has already
+          // received (i.e. its memory BIO), with kTLS it reads from the
+          // socket which is already non-blocking (cf. async_handshake()).
+          // Either way, WANT_READ means that nothing is available, yet.
+          ::SSL *ssl = stream_.native_handle();
+          adapt_input();
+          ERR_clear_error();
+          errno = 0;
+          int r = SSL_read(ssl, input_.data(),
+              int(std::min<size_t>(input_.size(),
+                  std::numeric_limits<int>::max())));
+          if (r <= 0) {
+            ec = direct_error(SSL_get_error(ssl, r));
+            return 0;
+          }
+          log_read(r);
+          return r;
+        }
+        void Base::async_write(const char *c, size_t size, Write_Fn fn)
+        {
+          async_write_impl(asio::buffer(c, size), std::move(fn));
+        }
+        void Base::async_write(const std::vector<char> &v, Write_Fn fn)
+        {
+          async_write_impl(asio::buffer(v), std::move(fn));
+        }
+        void Base::async_write(const std::vector<asio::const_buffer> &bs,
+            Write_Fn fn)
+        {
+          async_write_impl(bs, std::move(fn));
+        }
+        void Base::async_shutdown(Shutdown_Fn fn)
+        {
+          log_shutdown();
+          if (direct_) {
+            // just send our close_notify, i.e. don't wait for the peer's
+            io_service_.post([this, fn]() {
+                direct_op([this]() {
+                    int r = SSL_shutdown(stream_.native_handle());
+                    // i.e. 0: close_notify sent, the peer's is pending
+                    return r < 0 ? r : 1;
+                  },
+                  [fn](const boost::system::error_code &ec, size_t) {
+                    fn(ec);
+                  });
+              });
+            return;
+          }
+          stream_.async_shutdown(fn);
         }
-
       }
     }
   }
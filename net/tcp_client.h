@@ -27,10 +27,14 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <utility>
 
+#include <boost/version.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl/stream.hpp>
 namespace boost { namespace asio { namespace ssl { class context; } } }
+namespace Net { namespace SSL { class Session_Cache; } }
 
 namespace Net {
 
@@ -46,33 +50,127 @@ namespace Net {
           std::string    host;
           std::string    service; // or port
 
+          // preferred IP version - the other one is tried in parallel
           unsigned       ip            {4};
 
+          // seconds, 0 means no timeout
+          unsigned       connect_timeout   {30};
+          unsigned       handshake_timeout {30};
+          // milliseconds until the next endpoint is tried, although
+          // the current connect is still in progress
+          unsigned       connect_delay     {250};
+
+          // socket tuning, 0/empty means system default
+          // bytes, setting them disables the kernel's buffer autotuning
+          unsigned       rcvbuf            {0};
+          unsigned       sndbuf            {0};
+          bool           nodelay           {true};
+          // seconds, keepalive is enabled if keepalive_idle is set
+          unsigned       keepalive_idle     {0};
+          unsigned       keepalive_interval {0};
+          unsigned       keepalive_count    {0};
+          bool           quickack          {false};
+          // e.g. cubic or bbr
+          std::string    congestion;
+
       };
 
-      class Base : public Net::Client::Base {
-        private:
-          const Options                 &opts_;
-          boost::asio::ip::tcp::socket   socket_;
-          boost::asio::ip::tcp::resolver resolver_;
+    }
+
+    // Resolve, connect and I/O over a stream policy, i.e. a plain TCP
+    // socket or a TLS stream on top of one.
+    //
+    // The *_impl() members take concrete handlers, i.e. callers that know
+    // the client type don't go through a std::function and ASIO allocates
+    // and invokes the completion handler directly. The virtual
+    // Net::Client::Base members just forward to them. The operations are
+    // allocated from the per-connection read/write memory.
+    //
+    // The *_impl() members are protected, i.e. only the final client
+    // classes publish them - otherwise, a Stream_Client reference to an
+    // SSL client would bypass its kTLS dispatch.
+    template <typename Stream>
+    class Stream_Client : public Net::Client::Base {
+      private:
+        template <typename Handler> struct Read_Op {
+          Stream_Client *client;
+          Handler        handler;
+          void operator()(const boost::system::error_code &ec, size_t size)
+          {
+            if (!ec)
+              client->log_read(size);
+            handler(ec, size);
+          }
+        };
+      protected:
+        const Client::Options          &opts_;
+        Stream                          stream_;
+        boost::asio::ip::tcp::resolver  resolver_;
+
+        // args are passed to the stream constructor
+        template <typename... Args>
+        Stream_Client(boost::asio::io_service &io_service,
+            const Client::Options &opts,
+            boost::log::sources::severity_logger<Log::Severity> &lg,
+            Args&&... args)
+          :
+            Net::Client::Base(io_service, opts, lg),
+            opts_(opts),
+            stream_(std::forward<Args>(args)...),
+            resolver_(io_service)
+        {
+        }
+
+        template <typename Handler>
+        void async_read_some_impl(Handler handler)
+        {
+          adapt_input();
+          stream_.async_read_some(boost::asio::buffer(input_),
+              make_alloc_handler(read_memory_,
+                Read_Op<Handler>{this, std::move(handler)}));
+        }
+        template <typename Buffers, typename Handler>
+        void async_write_impl(const Buffers &bs, Handler handler)
+        {
+          boost::asio::async_write(stream_, bs,
+              make_alloc_handler(write_memory_, std::move(handler)));
+        }
+      public:
+        void async_resolve(Resolve_Fn fn) override;
+
+        void async_resolve(const boost::asio::ip::tcp::resolver::query &query,
+            Resolve_Fn fn) override;
+        void async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
+            Connect_Fn fn) override;
+        void async_read_some(Read_Fn fn) override;
+        size_t read_some(boost::system::error_code &ec) override;
+        void async_write(const char *c, size_t size, Write_Fn fn) override;
+        void async_write(const std::vector<char> &v, Write_Fn fn) override;
+        void async_write(const std::vector<boost::asio::const_buffer> &bs,
+            Write_Fn fn) override;
+
+        void cancel() override;
+        void close() override;
+        bool is_open() const override;
+
+        boost::asio::ip::tcp::socket &socket();
+    };
+
+    // instantiated in tcp_client.cc
+    extern template class Stream_Client<boost::asio::ip::tcp::socket>;
+    extern template class Stream_Client<
+      boost::asio::ssl::stream<boost::asio::ip::tcp::socket> >;
+
+    namespace Client {
 
+      class Base : public Stream_Client<boost::asio::ip::tcp::socket> {
         public:
-          void async_resolve(Resolve_Fn fn) override;
+          using Stream_Client::async_read_some_impl;
+          using Stream_Client::async_write_impl;
 
-          void async_resolve(const boost::asio::ip::tcp::resolver::query &query,
-              Resolve_Fn fn) override;
-          void async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
-              Connect_Fn fn) override;
           void async_handshake(Handshake_Fn fn) override;
-          void async_read_some(Read_Fn fn) override;
-          void async_write(const char *c, size_t size, Write_Fn fn) override;
-          void async_write(const std::vector<char> &v, Write_Fn fn) override;
           void async_shutdown(Shutdown_Fn fn) override;
 
-          void cancel() override;
-          void close() override;
-          bool is_open() const override;
-
         public:
           Base(boost::asio::io_service &io_service, const Options &opts,
           boost::log::sources::severity_logger<Log::Severity> &lg
@@ -94,38 +192,90 @@ namespace Net {
             std::string ca_file;
             std::string ca_path;
             bool        tls1          {true};
+            // empty: don't resume TLS sessions of previous runs
+            std::string session_cache;
+            // seconds
+            unsigned    session_ttl   {86400};
+            // kernel TLS - falls back to the userspace record layer
+            // if OpenSSL or the kernel don't support it
+            bool        ktls          {false};
 
             boost::asio::ssl::context &apply(boost::asio::ssl::context &context) const;
         };
 
-        class Base : public Net::Client::Base {
+        class Base : public Stream_Client<
+                     boost::asio::ssl::stream<boost::asio::ip::tcp::socket> > {
           private:
             const Options             &opts_;
             boost::asio::ssl::context &context_;
-            boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream_;
-            boost::asio::ip::tcp::resolver resolver_;
-
+            std::unique_ptr<Net::SSL::Session_Cache> session_cache_;
+            std::string                    session_key_;
+            boost::asio::steady_timer      handshake_timer_;
+            bool                           handshake_timed_out_ {false};
+
+            static int new_session(::SSL *ssl, SSL_SESSION *session);
+            void store_session(SSL_SESSION *session);
+
+            // With kTLS, OpenSSL directly works on the socket - instead of
+            // the memory BIOs of the asio stream - because only then it can
+            // move the record layer into the kernel. The socket is only
+            // used for waiting on readiness, then.
+            bool direct_ {false};
+            using Direct_Fn = std::function<void(
+                const boost::system::error_code &ec, size_t size)>;
+            struct Direct_Write;
+            boost::system::error_code direct_error(int e);
+            void direct_op(std::function<int(void)> op, Direct_Fn fn);
+            void direct_read(Read_Fn fn);
+            void direct_write(const std::vector<boost::asio::const_buffer> &bs,
+                Write_Fn fn);
+            void direct_write(std::shared_ptr<Direct_Write> w);
+            void log_ktls();
         public:
-            void async_resolve(Resolve_Fn fn) override;
+            // hide the ones of Stream_Client, i.e. with kTLS the
+            // handlers are type-erased
+            template <typename Handler>
+            void async_read_some_impl(Handler handler)
+            {
+              if (direct_)
+                direct_read(Read_Fn(std::move(handler)));
+              else
+                Stream_Client::async_read_some_impl(std::move(handler));
+            }
+            template <typename Buffers, typename Handler>
+            void async_write_impl(const Buffers &bs, Handler handler)
+            {
+              if (direct_)
+                direct_write(std::vector<boost::asio::const_buffer>(
+#if BOOST_VERSION >= 106600
+                      boost::asio::buffer_sequence_begin(bs),
+                      boost::asio::buffer_sequence_end(bs)),
+#else
+                      bs.begin(), bs.end()),
+#endif
+                    Write_Fn(std::move(handler)));
+              else
+                Stream_Client::async_write_impl(bs, std::move(handler));
+            }
 
-            void async_resolve(const boost::asio::ip::tcp::resolver::query &query,
-                Resolve_Fn fn) override;
-            void async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
-                Connect_Fn fn) override;
             void async_handshake(Handshake_Fn fn) override;
             void async_read_some(Read_Fn fn) override;
+            size_t read_some(boost::system::error_code &ec) override;
             void async_write(const char *c, size_t size, Write_Fn fn) override;
             void async_write(const std::vector<char> &v, Write_Fn fn) override;
+            void async_write(const std::vector<boost::asio::const_buffer> &bs,
+                Write_Fn fn) override;
             void async_shutdown(Shutdown_Fn fn) override;
-
-            void cancel() override;
-            void close() override;
-            bool is_open() const override;
           public:
             Base(boost::asio::io_service &io_service,
                 boost::asio::ssl::context &context, const Options &opts,
           boost::log::sources::severity_logger<Log::Severity> &lg
                 );
+            ~Base();
+
+            // after the handshake: true if the kernel decrypts the
+            // received records
+            bool ktls_active();
         };
 
       }
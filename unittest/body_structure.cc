@@ -0,0 +1,344 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <imap/client_parser.h>
+#include <imap/body_structure.h>
+#include <copy/part_filter.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <sstream>
+using namespace std;
+
+using namespace IMAP::Client;
+
+namespace {
+
+  // forwards the parser callbacks like IMAP::Copy::Client does
+  struct Structure_CB : public Callback::Null {
+    Memory::Buffer::Vector      buffer;
+    Memory::Buffer::Vector      tag_buffer;
+    Body_Structure              structure;
+    vector<Body_Part>           roots;
+    IMAP::Copy::Message_Assembler assembler;
+    uint32_t                    uid {0};
+
+    void imap_uid(uint32_t number) override { uid = number; }
+    void imap_data_fetch_end() override
+    {
+      if (structure.complete()) {
+        roots.push_back(structure.root());
+        structure.clear();
+      }
+    }
+    void imap_body_begin() override { structure.begin(); }
+    void imap_body_end() override { structure.end(); }
+    void imap_body_type() override
+    {
+      structure.type(buffer.begin(), buffer.end());
+    }
+    void imap_body_subtype() override
+    {
+      structure.subtype(buffer.begin(), buffer.end());
+    }
+    void imap_body_param_name() override
+    {
+      structure.param_name(buffer.begin(), buffer.end());
+    }
+    void imap_body_param_value() override
+    {
+      structure.param_value(buffer.begin(), buffer.end());
+    }
+    void imap_body_encoding() override
+    {
+      structure.encoding(buffer.begin(), buffer.end());
+    }
+    void imap_body_octets(uint32_t n) override { structure.octets(n); }
+    void imap_body_lines(uint32_t n) override { structure.lines(n); }
+    void imap_body_disposition() override
+    {
+      structure.disposition(buffer.begin(), buffer.end());
+    }
+
+    void imap_body_section_begin() override { assembler.section_begin(); }
+    void imap_section_header() override { assembler.section_header(); }
+    void imap_section_part(uint32_t n) override { assembler.section_part(n); }
+    void imap_section_mime() override { assembler.section_mime(); }
+    void imap_binary_section_begin() override
+    {
+      assembler.binary_section_begin();
+    }
+    void imap_binary_section_end() override
+    {
+      assembler.binary_section_end(buffer.begin(), buffer.end());
+    }
+    void imap_body_section_end() override
+    {
+      assembler.section_end(buffer.begin(), buffer.end());
+    }
+  };
+
+  const char structure_response[] =
+    "* 1 FETCH (UID 5 BODYSTRUCTURE ("
+      "(\"TEXT\" \"PLAIN\" (\"CHARSET\" \"US-ASCII\") NIL NIL \"7BIT\" 1152 23"
+        " NIL NIL NIL NIL (\"x\" (1 \"y\")))"
+      "(\"TEXT\" \"HTML\" (\"CHARSET\" \"UTF-8\") NIL NIL \"QUOTED-PRINTABLE\""
+        " 2000 40 NIL (\"INLINE\" NIL) NIL NIL)"
+      "(\"APPLICATION\" \"PDF\" (\"NAME\" \"report.pdf\") NIL NIL \"BASE64\" 4554"
+        " NIL (\"ATTACHMENT\" (\"FILENAME\" {10}\r\nreport.pdf)) NIL NIL)"
+      "(\"MESSAGE\" \"RFC822\" NIL NIL NIL \"7BIT\" 3000"
+        " (\"Mon, 7 Feb 1994 21:52:25 -0800\" \"subj\""
+        " ((\"Fred\" NIL \"fred\" \"example.org\")) NIL NIL NIL NIL NIL NIL"
+        " \"<id@example.org>\")"
+        " (\"TEXT\" \"PLAIN\" (\"CHARSET\" \"US-ASCII\") NIL NIL \"7BIT\" 100 3)"
+        " 50 NIL NIL NIL NIL)"
+      " \"MIXED\" (\"BOUNDARY\" \"b1\") NIL NIL NIL))\r\n"
+    "* 2 FETCH (UID 6 BODY (\"TEXT\" \"PLAIN\" (\"CHARSET\" \"US-ASCII\")"
+      " NIL NIL \"7BIT\" 3028 92))\r\n"
+    ;
+
+}
+
+BOOST_AUTO_TEST_SUITE( body_structure )
+
+  BOOST_AUTO_TEST_CASE( parse )
+  {
+    Structure_CB cb;
+    Parser p(cb.buffer, cb.tag_buffer, cb);
+    const char *begin = structure_response;
+    const char *end = begin + strlen(begin);
+    // also exercise nested calls across read() boundaries
+    for (const char *i = begin; i < end; i += 7)
+      p.read(i, min(i + 7, end));
+
+    BOOST_REQUIRE_EQUAL(cb.roots.size(), 2u);
+    const Body_Part &r = cb.roots[0];
+    BOOST_CHECK(r.is_multipart());
+    BOOST_CHECK_EQUAL(r.subtype, "mixed");
+    BOOST_REQUIRE(r.parameter("Boundary"));
+    BOOST_CHECK_EQUAL(*r.parameter("Boundary"), "b1");
+    BOOST_CHECK(r.part.empty());
+    BOOST_REQUIRE_EQUAL(r.children.size(), 4u);
+
+    const Body_Part &t = r.children[0];
+    BOOST_CHECK_EQUAL(t.type, "text");
+    BOOST_CHECK_EQUAL(t.subtype, "plain");
+    BOOST_CHECK_EQUAL(t.encoding, "7bit");
+    BOOST_CHECK_EQUAL(t.octets, 1152u);
+    BOOST_CHECK_EQUAL(t.lines, 23u);
+    BOOST_CHECK_EQUAL(t.part_str(), "1");
+    BOOST_REQUIRE(t.parameter("charset"));
+    BOOST_CHECK_EQUAL(*t.parameter("charset"), "US-ASCII");
+
+    const Body_Part &h = r.children[1];
+    BOOST_CHECK_EQUAL(h.subtype, "html");
+    BOOST_CHECK_EQUAL(h.disposition, "inline");
+    BOOST_CHECK(h.disposition_parameters.empty());
+
+    const Body_Part &a = r.children[2];
+    BOOST_CHECK_EQUAL(a.type, "application");
+    BOOST_CHECK_EQUAL(a.octets, 4554u);
+    BOOST_CHECK_EQUAL(a.disposition, "attachment");
+    BOOST_REQUIRE(a.disposition_parameter("filename"));
+    BOOST_CHECK_EQUAL(*a.disposition_parameter("filename"), "report.pdf");
+    BOOST_CHECK_EQUAL(a.parameters.size(), 1u);
+    BOOST_CHECK_EQUAL(a.part_str(), "3");
+
+    const Body_Part &m = r.children[3];
+    BOOST_CHECK(m.is_message());
+    BOOST_CHECK_EQUAL(m.octets, 3000u);
+    BOOST_CHECK_EQUAL(m.lines, 50u);
+    BOOST_REQUIRE_EQUAL(m.children.size(), 1u);
+    BOOST_CHECK_EQUAL(m.children[0].octets, 100u);
+    BOOST_CHECK_EQUAL(m.children[0].part_str(), "4");
+
+    const Body_Part &s = cb.roots[1];
+    BOOST_CHECK(!s.is_multipart());
+    BOOST_CHECK(s.is_text());
+    BOOST_CHECK_EQUAL(s.octets, 3028u);
+    BOOST_CHECK_EQUAL(s.lines, 92u);
+    BOOST_CHECK(s.children.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE( filter )
+  {
+    Structure_CB cb;
+    Parser p(cb.buffer, cb.tag_buffer, cb);
+    p.read(structure_response, structure_response + strlen(structure_response));
+    BOOST_REQUIRE_EQUAL(cb.roots.size(), 2u);
+    const Body_Part &r = cb.roots[0];
+
+    using namespace IMAP::Copy;
+    Part_Filter all;
+    BOOST_CHECK(!all.partial(r));
+
+    Part_Filter text(Part_Policy::TEXT, 0);
+    BOOST_CHECK(text.selected(r.children[0]));
+    BOOST_CHECK(text.selected(r.children[1]));
+    BOOST_CHECK(!text.selected(r.children[2]));
+    BOOST_CHECK(!text.selected(r.children[3]));
+    BOOST_CHECK(text.partial(r));
+    // a single part message is always fetched completely
+    BOOST_CHECK(!text.partial(cb.roots[1]));
+
+    Part_Filter small(Part_Policy::SMALL, 4096);
+    BOOST_CHECK(!small.selected(r.children[2]));
+    BOOST_CHECK(small.selected(r.children[3]));
+    BOOST_CHECK(small.partial(r));
+
+    vector<Fetch_Attribute> atts;
+    text.attributes(r, atts);
+    ostringstream o;
+    for (auto &x : atts)
+      o << x << ' ';
+    BOOST_CHECK_EQUAL(o.str(), "BODY.PEEK[HEADER] BODY.PEEK[1.MIME] BODY.PEEK[1] "
+        "BODY.PEEK[2.MIME] BODY.PEEK[2] ");
+
+    BOOST_CHECK(to_part_policy("small") == Part_Policy::SMALL);
+    BOOST_CHECK_THROW(to_part_policy("big"), std::runtime_error);
+  }
+
+  BOOST_AUTO_TEST_CASE( assemble )
+  {
+    const char structure[] =
+      "* 1 FETCH (UID 7 BODYSTRUCTURE ("
+        "(\"TEXT\" \"PLAIN\" (\"CHARSET\" \"US-ASCII\") NIL NIL \"7BIT\" 7 1)"
+        "(\"IMAGE\" \"PNG\" (\"NAME\" \"x.png\") NIL NIL \"BASE64\" 123456)"
+        " \"MIXED\" (\"BOUNDARY\" \"b1\")))\r\n"
+      ;
+    const char parts[] =
+      "* 1 FETCH (UID 7 FLAGS (\\Seen) BODY[HEADER] {61}\r\n"
+      "Subject: test\r\n"
+      "Content-Type: multipart/mixed; boundary=b1\r\n"
+      "\r\n"
+      " BODY[1.MIME] {46}\r\n"
+      "Content-Type: text/plain; charset=us-ascii\r\n"
+      "\r\n"
+      " BODY[1] {7}\r\n"
+      "Hello\r\n"
+      ")\r\n"
+      ;
+    Structure_CB cb;
+    Parser p(cb.buffer, cb.tag_buffer, cb);
+    p.read(structure, structure + strlen(structure));
+    BOOST_REQUIRE_EQUAL(cb.roots.size(), 1u);
+    p.read(parts, parts + strlen(parts));
+
+    IMAP::Copy::Part_Filter text(IMAP::Copy::Part_Policy::TEXT, 0);
+    string out;
+    cb.assembler.assemble(cb.roots[0], text, out);
+    BOOST_CHECK_EQUAL(out,
+        "Subject: test\n"
+        "Content-Type: multipart/mixed; boundary=b1\n"
+        "\n"
+        "--b1\n"
+        "Content-Type: text/plain; charset=us-ascii\n"
+        "\n"
+        "Hello\n"
+        "\n"
+        "--b1\n"
+        "Content-Type: text/plain; charset=us-ascii\n"
+        "Content-Disposition: inline\n"
+        "X-Imapdl-Omitted: image/png; octets=123456; name=\"x.png\"\n"
+        "\n"
+        "[omitted image/png part of 123456 octets]\n"
+        "\n"
+        "--b1--\n");
+  }
+
+  BOOST_AUTO_TEST_CASE( binary )
+  {
+    const char structure[] =
+      "* 1 FETCH (UID 8 BODYSTRUCTURE ("
+        "(\"TEXT\" \"PLAIN\" NIL NIL NIL \"7BIT\" 7 1)"
+        "(\"APPLICATION\" \"OCTET-STREAM\" NIL NIL NIL \"BASE64\" 18)"
+        " \"MIXED\" (\"BOUNDARY\" \"b2\")))\r\n"
+      ;
+    const char parts[] =
+      "* 1 FETCH (UID 8 BODY[HEADER] {46}\r\n"
+      "Content-Type: multipart/mixed; boundary=b2\r\n"
+      "\r\n"
+      " BODY[1.MIME] {28}\r\n"
+      "Content-Type: text/plain\r\n"
+      "\r\n"
+      " BODY[1] {7}\r\n"
+      "Hello\r\n"
+      " BODY[2.MIME] {77}\r\n"
+      "Content-Type: application/octet-stream\r\n"
+      "Content-Transfer-Encoding: base64\r\n"
+      "\r\n"
+      // literal8 content isn't CRLF converted and may contain NUL
+      " BINARY[2] ~{12}\r\n"
+      "\x00\x01\x02\r\n\xff\xfe\r\n\x00" "AB"
+      ")\r\n"
+      ;
+    Structure_CB cb;
+    Parser p(cb.buffer, cb.tag_buffer, cb);
+    p.read(structure, structure + sizeof(structure) - 1);
+    BOOST_REQUIRE_EQUAL(cb.roots.size(), 1u);
+    const Body_Part &r = cb.roots[0];
+
+    IMAP::Copy::Part_Filter filter;
+    BOOST_CHECK(!filter.partial(r));
+    filter.set_binary(true);
+    BOOST_CHECK(filter.partial(r));
+    vector<Fetch_Attribute> atts;
+    filter.attributes(r, atts);
+    ostringstream o;
+    for (auto &x : atts)
+      o << x << ' ';
+    BOOST_CHECK_EQUAL(o.str(), "BODY.PEEK[HEADER] BODY.PEEK[1.MIME] BODY.PEEK[1] "
+        "BODY.PEEK[2.MIME] BINARY.PEEK[2] ");
+
+    p.read(parts, parts + sizeof(parts) - 1);
+    string out;
+    cb.assembler.assemble(r, filter, out);
+    BOOST_CHECK_EQUAL(out,
+        "Content-Type: multipart/mixed; boundary=b2\n"
+        "\n"
+        "--b2\n"
+        "Content-Type: text/plain\n"
+        "\n"
+        "Hello\n"
+        "\n"
+        "--b2\n"
+        "Content-Type: application/octet-stream\n"
+        "Content-Transfer-Encoding: base64\n"
+        "\n"
+        "AAECDQr//g0KAEFC\n"
+        "\n"
+        "--b2--\n");
+  }
+
+  BOOST_AUTO_TEST_CASE( missing_section )
+  {
+    Structure_CB cb;
+    Parser p(cb.buffer, cb.tag_buffer, cb);
+    p.read(structure_response, structure_response + strlen(structure_response));
+    IMAP::Copy::Part_Filter text(IMAP::Copy::Part_Policy::TEXT, 0);
+    string out;
+    BOOST_CHECK_THROW(cb.assembler.assemble(cb.roots[0], text, out),
+        std::runtime_error);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
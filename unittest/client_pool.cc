@@ -0,0 +1,288 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <net/client_pool.h>
+#include <net/tcp_client.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace asio = boost::asio;
+using endpoint = asio::ip::tcp::endpoint;
+
+BOOST_AUTO_TEST_SUITE( client_pool )
+
+  // accepts connections and just keeps them open
+  class Server {
+    private:
+      asio::io_service        &io_service_;
+      asio::ip::tcp::acceptor acceptor_;
+      vector<shared_ptr<asio::ip::tcp::socket> > sockets_;
+
+      void do_accept()
+      {
+        auto s = make_shared<asio::ip::tcp::socket>(io_service_);
+        acceptor_.async_accept(*s, [this, s](const boost::system::error_code &ec) {
+            if (ec)
+              return;
+            sockets_.push_back(s);
+            do_accept();
+          });
+      }
+    public:
+      Server(asio::io_service &io_service)
+        :
+          io_service_(io_service),
+          acceptor_(io_service,
+              endpoint(asio::ip::address::from_string("127.0.0.1"), 0))
+      {
+        do_accept();
+      }
+      string port() const
+      {
+        return to_string(acceptor_.local_endpoint().port());
+      }
+      size_t accepted() const
+      {
+        return sockets_.size();
+      }
+      void stop()
+      {
+        acceptor_.close();
+      }
+  };
+
+  struct Fixture {
+    asio::io_service io_service;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    Server server {io_service};
+    Net::TCP::Client::Options opts;
+    Net::Client::Pool::Factory factory;
+
+    Fixture()
+    {
+      opts.host = "127.0.0.1";
+      opts.service = server.port();
+      factory = [this]() {
+        return unique_ptr<Net::Client::Base>(
+            new Net::TCP::Client::Base(io_service, opts, lg));
+      };
+    }
+    // runs the io_service for a while, i.e. also with pending timers
+    void run_for(std::chrono::milliseconds d)
+    {
+      asio::steady_timer t(io_service, d);
+      bool done = false;
+      t.async_wait([&done](const boost::system::error_code &) { done = true; });
+      while (!done)
+        io_service.run_one();
+    }
+  };
+
+  BOOST_FIXTURE_TEST_CASE( reuse, Fixture )
+  {
+    Net::Client::Pool pool(io_service, lg, std::chrono::milliseconds(0));
+    Net::Client::Connection *first = nullptr;
+    pool.async_acquire("a", opts.host, factory, [&](Net::Client::Connection &c) {
+        first = &c;
+        BOOST_CHECK(c.client().is_open());
+        BOOST_CHECK(!c.authenticated());
+        c.set_authenticated(true);
+        pool.release(c);
+      });
+    run_for(std::chrono::milliseconds(100));
+    BOOST_REQUIRE(first);
+    BOOST_CHECK(pool.has("a"));
+    BOOST_CHECK(!pool.has("b"));
+
+    Net::Client::Connection *second = nullptr;
+    pool.async_acquire("a", opts.host, factory, [&](Net::Client::Connection &c) {
+        second = &c;
+        BOOST_CHECK(c.authenticated());
+      });
+    run_for(std::chrono::milliseconds(100));
+    BOOST_CHECK(second == first);
+    BOOST_CHECK_EQUAL(server.accepted(), 1u);
+    BOOST_CHECK(!pool.has("a"));
+
+    // a different key gets its own connection
+    Net::Client::Connection *third = nullptr;
+    pool.async_acquire("b", opts.host, factory, [&](Net::Client::Connection &c) {
+        third = &c;
+      });
+    run_for(std::chrono::milliseconds(100));
+    BOOST_CHECK(third && third != first);
+    BOOST_CHECK_EQUAL(server.accepted(), 2u);
+    BOOST_CHECK_EQUAL(pool.size(), 2u);
+
+    pool.discard(*second);
+    pool.discard(*third);
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+    server.stop();
+    io_service.run();
+  }
+
+  BOOST_FIXTURE_TEST_CASE( keepalive, Fixture )
+  {
+    Net::Client::Pool pool(io_service, lg, std::chrono::milliseconds(20));
+    unsigned calls = 0;
+    bool alive = true;
+    pool.set_keepalive([&](Net::Client::Connection &c,
+          Net::Client::Pool::Done_Fn fn) {
+        BOOST_CHECK(c.client().is_open());
+        ++calls;
+        fn(alive);
+      });
+    pool.async_acquire("a", opts.host, factory, [&](Net::Client::Connection &c) {
+        pool.release(c);
+      });
+    run_for(std::chrono::milliseconds(150));
+    BOOST_CHECK_GT(calls, 2u);
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+
+    // an acquired connection isn't kept alive
+    Net::Client::Connection *acquired = nullptr;
+    pool.async_acquire("a", opts.host, factory, [&](Net::Client::Connection &c) {
+        acquired = &c;
+      });
+    run_for(std::chrono::milliseconds(10));
+    BOOST_REQUIRE(acquired);
+    unsigned n = calls;
+    run_for(std::chrono::milliseconds(100));
+    BOOST_CHECK_EQUAL(calls, n);
+
+    // a failed keepalive drops the connection
+    alive = false;
+    pool.release(*acquired);
+    run_for(std::chrono::milliseconds(100));
+    BOOST_CHECK_EQUAL(calls, n + 1);
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+    BOOST_CHECK_EQUAL(server.accepted(), 1u);
+    server.stop();
+    io_service.run();
+  }
+
+  BOOST_FIXTURE_TEST_CASE( spare, Fixture )
+  {
+    Net::Client::Pool pool(io_service, lg, std::chrono::milliseconds(0));
+    unsigned logins = 0;
+    pool.set_login([&](Net::Client::Connection &c,
+          Net::Client::Pool::Done_Fn fn) {
+        BOOST_CHECK(c.client().is_open());
+        ++logins;
+        fn(true);
+      });
+    pool.prepare("a", opts.host, factory);
+    // i.e. there is already one
+    pool.prepare("a", opts.host, factory);
+    BOOST_CHECK(pool.has("a"));
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+
+    // acquired while it's still opened
+    Net::Client::Connection *acquired = nullptr;
+    pool.async_acquire("a", opts.host, factory, [&](Net::Client::Connection &c) {
+        acquired = &c;
+        BOOST_CHECK(c.authenticated());
+      });
+    run_for(std::chrono::milliseconds(100));
+    BOOST_REQUIRE(acquired);
+    BOOST_CHECK_EQUAL(logins, 1u);
+    BOOST_CHECK_EQUAL(server.accepted(), 1u);
+    pool.discard(*acquired);
+    server.stop();
+    io_service.run();
+  }
+
+  BOOST_FIXTURE_TEST_CASE( failed_spare, Fixture )
+  {
+    Net::Client::Pool pool(io_service, lg, std::chrono::milliseconds(0));
+    unsigned logins = 0;
+    pool.set_login([&](Net::Client::Connection &,
+          Net::Client::Pool::Done_Fn fn) {
+        ++logins;
+        fn(false);
+      });
+    pool.prepare("a", opts.host, factory);
+    Net::Client::Connection *acquired = nullptr;
+    pool.async_acquire("a", opts.host, factory, [&](Net::Client::Connection &c) {
+        acquired = &c;
+      });
+    run_for(std::chrono::milliseconds(100));
+    // i.e. the acquire falls back to a new connection
+    BOOST_REQUIRE(acquired);
+    BOOST_CHECK(!acquired->authenticated());
+    BOOST_CHECK_EQUAL(logins, 1u);
+    BOOST_CHECK_EQUAL(server.accepted(), 2u);
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+    pool.discard(*acquired);
+
+    // errors of a spare aren't thrown
+    {
+      asio::ip::tcp::acceptor a(io_service,
+          endpoint(asio::ip::address::from_string("127.0.0.1"), 0));
+      opts.service = to_string(a.local_endpoint().port());
+    }
+    pool.prepare("b", opts.host, factory);
+    BOOST_CHECK_NO_THROW(run_for(std::chrono::milliseconds(100)));
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+    server.stop();
+    io_service.run();
+  }
+
+  BOOST_FIXTURE_TEST_CASE( close, Fixture )
+  {
+    Net::Client::Pool pool(io_service, lg, std::chrono::milliseconds(20));
+    unsigned logouts = 0;
+    pool.set_keepalive([&](Net::Client::Connection &,
+          Net::Client::Pool::Done_Fn fn) {
+        fn(true);
+      });
+    pool.set_logout([&](Net::Client::Connection &c,
+          Net::Client::Pool::Done_Fn fn) {
+        BOOST_CHECK(c.client().is_open());
+        ++logouts;
+        fn(true);
+      });
+    pool.async_acquire("a", opts.host, factory, [&](Net::Client::Connection &c) {
+        pool.release(c);
+      });
+    pool.prepare("b", opts.host, factory);
+    run_for(std::chrono::milliseconds(50));
+    BOOST_CHECK_EQUAL(pool.size(), 2u);
+
+    bool closed = false;
+    pool.async_close([&closed]() { closed = true; });
+    server.stop();
+    // i.e. no timer is left
+    io_service.run();
+    BOOST_CHECK(closed);
+    BOOST_CHECK_EQUAL(logouts, 2u);
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,152 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <net/connector.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+using namespace std;
+namespace asio = boost::asio;
+using endpoint = asio::ip::tcp::endpoint;
+
+BOOST_AUTO_TEST_SUITE( connector )
+
+  static endpoint ep(const char *address, unsigned short port)
+  {
+    return endpoint(asio::ip::address::from_string(address), port);
+  }
+
+  BOOST_AUTO_TEST_CASE( order )
+  {
+    Net::TCP::Connector::forget();
+    Net::TCP::Connector::Endpoints v = {
+      ep("2001:db8::1", 993), ep("2001:db8::2", 993),
+      ep("192.0.2.1", 993), ep("192.0.2.2", 993), ep("192.0.2.3", 993) };
+    {
+      auto r = Net::TCP::Connector::order(v, "example.org 993", 4);
+      Net::TCP::Connector::Endpoints x = {
+        ep("192.0.2.1", 993), ep("2001:db8::1", 993),
+        ep("192.0.2.2", 993), ep("2001:db8::2", 993),
+        ep("192.0.2.3", 993) };
+      BOOST_CHECK(r == x);
+    }
+    {
+      auto r = Net::TCP::Connector::order(v, "example.org 993", 6);
+      Net::TCP::Connector::Endpoints x = {
+        ep("2001:db8::1", 993), ep("192.0.2.1", 993),
+        ep("2001:db8::2", 993), ep("192.0.2.2", 993),
+        ep("192.0.2.3", 993) };
+      BOOST_CHECK(r == x);
+    }
+    Net::TCP::Connector::remember("example.org 993", ep("2001:db8::2", 993));
+    {
+      auto r = Net::TCP::Connector::order(v, "example.org 993", 4);
+      Net::TCP::Connector::Endpoints x = {
+        ep("2001:db8::2", 993), ep("192.0.2.1", 993),
+        ep("2001:db8::1", 993), ep("192.0.2.2", 993),
+        ep("192.0.2.3", 993) };
+      BOOST_CHECK(r == x);
+    }
+    {
+      auto r = Net::TCP::Connector::order(v, "example.org 143", 4);
+      BOOST_CHECK(r.front() == ep("192.0.2.1", 993));
+    }
+    Net::TCP::Connector::forget();
+  }
+
+  BOOST_AUTO_TEST_CASE( fallback )
+  {
+    Net::TCP::Connector::forget();
+    asio::io_service io_service;
+    asio::ip::tcp::acceptor acceptor(io_service, ep("127.0.0.1", 0));
+    unsigned short port = acceptor.local_endpoint().port();
+    // an unused port, i.e. the connect is refused
+    unsigned short closed_port = 0;
+    {
+      asio::ip::tcp::acceptor a(io_service, ep("127.0.0.1", 0));
+      closed_port = a.local_endpoint().port();
+    }
+    Net::TCP::Client::Options opts;
+    opts.host = "localhost";
+    opts.service = "imaps";
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    asio::ip::tcp::socket socket(io_service);
+    boost::system::error_code result = asio::error::would_block;
+    auto c = make_shared<Net::TCP::Connector>(io_service, socket, opts, lg,
+        [&result](const boost::system::error_code &ec) { result = ec; });
+    c->async_connect({ ep("127.0.0.1", closed_port), ep("127.0.0.1", port) });
+    c.reset();
+    io_service.run();
+    BOOST_CHECK(!result);
+    BOOST_REQUIRE(socket.is_open());
+    BOOST_CHECK(socket.remote_endpoint() == ep("127.0.0.1", port));
+
+    auto r = Net::TCP::Connector::order(
+        { ep("127.0.0.1", closed_port), ep("127.0.0.1", port) },
+        "localhost imaps", 4);
+    BOOST_CHECK(r.front() == ep("127.0.0.1", port));
+    Net::TCP::Connector::forget();
+  }
+
+  BOOST_AUTO_TEST_CASE( refused )
+  {
+    asio::io_service io_service;
+    unsigned short closed_port = 0;
+    {
+      asio::ip::tcp::acceptor a(io_service, ep("127.0.0.1", 0));
+      closed_port = a.local_endpoint().port();
+    }
+    Net::TCP::Client::Options opts;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    asio::ip::tcp::socket socket(io_service);
+    boost::system::error_code result;
+    unsigned calls = 0;
+    auto c = make_shared<Net::TCP::Connector>(io_service, socket, opts, lg,
+        [&result, &calls](const boost::system::error_code &ec) {
+          result = ec; ++calls; });
+    c->async_connect({ ep("127.0.0.1", closed_port),
+        ep("127.0.0.1", closed_port) });
+    c.reset();
+    io_service.run();
+    BOOST_CHECK_EQUAL(calls, 1u);
+    BOOST_CHECK(result == asio::error::connection_refused);
+    BOOST_CHECK(!socket.is_open());
+  }
+
+  BOOST_AUTO_TEST_CASE( no_endpoints )
+  {
+    asio::io_service io_service;
+    Net::TCP::Client::Options opts;
+    opts.local_address = "::1";
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    asio::ip::tcp::socket socket(io_service);
+    boost::system::error_code result;
+    auto c = make_shared<Net::TCP::Connector>(io_service, socket, opts, lg,
+        [&result](const boost::system::error_code &ec) { result = ec; });
+    c->async_connect({ ep("127.0.0.1", 993) });
+    c.reset();
+    io_service.run();
+    BOOST_CHECK(result == asio::error::address_family_not_supported);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -24,9 +24,12 @@ namespace fs = boost::filesystem;
 #include <boost/log/sources/record_ostream.hpp>
 
 #include <copy/client.h>
+#include <copy/journal.h>
 #include <copy/options.h>
+#include <copy/runner.h>
 #include <example/server.h>
 #include <net/ssl_util.h>
+#include <net/local_client.h>
 using namespace Net::SSL;
 
 
@@ -34,11 +37,13 @@ using namespace Net::SSL;
 using namespace ixxx;
 
 #include <string>
+#include <set>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <limits>
 #include <memory>
 #include <stdexcept>
 
@@ -164,7 +169,9 @@ class Client_Frontend {
                 static_cast<Log::Severity>(opts.file_severity),
                 opts.logfile)),
         context(boost::asio::ssl::context::sslv23),
-        net_client(use_ssl?
+        net_client(!opts.tunnel.empty()?
+            (static_cast<Net::Client::Base*>(new Net::Pipe::Client::Base(io_service, opts, opts.tunnel, lg)))
+            : use_ssl?
             (static_cast<Net::Client::Base*>(new Net::TCP::SSL::Client::Base(io_service, context, opts, lg)))
             :
             (static_cast<Net::Client::Base*>(new Net::TCP::Client::Base(io_service, opts, lg)))
@@ -372,6 +379,227 @@ static void test_partial_2(bool use_ssl)
   BOOST_CHECK_EQUAL(fs::exists(journal), false);
 }
 
+// two accounts in parallel, each one against its own replay server
+static void test_accounts()
+{
+  string maildir{"tmp/cp/accounts"};
+  string journal{"tmp/accounts.journal"};
+  string tls_cache{"tmp/accounts.tls"};
+  fs::remove_all(maildir);
+  int rc1 = 0;
+  int rc2 = 0;
+  thread replay_server1{Replay_Server{rc1, "cp_basic.trace",
+    "ut_accounts1_server.log", true, 119, 6666}};
+  thread replay_server2{Replay_Server{rc2, "cp_basic.trace",
+    "ut_accounts2_server.log", true, 119, 6667}};
+
+  this_thread::sleep_for(chrono::seconds{1});
+
+  string prefix(ut_prefix());
+  prefix += '/';
+  string configfile{prefix+"cp.conf"};
+  char cconfigfile[128] = {0};
+  strncpy(cconfigfile, configfile.c_str(), sizeof(cconfigfile)-1);
+  char *argv[] = {
+    (char*)"imapcp",
+    (char*)"--account", (char*)"fake",
+    (char*)"--account", (char*)"fake2",
+    (char*)"--threads", (char*)"2",
+    (char*)"--log", (char*)"ut_accounts.log", (char*)"--log_v",
+    (char*)"--maildir", (char*)maildir.c_str(),
+    (char*)"-v6",
+    (char*)"--gwait", (char*)"400",
+    (char*)"--config", cconfigfile,
+    (char*)"--journal", (char*)journal.c_str(),
+    (char*)"--tls_cache", (char*)tls_cache.c_str(),
+    0
+  };
+  int argc = sizeof(argv)/sizeof(char*)-1;
+
+  vector<IMAP::Copy::Options> sessions(IMAP::Copy::parse_sessions(argc, argv));
+  BOOST_REQUIRE_EQUAL(sessions.size(), 2u);
+  // the sessions must not share the journal or the TLS session cache
+  BOOST_CHECK_EQUAL(sessions[0].journal_file, journal + ".fake");
+  BOOST_CHECK_EQUAL(sessions[1].journal_file, journal + ".fake2");
+  BOOST_CHECK_EQUAL(sessions[0].session_cache, tls_cache + ".fake");
+  BOOST_CHECK_EQUAL(sessions[1].session_cache, tls_cache + ".fake2");
+
+  boost::log::sources::severity_logger<Log::Severity> lg(Log::create(
+        static_cast<Log::Severity>(sessions[0].severity),
+        static_cast<Log::Severity>(sessions[0].file_severity),
+        sessions[0].logfile));
+  BOOST_CHECK_EQUAL(IMAP::Copy::run_sessions(sessions, sessions[0].threads, lg),
+      true);
+
+  replay_server1.join();
+  replay_server2.join();
+  BOOST_CHECK_EQUAL(rc1, 0);
+  BOOST_CHECK_EQUAL(rc2, 0);
+
+  // both accounts delivered the same messages into the maildir
+  multiset<string> sums;
+  fs::directory_iterator begin(maildir + "/new");
+  fs::directory_iterator end;
+  for (auto i = begin; i != end; ++i) {
+    string t{(*i).path().generic_string()};
+    string sum{sha256_sum(t)};
+    sums.insert(sum);
+  }
+  array<const char*, 6> ref = {{
+    "6a8c8af376177fad7261d487fac2f5ebfa977820420470841335f6cbe9cb0bfa",
+    "6a8c8af376177fad7261d487fac2f5ebfa977820420470841335f6cbe9cb0bfa",
+    "a456fb5e0073393d887806c852d775b9eb8276c6a0d7ee3b3345bfe1a5e1658a",
+    "a456fb5e0073393d887806c852d775b9eb8276c6a0d7ee3b3345bfe1a5e1658a",
+    "cb48864719e554c91fbf77849d06b8c8b23107eabe932d05cd332ce21f868d5b",
+    "cb48864719e554c91fbf77849d06b8c8b23107eabe932d05cd332ce21f868d5b"
+  }};
+  BOOST_CHECK_EQUAL_COLLECTIONS(sums.begin(), sums.end(), ref.begin(), ref.end());
+}
+
+// several mailboxes over one session - Archive has no EXISTS line, i.e.
+// the count from INBOX must not leak into it
+static void test_mailboxes(bool from_config)
+{
+  string maildir{"tmp/cp/mailboxes"};
+  fs::remove_all(maildir);
+  int rc = 0;
+  thread replay_server{Replay_Server{rc, "mailboxes.trace", "ut_mailboxes_server.log"}};
+
+  this_thread::sleep_for(chrono::seconds{1});
+
+  string prefix(ut_prefix());
+  prefix += '/';
+  string configfile{prefix+"cp.conf"};
+  char cconfigfile[128] = {0};
+  strncpy(cconfigfile, configfile.c_str(), sizeof(cconfigfile)-1);
+  char *array_argv[] = {
+    (char*)"imapcp",
+    (char*)"--account", (char*)"fake_mailboxes",
+    (char*)"--log", (char*)"ut_mailboxes.log", (char*)"--log_v",
+    (char*)"--maildir", (char*)maildir.c_str(),
+    (char*)"-v6",
+    (char*)"--gwait", (char*)"400",
+    (char*)"--config", cconfigfile,
+    0
+  };
+  char *repeat_argv[] = {
+    (char*)"imapcp",
+    (char*)"--account", (char*)"fake_keep",
+    (char*)"--mailbox", (char*)"INBOX",
+    (char*)"--mailbox", (char*)"Archive",
+    (char*)"--log", (char*)"ut_mailboxes.log", (char*)"--log_v",
+    (char*)"--maildir", (char*)maildir.c_str(),
+    (char*)"-v6",
+    (char*)"--gwait", (char*)"400",
+    (char*)"--config", cconfigfile,
+    0
+  };
+  char **argv = from_config ? array_argv : repeat_argv;
+  int argc = from_config ? sizeof(array_argv)/sizeof(char*)-1
+                   : sizeof(repeat_argv)/sizeof(char*)-1;
+
+  {
+    IMAP::Copy::Options opts(argc, argv);
+    array<const char*, 2> ref = {{ "INBOX", "Archive" }};
+    BOOST_CHECK_EQUAL_COLLECTIONS(opts.mailboxes.begin(), opts.mailboxes.end(),
+        ref.begin(), ref.end());
+    BOOST_CHECK_EQUAL(opts.mailbox, "INBOX");
+    BOOST_CHECK_EQUAL(opts.del, false);
+  }
+
+  {
+    Client_Frontend client(argc, argv, true);
+    client.run();
+  }
+
+  replay_server.join();
+  BOOST_CHECK_EQUAL(rc, 0);
+
+  set<string> sums;
+  fs::directory_iterator begin(maildir + "/new");
+  fs::directory_iterator end;
+  for (auto i = begin; i != end; ++i) {
+    string t{(*i).path().generic_string()};
+    string sum{sha256_sum(t)};
+    sums.insert(sum);
+  }
+  array<const char*, 3> ref = {{
+    "6a8c8af376177fad7261d487fac2f5ebfa977820420470841335f6cbe9cb0bfa",
+    "a456fb5e0073393d887806c852d775b9eb8276c6a0d7ee3b3345bfe1a5e1658a",
+    "cb48864719e554c91fbf77849d06b8c8b23107eabe932d05cd332ce21f868d5b"
+  }};
+  BOOST_CHECK_EQUAL_COLLECTIONS(sums.begin(), sums.end(), ref.begin(), ref.end());
+}
+
+// the connection breaks while fetching the second mailbox, thus, the
+// journal must refer to it and not to INBOX, which is already expunged
+static void test_mailboxes_journal()
+{
+  string maildir{"tmp/cp/mailboxes_part"};
+  string journal{"tmp/mailboxes.journal"};
+  fs::remove_all(maildir);
+  fs::remove(journal);
+  int rc = 0;
+  thread replay_server{Replay_Server{rc, "mailboxes_part.trace",
+    "ut_mailboxes_part_server.log", true, 5}};
+
+  this_thread::sleep_for(chrono::seconds{1});
+
+  string prefix(ut_prefix());
+  prefix += '/';
+  string configfile{prefix+"cp.conf"};
+  char cconfigfile[128] = {0};
+  strncpy(cconfigfile, configfile.c_str(), sizeof(cconfigfile)-1);
+  char *argv[] = {
+    (char*)"imapcp",
+    (char*)"--account", (char*)"fake",
+    (char*)"--mailbox", (char*)"INBOX",
+    (char*)"--mailbox", (char*)"Archive",
+    (char*)"--log", (char*)"ut_mailboxes_part.log", (char*)"--log_v",
+    (char*)"--maildir", (char*)maildir.c_str(),
+    (char*)"-v6",
+    (char*)"--gwait", (char*)"400",
+    (char*)"--config", cconfigfile,
+    (char*)"--journal", (char*)journal.c_str(),
+    0
+  };
+  int argc = sizeof(argv)/sizeof(char*)-1;
+  {
+    Client_Frontend client(argc, argv, true);
+    BOOST_CHECK_THROW(client.run(), std::runtime_error);
+  }
+
+  replay_server.join();
+  BOOST_CHECK_EQUAL(rc, 23);
+
+  set<string> sums;
+  fs::directory_iterator begin(maildir + "/new");
+  fs::directory_iterator end;
+  for (auto i = begin; i != end; ++i) {
+    string t{(*i).path().generic_string()};
+    string sum{sha256_sum(t)};
+    sums.insert(sum);
+  }
+  array<const char*, 5> ref = {{
+    "3ed2b804502b2b81f7aa37494401d21fd4314121c52174c68ebf739b7e57abd5",
+    "6a8c8af376177fad7261d487fac2f5ebfa977820420470841335f6cbe9cb0bfa",
+    "a456fb5e0073393d887806c852d775b9eb8276c6a0d7ee3b3345bfe1a5e1658a",
+    "a7f858db4ee1035f87b9df1ecbde7bb9d27da2b8aa044380d5706c3b5784039d",
+    "cb48864719e554c91fbf77849d06b8c8b23107eabe932d05cd332ce21f868d5b"
+  }};
+  BOOST_CHECK_EQUAL_COLLECTIONS(sums.begin(), sums.end(), ref.begin(), ref.end());
+
+  BOOST_REQUIRE_EQUAL(fs::exists(journal), true);
+  IMAP::Copy::Journal j;
+  j.read(journal);
+  BOOST_CHECK_EQUAL(j.mailbox_, "Archive");
+  BOOST_CHECK_EQUAL(j.uidvalidity_, 1204039923u);
+  BOOST_REQUIRE_EQUAL(j.uids_.size(), 1u);
+  BOOST_CHECK_EQUAL(j.uids_.front().first, 23369u);
+  BOOST_CHECK_EQUAL(j.uids_.front().second, 23370u);
+  fs::remove(journal);
+}
+
 static void test_fetch_header()
 {
   bool use_ssl = false;
@@ -482,6 +710,59 @@ R"([MSG] Mailbox: -  INBOX
   BOOST_CHECK_EQUAL(buffer.data(), ref);
 }
 
+// i.e. sizes beyond 4 GiB don't wrap around
+static void test_buffer_sizes()
+{
+  string prefix(ut_prefix());
+  prefix += '/';
+  string configfile{prefix+"cp.conf"};
+  char cconfigfile[128] = {0};
+  strncpy(cconfigfile, configfile.c_str(), sizeof(cconfigfile)-1);
+  char *argv[] = {
+    (char*)"imapcp",
+    (char*)"--account", (char*)"fake",
+    (char*)"--maildir", (char*)"tmp/cp/buffer_sizes",
+    (char*)"--config", cconfigfile,
+    (char*)"--rcvbuf_kb", (char*)"4194304",
+    (char*)"--sndbuf_kb", (char*)"64",
+    0
+  };
+  int argc = sizeof(argv)/sizeof(char*)-1;
+
+  IMAP::Copy::Options opts(argc, argv);
+  BOOST_CHECK_EQUAL(opts.rcvbuf, unsigned(numeric_limits<int>::max()));
+  BOOST_CHECK_EQUAL(opts.sndbuf, 64u * 1024u);
+}
+
+static void test_preauth()
+{
+  string prefix(ut_prefix());
+  prefix += '/';
+  string configfile{prefix+"cp.conf"};
+  char cconfigfile[128] = {0};
+  strncpy(cconfigfile, configfile.c_str(), sizeof(cconfigfile)-1);
+  string tunnel{"sh " + prefix + "preauth.sh"};
+  char *argv[] = {
+    (char*)"imapcp",
+    (char*)"--account", (char*)"fake",
+    (char*)"--log", (char*)"ut_preauth.log", (char*)"--log_v",
+    (char*)"--maildir", (char*)"tmp/cp/preauth",
+    (char*)"-v6",
+    (char*)"--config", cconfigfile,
+    (char*)"--tunnel", (char*)tunnel.c_str(),
+    0
+  };
+  int argc = sizeof(argv)/sizeof(char*)-1;
+
+  fs::remove_all("tmp/cp/preauth");
+  // i.e. the server would answer a LOGIN with BAD
+  {
+    Client_Frontend client(argc, argv, false);
+    BOOST_CHECK_NO_THROW(client.run());
+  }
+  boost::log::core::get()->remove_all_sinks();
+}
+
 struct Log_Fixture {
   boost::log::sources::severity_logger<Log::Severity> lg;
   Log_Fixture()
@@ -533,6 +814,23 @@ BOOST_AUTO_TEST_SUITE( copy )
     boost::log::core::get()->remove_all_sinks();
     test_partial_2(true);
   }
+  BOOST_AUTO_TEST_CASE(accounts)
+  {
+    boost::log::core::get()->remove_all_sinks();
+    test_accounts();
+  }
+  BOOST_AUTO_TEST_CASE(mailboxes)
+  {
+    boost::log::core::get()->remove_all_sinks();
+    test_mailboxes(true);
+    boost::log::core::get()->remove_all_sinks();
+    test_mailboxes(false);
+  }
+  BOOST_AUTO_TEST_CASE(mailboxes_journal)
+  {
+    boost::log::core::get()->remove_all_sinks();
+    test_mailboxes_journal();
+  }
   BOOST_AUTO_TEST_CASE(fetch_header)
   {
     boost::log::core::get()->remove_all_sinks();
@@ -543,5 +841,14 @@ BOOST_AUTO_TEST_SUITE( copy )
     boost::log::core::get()->remove_all_sinks();
     test_list();
   }
+  BOOST_AUTO_TEST_CASE(preauth)
+  {
+    boost::log::core::get()->remove_all_sinks();
+    test_preauth();
+  }
+  BOOST_AUTO_TEST_CASE(buffer_sizes)
+  {
+    test_buffer_sizes();
+  }
 
 BOOST_AUTO_TEST_SUITE_END()
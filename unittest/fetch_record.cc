@@ -0,0 +1,143 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <imap/fetch_record.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+using namespace std;
+
+using namespace IMAP::Client;
+
+BOOST_AUTO_TEST_SUITE( fetch_record )
+
+  BOOST_AUTO_TEST_CASE( arena )
+  {
+    Record::Arena a(64);
+    const char s[] = "Hello World";
+    const char *x = a.copy(s, s + sizeof(s));
+    BOOST_CHECK_EQUAL(string(x), s);
+    uint64_t *v = a.allocate_array<uint64_t>(3);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(v) % alignof(uint64_t), 0u);
+    // larger than a block
+    char *y = static_cast<char*>(a.allocate(100, 1));
+    memset(y, 'x', 100);
+    BOOST_CHECK_EQUAL(a.used(), sizeof(s) + 3 * sizeof(uint64_t) + 100);
+    size_t capacity = a.capacity();
+    a.reset();
+    BOOST_CHECK_EQUAL(a.used(), 0u);
+    a.copy(s, s + sizeof(s));
+    a.allocate(100, 1);
+    // the blocks are reused
+    BOOST_CHECK_EQUAL(a.capacity(), capacity);
+  }
+
+  BOOST_AUTO_TEST_CASE( basic )
+  {
+    const char response[] =
+      "* 1 FETCH (UID 10 RFC822.SIZE 1234 FLAGS (\\Seen $Junk) BODY[] {6}\r\n"
+      "a\r\nbcd)\r\n"
+      "* 2 FETCH (FLAGS () UID 11 BODY[HEADER] \"xyz\" BODY[TEXT] NIL)\r\n"
+      "* 3 EXISTS\r\n"
+      "a004 OK FETCH completed\r\n"
+      ;
+    struct Result {
+      uint32_t number;
+      uint32_t uid;
+      uint32_t size;
+      bool     seen;
+      vector<string> keywords;
+      vector<pair<Record::Section_Kind, string> > sections;
+    };
+    vector<Result> results;
+    unsigned batches = 0;
+    Record::Builder b([&results, &batches](const Record::Batch &batch) {
+          ++batches;
+          for (auto &r : batch) {
+            Result x;
+            x.number = r.number;
+            x.uid    = r.uid;
+            x.size   = r.has_rfc822_size ? r.rfc822_size : 0;
+            x.seen   = r.has(IMAP::Flag::SEEN);
+            for (size_t i = 0; i < r.keyword_count; ++i)
+              x.keywords.emplace_back(r.keywords[i].begin, r.keywords[i].end());
+            for (size_t i = 0; i < r.section_count; ++i)
+              x.sections.emplace_back(r.sections[i].kind,
+                  string(r.sections[i].content.begin,
+                         r.sections[i].content.end()));
+            results.push_back(x);
+          }
+        });
+    Parser p(b.buffer(), b.tag_buffer(), b);
+    p.read(response, response + sizeof(response) - 1);
+
+    BOOST_CHECK_EQUAL(batches, 1u);
+    BOOST_REQUIRE_EQUAL(results.size(), 2u);
+    BOOST_CHECK_EQUAL(results[0].number, 1u);
+    BOOST_CHECK_EQUAL(results[0].uid, 10u);
+    BOOST_CHECK_EQUAL(results[0].size, 1234u);
+    BOOST_CHECK_EQUAL(results[0].seen, true);
+    BOOST_REQUIRE_EQUAL(results[0].keywords.size(), 1u);
+    BOOST_CHECK_EQUAL(results[0].keywords[0], "$Junk");
+    BOOST_REQUIRE_EQUAL(results[0].sections.size(), 1u);
+    BOOST_CHECK(results[0].sections[0].first == Record::Section_Kind::FULL);
+    BOOST_CHECK_EQUAL(results[0].sections[0].second, "a\nbcd");
+
+    BOOST_CHECK_EQUAL(results[1].number, 2u);
+    BOOST_CHECK_EQUAL(results[1].uid, 11u);
+    BOOST_CHECK_EQUAL(results[1].size, 0u);
+    BOOST_CHECK_EQUAL(results[1].seen, false);
+    BOOST_CHECK(results[1].keywords.empty());
+    BOOST_REQUIRE_EQUAL(results[1].sections.size(), 2u);
+    BOOST_CHECK(results[1].sections[0].first == Record::Section_Kind::HEADER);
+    BOOST_CHECK_EQUAL(results[1].sections[0].second, "xyz");
+    BOOST_CHECK(results[1].sections[1].first == Record::Section_Kind::OTHER);
+    BOOST_CHECK_EQUAL(b.arena().used(), 0u);
+  }
+
+  BOOST_AUTO_TEST_CASE( batches )
+  {
+    string response;
+    for (unsigned i = 1; i <= 10; ++i)
+      response += "* " + to_string(i) + " FETCH (UID " + to_string(100 + i)
+        + " FLAGS (\\Seen))\r\n";
+    response += "a004 OK FETCH completed\r\n";
+    vector<size_t> sizes;
+    vector<uint32_t> uids;
+    Record::Builder b([&sizes, &uids](const Record::Batch &batch) {
+          sizes.push_back(batch.size());
+          for (auto &r : batch)
+            uids.push_back(r.uid);
+        }, 4);
+    Parser p(b.buffer(), b.tag_buffer(), b);
+    p.read(response.data(), response.data() + response.size());
+    BOOST_REQUIRE_EQUAL(sizes.size(), 3u);
+    BOOST_CHECK_EQUAL(sizes[0], 4u);
+    BOOST_CHECK_EQUAL(sizes[1], 4u);
+    BOOST_CHECK_EQUAL(sizes[2], 2u);
+    BOOST_REQUIRE_EQUAL(uids.size(), 10u);
+    for (unsigned i = 0; i < 10; ++i)
+      BOOST_CHECK_EQUAL(uids[i], 101 + i);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
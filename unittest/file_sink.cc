@@ -0,0 +1,110 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+#include <copy/file_sink.h>
+
+#include <ixxx/ixxx.h>
+using namespace ixxx;
+
+#include <fcntl.h>
+
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE( file_sink )
+
+  static const char dir[] = "tmp/file_sink";
+
+  static string slurp(const string &filename)
+  {
+    ifstream f(filename, ifstream::in | ifstream::binary);
+    return string(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+  }
+
+  BOOST_AUTO_TEST_CASE( basic )
+  {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    int dir_fd = posix::open(dir, O_RDONLY);
+    IMAP::Copy::File_Sink sink;
+    BOOST_CHECK(!sink.is_open());
+    sink.open(dir_fd, "a");
+    BOOST_CHECK(sink.is_open());
+    const char s[] = "Hello World\n";
+    sink.push(s, 5);
+    sink.push(s + 5, 0);
+    sink.push(s + 5, sizeof(s) - 6);
+    sink.close();
+    BOOST_CHECK(!sink.is_open());
+    BOOST_CHECK_EQUAL(sink.bytes(), sizeof(s) - 1);
+    BOOST_CHECK_EQUAL(slurp(string(dir) + "/a"), s);
+    posix::close(dir_fd);
+  }
+
+  // more slices than a single writev() call accepts
+  BOOST_AUTO_TEST_CASE( many )
+  {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    int dir_fd = posix::open(dir, O_RDONLY);
+    IMAP::Copy::File_Sink sink;
+    sink.open(dir_fd, "b");
+    const char s[] = "xy";
+    string ref;
+    for (unsigned i = 0; i < 5000; ++i) {
+      // not contiguous, thus, each one is a separate slice
+      sink.push(s + i % 2, 1);
+      ref += s[i % 2];
+    }
+    sink.flush();
+    sink.push(s, 2);
+    ref += s;
+    sink.close();
+    BOOST_CHECK_EQUAL(slurp(string(dir) + "/b"), ref);
+    posix::close(dir_fd);
+  }
+
+  BOOST_AUTO_TEST_CASE( exists )
+  {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    int dir_fd = posix::open(dir, O_RDONLY);
+    {
+      IMAP::Copy::File_Sink sink;
+      sink.open(dir_fd, "c");
+      BOOST_CHECK_THROW(sink.open(dir_fd, "d"), std::logic_error);
+      sink.close();
+    }
+    {
+      IMAP::Copy::File_Sink sink;
+      BOOST_CHECK_THROW(sink.open(dir_fd, "c"), std::exception);
+      BOOST_CHECK(!sink.is_open());
+    }
+    posix::close(dir_fd);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,215 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <net/handler_memory.h>
+#include <net/tcp_client.h>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+namespace asio = boost::asio;
+
+// counts the heap allocations of the current thread while enabled
+static thread_local bool counting {false};
+static atomic<size_t> allocations {0};
+
+void *operator new(size_t size)
+{
+  if (counting)
+    ++allocations;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+BOOST_AUTO_TEST_SUITE( handler_memory )
+
+  BOOST_AUTO_TEST_CASE( recycle )
+  {
+    Net::Handler_Memory memory;
+    void *a = memory.allocate(64);
+    BOOST_CHECK(memory.in_use());
+    // in use -> heap
+    void *b = memory.allocate(64);
+    BOOST_CHECK(a != b);
+    memory.deallocate(b);
+    memory.deallocate(a);
+    BOOST_CHECK(!memory.in_use());
+    void *c = memory.allocate(128);
+    BOOST_CHECK_EQUAL(a, c);
+    memory.deallocate(c);
+    // too large -> heap
+    void *d = memory.allocate(64 * 1024);
+    BOOST_CHECK(d != a);
+    memory.deallocate(d);
+  }
+
+  // exposes the handler memory of the client
+  class Probe_Client : public Net::TCP::Client::Base {
+    public:
+      using Net::TCP::Client::Base::Base;
+      bool reading() const { return read_memory_->in_use(); }
+      weak_ptr<Net::Handler_Memory> read_memory() const { return read_memory_; }
+  };
+
+  class Reader {
+    private:
+      Probe_Client &client_;
+      size_t        reads_  {0};
+      // pending reads whose operation was allocated from the heap
+      size_t        misses_ {0};
+      size_t        warmup_;
+      size_t        n_;
+    public:
+      Reader(Probe_Client &client, size_t warmup, size_t n)
+        :
+          client_(client),
+          warmup_(warmup),
+          n_(n)
+      {
+      }
+      void do_read()
+      {
+        client_.async_read_some([this](const boost::system::error_code &ec,
+              size_t)
+            {
+              if (ec)
+                return;
+              ++reads_;
+              if (reads_ == warmup_)
+                counting = true;
+              if (reads_ == warmup_ + n_) {
+                counting = false;
+                client_.close();
+                return;
+              }
+              do_read();
+            });
+        if (!client_.reading())
+          ++misses_;
+      }
+      size_t reads() const { return reads_; }
+      size_t misses() const { return misses_; }
+  };
+
+  BOOST_AUTO_TEST_CASE( steady_state_reads )
+  {
+    asio::io_service io_service;
+    asio::ip::tcp::acceptor acceptor(io_service,
+        asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+    thread server([&acceptor]() {
+        asio::io_service io_service;
+        asio::ip::tcp::socket socket(io_service);
+        acceptor.accept(socket);
+        vector<char> v(64 * 1024, 'x');
+        boost::system::error_code ec;
+        // until the client closes the connection
+        while (!ec)
+          asio::write(socket, asio::buffer(v), ec);
+        });
+
+    Net::TCP::Client::Options opts;
+    opts.host           = "127.0.0.1";
+    opts.service        = to_string(acceptor.local_endpoint().port());
+    // i.e. no buffer resizing
+    opts.min_input_size = 16 * 1024;
+    opts.max_input_size = 16 * 1024;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    Probe_Client client(io_service, opts, lg);
+    Reader reader(client, 64, 1024);
+    allocations = 0;
+    client.async_resolve([&](const boost::system::error_code &ec,
+          asio::ip::tcp::resolver::iterator iterator)
+        {
+          BOOST_REQUIRE(!ec);
+          client.async_connect(iterator,
+              [&](const boost::system::error_code &ec)
+              {
+                BOOST_REQUIRE(!ec);
+                reader.do_read();
+              });
+        });
+    io_service.run();
+    server.join();
+
+    BOOST_CHECK_EQUAL(reader.reads(), 64u + 1024u);
+    BOOST_CHECK_EQUAL(reader.misses(), 0u);
+    BOOST_CHECK_EQUAL(allocations.load(), 0u);
+  }
+
+  // the aborted read is destroyed with the io_service, i.e. after
+  // the client that owns the memory
+  BOOST_AUTO_TEST_CASE( outlives_client )
+  {
+    weak_ptr<Net::Handler_Memory> memory;
+    {
+      asio::io_service io_service;
+      asio::ip::tcp::acceptor acceptor(io_service,
+          asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+      asio::ip::tcp::socket peer(io_service);
+      Net::TCP::Client::Options opts;
+      boost::log::sources::severity_logger<Log::Severity> lg;
+      unique_ptr<Probe_Client> client(new Probe_Client(io_service, opts, lg));
+      client->socket().connect(acceptor.local_endpoint());
+      acceptor.accept(peer);
+      client->async_read_some([](const boost::system::error_code &, size_t) {});
+      BOOST_CHECK(client->reading());
+      memory = client->read_memory();
+      client.reset();
+      BOOST_CHECK(!memory.expired());
+    }
+    BOOST_CHECK(memory.expired());
+  }
+
+  template <typename C, typename = void>
+  struct Has_Read_Impl : false_type {};
+  template <typename C>
+  struct Has_Read_Impl<C, decltype(declval<C&>().async_read_some_impl(
+        declval<Net::Client::Base::Read_Fn>()))> : true_type {};
+
+  // i.e. the concrete handler path of an SSL client can't be reached
+  // via its Stream_Client base, which doesn't know about kTLS
+  BOOST_AUTO_TEST_CASE( ssl_dispatch )
+  {
+    using SSL_Stream = Net::TCP::Stream_Client<
+      asio::ssl::stream<asio::ip::tcp::socket> >;
+    BOOST_CHECK(!Has_Read_Impl<SSL_Stream>::value);
+    BOOST_CHECK(Has_Read_Impl<Net::TCP::SSL::Client::Base>::value);
+    BOOST_CHECK(Has_Read_Impl<Net::TCP::Client::Base>::value);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
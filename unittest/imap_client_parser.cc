@@ -32,6 +32,7 @@ namespace fs = boost::filesystem;
 #include <unordered_set>
 #include <set>
 #include <iostream>
+#include <algorithm>
 
 #include <imap/client_parser.h>
 #include <imap/imap.h>
@@ -39,8 +40,59 @@ namespace fs = boost::filesystem;
 #include <maildir/maildir.h>
 #include <buffer/file.h>
 
+// for instantiating IMAP::Client::Basic_Parser
+#include "client_parser_impl.h"
+
 using namespace std;
 
+namespace {
+
+  // i.e. the callbacks can be inlined by the parser
+  class Final_Handler final : public IMAP::Client::Callback::Null {
+    private:
+      friend class IMAP::Client::Basic_Parser<Final_Handler>;
+    public:
+      Memory::Buffer::Vector buffer;
+      Memory::Buffer::Vector tag_buffer;
+      IMAP::Client::Basic_Parser<Final_Handler> parser;
+      unsigned fetches {0};
+      uint32_t uid     {0};
+      unsigned flags   {0};
+      string   body;
+
+      Final_Handler() : parser(buffer, tag_buffer, *this) {}
+    protected:
+      void imap_data_fetch_begin(uint32_t number) override
+      {
+        ++fetches;
+      }
+      void imap_uid(uint32_t number) override
+      {
+        if (!uid)
+          uid = number;
+      }
+      void imap_flag(IMAP::Flag flag) override
+      {
+        ++flags;
+      }
+      void imap_body_section_inner() override
+      {
+        parser.set_slice_literals(true);
+      }
+      void imap_body_section_end() override
+      {
+        parser.set_slice_literals(false);
+      }
+      void imap_literal_slice(const char *begin, size_t n) override
+      {
+        body.append(begin, n);
+      }
+  };
+
+}
+
+template class IMAP::Client::Basic_Parser<Final_Handler>;
+
 BOOST_AUTO_TEST_SUITE( imap_client_parser )
 
   BOOST_AUTO_TEST_SUITE( basic )
@@ -106,6 +158,43 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(cb.t, 23);
     }
 
+    BOOST_AUTO_TEST_CASE( number )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "A0042 OK fine\r\n"
+        "x12y OK no number\r\n"
+        "7 OK fine\r\n"
+        "A1234567890 OK too long\r\n"
+        "a1b999999999 OK fine\r\n"
+        ;
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        vector<uint32_t> numbers;
+        unsigned ends {0};
+        void imap_tag_number(uint32_t number) override
+        {
+          numbers.push_back(number);
+        }
+        void imap_tagged_status_end(Status c) override
+        {
+          ++ends;
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      const char *begin = response;
+      const char *end = begin + strlen(begin);
+      // split inside the tags
+      for (const char *i = begin; i < end; i += 3)
+        p.read(i, min(i + 3, end));
+      BOOST_CHECK_EQUAL(cb.ends, 5u);
+      vector<uint32_t> ref = { 42, 7, 999999999 };
+      BOOST_CHECK_EQUAL_COLLECTIONS(cb.numbers.begin(), cb.numbers.end(),
+          ref.begin(), ref.end());
+    }
+
     BOOST_AUTO_TEST_CASE( multiple )
     {
       using namespace IMAP::Server::Response;
@@ -233,6 +322,38 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(cb.t, 130);
     }
 
+    BOOST_AUTO_TEST_CASE( preauth )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "* PREAUTH [CAPABILITY IMAP4rev1 UIDPLUS] Logged in as juser\r\n"
+        "* preauth ok\r\n";
+      const char *begin = response;
+      const char *end = begin + strlen(begin);
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        unsigned t { 0 };
+        void imap_capability(Capability c) override
+        {
+          if (c == Capability::UIDPLUS)
+            t+=2;
+        }
+        void imap_untagged_status_end(Status c) override
+        {
+          BOOST_CHECK_EQUAL(c, IMAP::Server::Response::Status::PREAUTH);
+          string s(buffer.begin(), buffer.end());
+          BOOST_CHECK(s == "Logged in as juser" || s == "ok");
+          t+=128;
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      p.read(begin, end);
+      BOOST_CHECK_EQUAL(cb.t, 258);
+    }
+
     BOOST_AUTO_TEST_CASE( exists )
     {
       using namespace IMAP::Server::Response;
@@ -303,6 +424,41 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(cb.t, 0);
     }
 
+    BOOST_AUTO_TEST_CASE( number_split )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "* 4294967295 EXISTS\r\n"
+        "* 1234567 EXISTS\r\n"
+        ;
+      static unsigned number[] = {
+        4294967295u,
+        1234567u
+      };
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        unsigned t { 0 };
+        void imap_data_exists(unsigned n) override
+        {
+          BOOST_REQUIRE(t < 2);
+          BOOST_CHECK_EQUAL(n, number[t]);
+          ++t;
+        }
+      };
+      // the digits are accumulated in the parser state, thus any split works
+      for (size_t k = 1; k < 8; ++k) {
+        CB cb;
+        IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+        const char *begin = response;
+        const char *end = begin + strlen(begin);
+        for (const char *i = begin; i < end; i += k)
+          p.read(i, min(i + k, end));
+        BOOST_CHECK_EQUAL(cb.t, 2);
+      }
+    }
+
     BOOST_AUTO_TEST_CASE( flags )
     {
       using namespace IMAP::Server::Response;
@@ -638,6 +794,93 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(s, ref);
     }
 
+    BOOST_AUTO_TEST_CASE( binary_literal )
+    {
+      const char response[] =
+"* 12 FETCH (BINARY[2] {8}\r\n"
+"a\rb\nc\r\nd BINARY[3] ~{8}\r\n"
+"a\rb\nc\r\nd BODY[1] {9}\r\n"
+"a\rb\r\nc\r\nd)\r\n"
+"a004 OK FETCH completed\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + sizeof(response)-1;
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        vector<string> sections;
+        void imap_binary_section_end() override
+        {
+          sections.emplace_back(buffer.begin(), buffer.end());
+        }
+        void imap_body_section_end() override
+        {
+          sections.emplace_back(buffer.begin(), buffer.end());
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      p.set_convert_crlf(true);
+      p.read(begin, end);
+      BOOST_REQUIRE_EQUAL(cb.sections.size(), 3u);
+      // BINARY content is never converted - regardless of the literal type
+      BOOST_CHECK_EQUAL(cb.sections[0], "a\rb\nc\r\nd");
+      BOOST_CHECK_EQUAL(cb.sections[1], "a\rb\nc\r\nd");
+      BOOST_CHECK_EQUAL(cb.sections[2], "a\rb\nc\nd");
+    }
+
+    BOOST_AUTO_TEST_CASE( convert_last_char )
+    {
+      // i.e. the last character after a converted CRLF or a pending CR
+      const pair<string, string> v[] = {
+        { "x\r\ny", "x\ny"     },
+        { "\r\ny",  "\ny"      },
+        { "x\ry",   "x\ry"     },
+        { "x\r\r",  "x\r\r"    },
+        { "\r",     "\r"       },
+        { "y",      "y"        },
+        { "x\r\n",  "x\n"      }
+      };
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        IMAP::Client::Parser  *parser {nullptr};
+        bool                   slice  {false};
+        string                 body;
+        void imap_body_section_inner() override
+        {
+          parser->set_slice_literals(slice);
+        }
+        void imap_body_section_end() override
+        {
+          parser->set_slice_literals(false);
+          if (!slice)
+            body.assign(buffer.begin(), buffer.end());
+        }
+        void imap_literal_slice(const char *b, size_t n) override
+        {
+          body.append(b, n);
+        }
+      };
+      for (auto slice : { false, true }) {
+        for (auto &i : v) {
+          string response("* 1 FETCH (BODY[] {"
+              + std::to_string(i.first.size()) + "}\r\n"
+              + i.first + ")\r\n"
+              "a004 OK FETCH completed\r\n");
+          CB cb;
+          cb.slice = slice;
+          IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+          p.set_convert_crlf(true);
+          cb.parser = &p;
+          p.read(response.data(), response.data() + response.size());
+          BOOST_CHECK_EQUAL(cb.body, i.second);
+          BOOST_CHECK(p.finished());
+        }
+      }
+    }
+
     BOOST_AUTO_TEST_CASE( header )
     {
       static const char filename[] = "tmp/fetch_header";
@@ -911,6 +1154,198 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(b.data(), ref);
     }
 
+    BOOST_AUTO_TEST_CASE( inline_cr_split )
+    {
+      const char response[] =
+"* 12 FETCH (BODY[HEADER] {40}\r\n"
+"hello\rworld\r\n"
+"\r\n"
+"a somewhat longer line\r\r\n"
+")\r\n"
+"a004 OK FETCH completed\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + sizeof(response)-1;
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Proxy  proxy;
+        Memory::Buffer::Vector tag_buffer;
+        void imap_body_section_inner() override
+        {
+          proxy.set(&buffer);
+        }
+        void imap_body_section_end() override
+        {
+          proxy.set(nullptr);
+        }
+      };
+      const char ref[] = "hello\rworld\n\na somewhat longer line\r\n";
+      // i.e. each CR is once split from its successor
+      for (const char *x = begin + 1; x < end; ++x) {
+        CB cb;
+        IMAP::Client::Parser p(cb.proxy, cb.tag_buffer, cb);
+        p.read(begin, x);
+        p.read(x, end);
+        string s(cb.buffer.begin(), cb.buffer.end());
+        BOOST_CHECK_EQUAL(s, ref);
+        BOOST_CHECK(p.finished());
+      }
+    }
+
+    // the literal converter skips over clean runs in bulk - thus, check
+    // that the result is the same as with the byte-by-byte case (i.e.
+    // chunk size 1) for all kinds of read boundaries
+    BOOST_AUTO_TEST_CASE( body_chunked )
+    {
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Proxy  proxy;
+        Memory::Buffer::Vector tag_buffer;
+        void imap_body_section_inner() override
+        {
+          proxy.set(&buffer);
+        }
+        void imap_body_section_end() override
+        {
+          proxy.set(nullptr);
+        }
+      };
+      using namespace IMAP::Test::Dovecot;
+      string ref(IMAP::Test::Dovecot::fetch);
+      boost::replace_all(ref, "\r\n", "\n");
+      const char *fetch_end = IMAP::Test::Dovecot::fetch
+        + strlen(IMAP::Test::Dovecot::fetch);
+      for (size_t n : { 1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 64, 1000, 4096 }) {
+        CB cb;
+        IMAP::Client::Parser p(cb.proxy, cb.tag_buffer, cb);
+        p.read(prologue, prologue + strlen(prologue));
+        p.read(fetch_head, fetch_head + strlen(fetch_head));
+        const char *x = IMAP::Test::Dovecot::fetch;
+        for (; size_t(fetch_end - x) > n; x += n)
+          p.read(x, x + n);
+        p.read(x, fetch_end);
+        p.read(fetch_tail, fetch_tail + strlen(fetch_tail));
+        p.read(epilogue, epilogue + strlen(epilogue));
+        BOOST_CHECK(p.finished());
+        string s(cb.buffer.begin(), cb.buffer.end());
+        BOOST_CHECK_EQUAL(s.size(), ref.size());
+        BOOST_CHECK(s == ref);
+      }
+    }
+
+    BOOST_AUTO_TEST_CASE( body_slices )
+    {
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        IMAP::Client::Parser  *parser {nullptr};
+        const char            *begin  {nullptr};
+        const char            *end    {nullptr};
+        string                 body;
+        size_t                 slices {0};
+        void imap_body_section_inner() override
+        {
+          parser->set_slice_literals(true);
+        }
+        void imap_body_section_end() override
+        {
+          parser->set_slice_literals(false);
+        }
+        void imap_literal_slice(const char *b, size_t n) override
+        {
+          ++slices;
+          BOOST_REQUIRE(n);
+          // i.e. directly from the input or a converted newline
+          BOOST_CHECK((b >= begin && b + n <= end)
+              || (n == 1 && (*b == '\n' || *b == '\r')));
+          body.append(b, n);
+        }
+      };
+      using namespace IMAP::Test::Dovecot;
+      string ref(IMAP::Test::Dovecot::fetch);
+      boost::replace_all(ref, "\r\n", "\n");
+      const char *fetch_end = IMAP::Test::Dovecot::fetch
+        + strlen(IMAP::Test::Dovecot::fetch);
+      for (size_t n : { 1, 7, 16, 33, 1000, 10000 }) {
+        CB cb;
+        IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+        cb.parser = &p;
+        p.read(prologue, prologue + strlen(prologue));
+        p.read(fetch_head, fetch_head + strlen(fetch_head));
+        const char *x = IMAP::Test::Dovecot::fetch;
+        for (; x < fetch_end; x += n) {
+          cb.begin = x;
+          cb.end = min(x + n, fetch_end);
+          p.read(cb.begin, cb.end);
+        }
+        p.read(fetch_tail, fetch_tail + strlen(fetch_tail));
+        p.read(epilogue, epilogue + strlen(epilogue));
+        BOOST_CHECK(p.finished());
+        BOOST_CHECK_EQUAL(cb.body.size(), ref.size());
+        BOOST_CHECK(cb.body == ref);
+        BOOST_CHECK(cb.slices);
+      }
+    }
+
+    BOOST_AUTO_TEST_CASE( inline_cr_slices )
+    {
+      const char response[] =
+"* 12 FETCH (BODY[HEADER] {15}\r\n"
+"hello\rworld\r\n"
+"\r\n"
+")\r\n"
+"a004 OK FETCH completed\r\n"
+        ;
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        IMAP::Client::Parser  *parser {nullptr};
+        string                 body;
+        bool                   buffer_empty {false};
+        void imap_body_section_inner() override
+        {
+          parser->set_slice_literals(true);
+        }
+        void imap_body_section_end() override
+        {
+          parser->set_slice_literals(false);
+          // the resp-text of the tagged response is buffered later on
+          buffer_empty = buffer.empty();
+        }
+        void imap_literal_slice(const char *b, size_t n) override
+        {
+          body.append(b, n);
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      cb.parser = &p;
+      p.read(response, response + sizeof(response) - 1);
+      BOOST_CHECK_EQUAL(cb.body, "hello\rworld\n\n");
+      BOOST_CHECK(cb.buffer_empty);
+      BOOST_CHECK(p.finished());
+    }
+
+    BOOST_AUTO_TEST_CASE( final_handler )
+    {
+      using namespace IMAP::Test::Dovecot;
+      Final_Handler h;
+      h.parser.read(prologue, prologue + strlen(prologue));
+      h.parser.read(fetch_head, fetch_head + strlen(fetch_head));
+      h.parser.read(IMAP::Test::Dovecot::fetch,
+          IMAP::Test::Dovecot::fetch + strlen(IMAP::Test::Dovecot::fetch));
+      h.parser.read(fetch_tail, fetch_tail + strlen(fetch_tail));
+      h.parser.read(epilogue, epilogue + strlen(epilogue));
+      BOOST_CHECK(h.parser.finished());
+      BOOST_CHECK_EQUAL(h.fetches, 74);
+      BOOST_CHECK_EQUAL(h.uid, 10972);
+      BOOST_CHECK(h.flags);
+      string ref(IMAP::Test::Dovecot::fetch);
+      boost::replace_all(ref, "\r\n", "\n");
+      BOOST_CHECK(h.body == ref);
+    }
+
     BOOST_AUTO_TEST_CASE( body_cyrus )
     {
       static const char filepath[] = "tmp/mdir_cyrus";
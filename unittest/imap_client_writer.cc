@@ -24,6 +24,7 @@
 #include <imap/client_writer.h>
 
 #include <iostream>
+#include <cstring>
 #include <sstream>
 using namespace std;
 
@@ -76,6 +77,23 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
           std::logic_error);
     }
 
+    BOOST_AUTO_TEST_CASE( concurrent )
+    {
+      IMAP::Client::Tag tag;
+
+      string t;
+      tag.next(t, IMAP::Client::Command::NOOP);
+      tag.next(t, IMAP::Client::Command::NOOP, true);
+      BOOST_CHECK_EQUAL(t, "A001");
+      tag.pop(0);
+      // one is still outstanding
+      BOOST_CHECK_THROW(tag.next(t, IMAP::Client::Command::NOOP),
+          std::logic_error);
+      tag.pop(1);
+      tag.next(t, IMAP::Client::Command::NOOP);
+      BOOST_CHECK_EQUAL(t, "A002");
+    }
+
     BOOST_AUTO_TEST_CASE( pop )
     {
       IMAP::Client::Tag tag;
@@ -96,6 +114,61 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
       tag.pop(t);
       BOOST_CHECK_THROW(tag.pop(t), std::logic_error);
     }
+    BOOST_AUTO_TEST_CASE( number )
+    {
+      IMAP::Client::Tag tag("X", 2);
+      string t;
+      for (unsigned i = 0; i < 120; ++i) {
+        uint32_t n = tag.next(t, IMAP::Client::Command::NOOP);
+        BOOST_CHECK_EQUAL(n, i);
+        BOOST_CHECK_EQUAL(tag.last(), i);
+        BOOST_CHECK_EQUAL(tag.number(t.data(), t.data() + t.size()), i);
+        tag.pop(n);
+      }
+      BOOST_CHECK_EQUAL(t, "X119");
+      BOOST_CHECK(tag.has_prefix(t.data(), t.data() + t.size()));
+      const char other[] = "A001";
+      BOOST_CHECK(!tag.has_prefix(other, other + 4));
+      BOOST_CHECK_THROW(tag.number(other, other + 4), std::logic_error);
+      BOOST_CHECK_THROW(IMAP::Client::Tag("A1"), std::logic_error);
+    }
+    BOOST_AUTO_TEST_CASE( leading_zeros )
+    {
+      IMAP::Client::Tag tag("A", 3);
+      auto matches = [&tag](const char *t) {
+        return tag.matches(t, t + strlen(t));
+      };
+      BOOST_CHECK(matches("A000"));
+      BOOST_CHECK(matches("A042"));
+      BOOST_CHECK(matches("A1042"));
+      // the parser reports the trailing digits, i.e. 42 in each case
+      BOOST_CHECK(!matches("A0042"));
+      BOOST_CHECK(!matches("A42"));
+      BOOST_CHECK(!matches("AB042"));
+      BOOST_CHECK(!matches("A0000"));
+      BOOST_CHECK_THROW(tag.number("A0042", "A0042" + 5), std::logic_error);
+      BOOST_CHECK_EQUAL(tag.number("A042", "A042" + 4), 42u);
+    }
+    BOOST_AUTO_TEST_CASE( table )
+    {
+      IMAP::Client::Tag_Table<unsigned> table(4);
+      for (unsigned i = 0; i < 100; ++i)
+        table.insert(1000 + i, i);
+      BOOST_CHECK_EQUAL(table.size(), 100u);
+      BOOST_CHECK_EQUAL(table.capacity(), 128u);
+      for (unsigned i = 0; i < 100; i += 2)
+        BOOST_CHECK(table.erase(1000 + i));
+      BOOST_CHECK(!table.erase(1000));
+      BOOST_CHECK(!table.find(1000));
+      BOOST_REQUIRE(table.find(1099));
+      BOOST_CHECK_EQUAL(*table.find(1099), 99u);
+      BOOST_CHECK_THROW(table.insert(1099, 0), std::logic_error);
+      // not a window
+      table.insert(1u << 20, 1);
+      table.insert(3u << 20, 3);
+      BOOST_CHECK_EQUAL(*table.find(3u << 20), 3u);
+      BOOST_CHECK_EQUAL(table.size(), 52u);
+    }
     BOOST_AUTO_TEST_CASE( pop_throw2 )
     {
       IMAP::Client::Tag tag;
@@ -237,6 +310,39 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
         set.emplace_back(1, 1);
         BOOST_CHECK_THROW(writer.uid_expunge(set, t), std::runtime_error);
       }
+      BOOST_AUTO_TEST_CASE( validate_first )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        writer.set_validation(Validation::FIRST_N, 1);
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        vector<pair<uint32_t, uint32_t> > set;
+        set.emplace_back(1, 1);
+        writer.uid_expunge(set, t);
+        tag.pop(t);
+        // state changes are still tracked
+        writer.examine("INBOX", t);
+        BOOST_CHECK_THROW(writer.expunge(t), std::runtime_error);
+        tag.pop(t);
+        // 2nd UID EXPUNGE isn't validated anymore
+        writer.uid_expunge(set, t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A005 UID EXPUNGE 1\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( validation_str )
+      {
+        using namespace IMAP::Client;
+        BOOST_CHECK(to_validation("first") == Validation::FIRST_N);
+        BOOST_CHECK(to_validation("debug") == Validation::DEBUG);
+        BOOST_CHECK_THROW(to_validation("never"), std::runtime_error);
+        ostringstream o;
+        o << Validation::ALWAYS;
+        BOOST_CHECK_EQUAL(o.str(), "always");
+      }
     BOOST_AUTO_TEST_SUITE_END()
 
     BOOST_AUTO_TEST_SUITE( uid_expunge )
@@ -322,6 +428,44 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
         v.push_back('\0');
         BOOST_CHECK_EQUAL(v.data(), "A002 UID EXPUNGE 2:*,*,*:2\r\n");
       }
+      BOOST_AUTO_TEST_CASE( split )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){
+            v.insert(v.end(), x.begin(), x.end()); });
+        writer.set_max_command_length(24);
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        v.clear();
+        vector<pair<uint32_t, uint32_t> > set = { {1,2}, {4,4}, {6,9}, {11,11} };
+        writer.uid_expunge(set, t);
+        BOOST_CHECK_EQUAL(t, "A004");
+        BOOST_CHECK_EQUAL(writer.tag_numbers().size(), 3u);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),
+            "A002 UID EXPUNGE 1:2,4\r\n"
+            "A003 UID EXPUNGE 6:9\r\n"
+            "A004 UID EXPUNGE 11\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( unlimited )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        vector<pair<uint32_t, uint32_t> > set;
+        for (uint32_t i = 1; i < 10000; i += 2)
+          set.emplace_back(i, i);
+        writer.uid_expunge(set, t);
+        BOOST_CHECK_EQUAL(writer.tag_numbers().size(), 1u);
+        BOOST_CHECK(v.size() > 8192);
+      }
       BOOST_AUTO_TEST_CASE( throw_single )
       {
         vector<char> v;
@@ -428,6 +572,122 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
         BOOST_CHECK_EQUAL(v.data(),"A002 FETCH 1 "
             "(UID BODY[HEADER.FIELDS (date from subject)] BODY[])\r\n");
       }
+      BOOST_AUTO_TEST_CASE( uid_parts )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        vector<pair<uint32_t, uint32_t> > set;
+        set.emplace_back(4711, 4711);
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::BODYSTRUCTURE);
+        atts.emplace_back(Fetch::BODY_PEEK,
+            IMAP::Section_Attribute(IMAP::Section::HEADER));
+        atts.emplace_back(Fetch::BODY_PEEK,
+            IMAP::Section_Attribute(vector<uint32_t>{1, 2}, IMAP::Section::MIME));
+        atts.emplace_back(Fetch::BODY_PEEK,
+            IMAP::Section_Attribute(vector<uint32_t>{2}));
+        writer.uid_fetch(set, atts, t);
+        BOOST_CHECK_EQUAL(t, "A002");
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),"A002 UID FETCH 4711 "
+            "(BODYSTRUCTURE BODY.PEEK[HEADER] BODY.PEEK[1.2.MIME] BODY.PEEK[2])\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( invalid_part )
+      {
+        BOOST_CHECK_THROW(IMAP::Section_Attribute section(IMAP::Section::MIME),
+            std::logic_error);
+        BOOST_CHECK_THROW(IMAP::Section_Attribute section(vector<uint32_t>{1, 0}),
+            std::logic_error);
+      }
+      BOOST_AUTO_TEST_CASE( uid_binary )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        vector<pair<uint32_t, uint32_t> > set;
+        set.emplace_back(23, 23);
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::BINARY_PEEK,
+            IMAP::Section_Attribute(vector<uint32_t>{2, 1}));
+        atts.emplace_back(Fetch::BINARY_SIZE,
+            IMAP::Section_Attribute(vector<uint32_t>{3}));
+        atts.emplace_back(Fetch::BINARY);
+        writer.uid_fetch(set, atts, t);
+        BOOST_CHECK_EQUAL(t, "A002");
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),"A002 UID FETCH 23 "
+            "(BINARY.PEEK[2.1] BINARY.SIZE[3] BINARY[])\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( uid_concurrent )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){
+            v.insert(v.end(), x.begin(), x.end()); });
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        v.clear();
+        vector<pair<uint32_t, uint32_t> > set = { {23, 23} };
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::UID);
+        writer.uid_fetch(set, atts, t);
+        BOOST_CHECK_THROW(writer.uid_fetch(set, atts, t), std::logic_error);
+        set.front() = make_pair(42, 42);
+        writer.uid_fetch(set, atts, t, true);
+        BOOST_CHECK_EQUAL(t, "A003");
+        vector<uint32_t> numbers = { 3 };
+        BOOST_CHECK(writer.tag_numbers() == numbers);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),
+            "A002 UID FETCH 23 UID\r\n"
+            "A003 UID FETCH 42 UID\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( uid_split )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){
+            v.insert(v.end(), x.begin(), x.end()); });
+        writer.set_max_command_length(42);
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        v.clear();
+        vector<pair<uint32_t, uint32_t> > set = { {1,3}, {5,7}, {9,9}, {11,20} };
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::UID);
+        atts.emplace_back(Fetch::BODY_PEEK);
+        writer.uid_fetch(set, atts, t);
+        BOOST_CHECK_EQUAL(t, "A003");
+        vector<uint32_t> numbers = { 2, 3 };
+        BOOST_CHECK(writer.tag_numbers() == numbers);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),
+            "A002 UID FETCH 1:3,5:7 (UID BODY.PEEK[])\r\n"
+            "A003 UID FETCH 9,11:20 (UID BODY.PEEK[])\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( invalid_binary )
+      {
+        using namespace IMAP::Client;
+        BOOST_CHECK_THROW(Fetch_Attribute att(Fetch::BINARY_PEEK,
+              IMAP::Section_Attribute(vector<uint32_t>{1}, IMAP::Section::MIME)),
+            std::logic_error);
+        BOOST_CHECK_THROW(Fetch_Attribute att(Fetch::BINARY,
+              IMAP::Section_Attribute(IMAP::Section::HEADER)),
+            std::logic_error);
+      }
       BOOST_AUTO_TEST_CASE( empty_atts )
       {
         vector<char> v;
@@ -515,6 +775,36 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
         BOOST_CHECK_EQUAL(v.data(), "A002 UID STORE 1 FLAGS.SILENT \\FLAGGED \\ANSWERED\r\n");
       }
 
+      BOOST_AUTO_TEST_CASE( split )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){
+            v.insert(v.end(), x.begin(), x.end()); });
+        writer.set_max_command_length(40);
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        v.clear();
+        vector<pair<uint32_t, uint32_t> > set = { {1,3}, {5,7}, {9,9}, {11,20} };
+        vector<IMAP::Flag> flags;
+        flags.emplace_back(IMAP::Flag::DELETED);
+        writer.uid_store(set, flags, t);
+        BOOST_CHECK_EQUAL(t, "A003");
+        vector<uint32_t> numbers = { 2, 3 };
+        BOOST_CHECK(writer.tag_numbers() == numbers);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),
+            "A002 UID STORE 1:3,5:7 FLAGS \\DELETED\r\n"
+            "A003 UID STORE 9,11:20 FLAGS \\DELETED\r\n");
+        // the parts don't relax the check for the next command
+        BOOST_CHECK_THROW(writer.uid_store(set, flags, t), std::logic_error);
+        tag.pop(3);
+        tag.pop(2);
+        BOOST_CHECK_THROW(tag.pop(2), std::logic_error);
+      }
+
     BOOST_AUTO_TEST_SUITE_END()
 
     BOOST_AUTO_TEST_SUITE(list)
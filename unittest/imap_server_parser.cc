@@ -257,6 +257,39 @@ BOOST_AUTO_TEST_SUITE( imap_server_parser )
       BOOST_CHECK_EQUAL(p.finished(), true);
     }
 
+    BOOST_AUTO_TEST_CASE( preauth )
+    {
+      const char inp[] =
+        "a1 nOOp\r\n"
+        "a2 select INBOX\r\n"
+        "a3 logout\r\n"
+        ;
+      const char *begin = inp;
+      const char *end   = inp + sizeof(inp)-1;
+      using namespace IMAP::Server;
+      Buffer::Proxy proxy;
+      Callback::Null cb;
+      {
+        Parser p(proxy, proxy, cb);
+        BOOST_CHECK_THROW(p.read(begin, end), std::runtime_error);
+      }
+      {
+        Parser p(proxy, proxy, cb);
+        p.set_authenticated();
+        p.read(begin, end);
+        BOOST_CHECK_EQUAL(p.finished(), true);
+        BOOST_CHECK_THROW(p.set_authenticated(), std::logic_error);
+      }
+      {
+        // between two commands of the not authenticated state
+        Parser p(proxy, proxy, cb);
+        p.read(begin, begin + 9);
+        p.set_authenticated();
+        p.read(begin + 9, end);
+        BOOST_CHECK_EQUAL(p.finished(), true);
+      }
+    }
+
   BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <cstring>
+
+#include <imap/literal_scan.h>
+#include "data.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE( literal_scan )
+
+  BOOST_AUTO_TEST_CASE( kernel )
+  {
+    BOOST_TEST_MESSAGE("literal scan kernel: " << IMAP::Literal::kernel_name());
+    BOOST_CHECK(IMAP::Literal::kernel_name());
+  }
+
+  BOOST_AUTO_TEST_CASE( empty )
+  {
+    const char s[] = "x";
+    BOOST_CHECK(IMAP::Literal::find_special(s, s) == s);
+    BOOST_CHECK(IMAP::Literal::find_special_scalar(s, s) == s);
+  }
+
+  BOOST_AUTO_TEST_CASE( clean )
+  {
+    string s(100, 'x');
+    const char *begin = s.data();
+    for (size_t i = 0; i <= s.size(); ++i) {
+      const char *end = begin + i;
+      BOOST_CHECK(IMAP::Literal::find_special(begin, end) == end);
+    }
+  }
+
+  // each special character at each position and for different
+  // alignments of the start
+  BOOST_AUTO_TEST_CASE( position )
+  {
+    for (char c : { '\r', '\n', '\0' }) {
+      for (size_t off = 0; off < 33; ++off) {
+        for (size_t i = off; i < 100; ++i) {
+          string s(100, 'x');
+          s[i] = c;
+          const char *begin = s.data() + off;
+          const char *end = s.data() + s.size();
+          BOOST_CHECK(IMAP::Literal::find_special(begin, end) == s.data() + i);
+          BOOST_CHECK(IMAP::Literal::find_special_scalar(begin, end)
+              == s.data() + i);
+        }
+      }
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( first_of_many )
+  {
+    string s(80, 'y');
+    s[40] = '\n';
+    s[50] = '\r';
+    s[60] = '\0';
+    const char *begin = s.data();
+    const char *end = s.data() + s.size();
+    BOOST_CHECK(IMAP::Literal::find_special(begin, end) == begin + 40);
+    BOOST_CHECK(IMAP::Literal::find_special(begin + 41, end) == begin + 50);
+    BOOST_CHECK(IMAP::Literal::find_special(begin + 51, end) == begin + 60);
+    BOOST_CHECK(IMAP::Literal::find_special(begin + 61, end) == end);
+  }
+
+  BOOST_AUTO_TEST_CASE( high_bit )
+  {
+    string s(64, '\x8d');
+    s += '\r';
+    const char *begin = s.data();
+    const char *end = s.data() + s.size();
+    BOOST_CHECK(IMAP::Literal::find_special(begin, end) == end - 1);
+  }
+
+  BOOST_AUTO_TEST_CASE( message )
+  {
+    const char *begin = IMAP::Test::Dovecot::fetch;
+    const char *end = begin + strlen(begin);
+    for (const char *p = begin; p < end; ++p) {
+      BOOST_REQUIRE(IMAP::Literal::find_special(p, end)
+          == IMAP::Literal::find_special_scalar(p, end));
+    }
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
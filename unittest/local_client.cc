@@ -0,0 +1,94 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <net/local_client.h>
+
+#include <boost/asio/io_service.hpp>
+
+#include <chrono>
+
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+using namespace std;
+namespace asio = boost::asio;
+
+BOOST_AUTO_TEST_SUITE( local_client )
+
+  static pid_t spawn(const char *command)
+  {
+    const char *argv[] = { "/bin/sh", "-c", command, nullptr };
+    pid_t pid = 0;
+    int r = posix_spawn(&pid, "/bin/sh", nullptr, nullptr,
+        const_cast<char * const *>(argv), environ);
+    BOOST_REQUIRE_EQUAL(r, 0);
+    return pid;
+  }
+
+  static bool reaped(pid_t pid)
+  {
+    int status = 0;
+    return waitpid(pid, &status, WNOHANG) == -1 && errno == ECHILD;
+  }
+
+  BOOST_AUTO_TEST_CASE( reap_exited )
+  {
+    asio::io_service io_service;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    pid_t pid = spawn("exit 3");
+    make_shared<Net::Pipe::Reaper>(io_service, pid, lg)->async_reap();
+    io_service.run();
+    BOOST_CHECK(reaped(pid));
+  }
+
+  BOOST_AUTO_TEST_CASE( reap_escalates )
+  {
+    asio::io_service io_service;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    // i.e. the ignored SIGTERM is inherited by sleep
+    pid_t pid = spawn("trap '' TERM; exec sleep 30");
+    auto start = chrono::steady_clock::now();
+    make_shared<Net::Pipe::Reaper>(io_service, pid, lg,
+        chrono::milliseconds(50))->async_reap();
+    io_service.run();
+    auto waited = chrono::steady_clock::now() - start;
+    BOOST_CHECK(reaped(pid));
+    BOOST_CHECK(waited >= chrono::milliseconds(100));
+    BOOST_CHECK(waited < chrono::seconds(10));
+  }
+
+  BOOST_AUTO_TEST_CASE( reap_on_destruction )
+  {
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    pid_t pid = spawn("exec sleep 30");
+    {
+      asio::io_service io_service;
+      make_shared<Net::Pipe::Reaper>(io_service, pid, lg)->async_reap();
+      // i.e. the io_service isn't run
+    }
+    BOOST_CHECK(reaped(pid));
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
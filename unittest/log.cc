@@ -0,0 +1,98 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <log/log.h>
+
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+// INSANE, i.e. console sinks of other tests don't print them
+static void log_records(size_t n)
+{
+  boost::log::sources::severity_logger<Log::Severity> lg;
+  for (size_t i = 0; i < n; ++i)
+    BOOST_LOG_SEV(lg, Log::INSANE) << "record " << i;
+}
+
+BOOST_AUTO_TEST_SUITE( log_async )
+
+  BOOST_AUTO_TEST_CASE( overflow )
+  {
+    BOOST_CHECK(Log::to_overflow("drop") == Log::Overflow::DROP);
+    BOOST_CHECK(Log::to_overflow("block") == Log::Overflow::BLOCK);
+    BOOST_CHECK(Log::to_overflow("count") == Log::Overflow::COUNT);
+    BOOST_CHECK_THROW(Log::to_overflow("wait"), std::runtime_error);
+  }
+
+  BOOST_AUTO_TEST_CASE( block )
+  {
+    const char filename[] = "tmp/log_async_block.log";
+    fs::create_directory("tmp");
+    fs::remove(filename);
+    Log::setup_async(Log::Overflow::BLOCK);
+    Log::setup_file(Log::INSANE, filename);
+    log_records(20000);
+    Log::stop();
+
+    ifstream f(filename);
+    string line;
+    size_t n = 0;
+    for (; getline(f, line); ++n)
+      ;
+    BOOST_CHECK_EQUAL(n, 20000u);
+    BOOST_CHECK(line.find("record 19999") != string::npos);
+  }
+
+  BOOST_AUTO_TEST_CASE( count )
+  {
+    const char filename[] = "tmp/log_async_count.log";
+    fs::create_directory("tmp");
+    fs::remove(filename);
+    Log::setup_async(Log::Overflow::COUNT);
+    Log::setup_file(Log::INSANE, filename);
+    log_records(100000);
+    Log::stop();
+
+    // either all records are written or the last line
+    // reports the dropped ones
+    ifstream f(filename);
+    string line;
+    size_t n = 0;
+    size_t dropped = 0;
+    while (getline(f, line)) {
+      auto i = line.find("Dropped ");
+      if (i == string::npos)
+        ++n;
+      else
+        dropped = stoul(line.substr(i + 8));
+    }
+    BOOST_CHECK_EQUAL(n + dropped, 100000u);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
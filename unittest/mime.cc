@@ -22,6 +22,7 @@
 #include <boost/algorithm/hex.hpp>
 
 #include <mime/base64_decoder.h>
+#include <mime/base64_encoder.h>
 #include <mime/q_decoder.h>
 #include <mime/header_decoder.h>
 
@@ -34,6 +35,67 @@ BOOST_AUTO_TEST_SUITE(mime)
 
   BOOST_AUTO_TEST_SUITE(base64)
 
+    BOOST_AUTO_TEST_SUITE(encoder)
+
+      BOOST_AUTO_TEST_CASE(basic)
+      {
+        const char inp[] = "hello world\n";
+        string s;
+        MIME::Base64::encode(inp, inp + sizeof(inp) - 1, s);
+        BOOST_CHECK_EQUAL(s, "aGVsbG8gd29ybGQK\r\n");
+      }
+      BOOST_AUTO_TEST_CASE(pad)
+      {
+        string s;
+        const char inp[] = "foob";
+        MIME::Base64::encode(inp, inp + 4, s, 0);
+        BOOST_CHECK_EQUAL(s, "Zm9vYg==");
+        s.clear();
+        MIME::Base64::encode(inp, inp + 2, s, 0);
+        BOOST_CHECK_EQUAL(s, "Zm8=");
+        s.clear();
+        MIME::Base64::encode(inp, inp, s);
+        BOOST_CHECK(s.empty());
+      }
+      BOOST_AUTO_TEST_CASE(wrap)
+      {
+        string inp(100, '\xff');
+        string s("prefix");
+        MIME::Base64::encode(inp.data(), inp.data() + inp.size(), s, 64, false);
+        BOOST_CHECK_EQUAL(s.size(), 6u + 136u + 3u);
+        BOOST_CHECK_EQUAL(s.substr(0, 6), "prefix");
+        BOOST_CHECK_EQUAL(s[6 + 64], '\n');
+        BOOST_CHECK_EQUAL(s[6 + 2 * 65 - 1], '\n');
+        BOOST_CHECK_EQUAL(s.substr(s.size() - 3), "==\n");
+      }
+      BOOST_AUTO_TEST_CASE(line_length)
+      {
+        string inp(1000, 'x');
+        for (size_t l : { 76, 72, 64, 60, 4 }) {
+          string s;
+          MIME::Base64::encode(inp.data(), inp.data() + inp.size(), s, l);
+          BOOST_CHECK_EQUAL(MIME::Base64::line_length(inp.size(), s.size()), l);
+        }
+        // inconsistent sizes
+        BOOST_CHECK_EQUAL(MIME::Base64::line_length(1000, 10), 76u);
+        BOOST_CHECK_EQUAL(MIME::Base64::line_length(1000, 1337), 76u);
+      }
+      BOOST_AUTO_TEST_CASE(roundtrip)
+      {
+        string inp;
+        for (unsigned i = 0; i < 1024; ++i)
+          inp.push_back(char(i * 7));
+        string s;
+        // the decoder is for encoded words, i.e. without line breaks
+        MIME::Base64::encode(inp.data(), inp.data() + inp.size(), s, 0);
+        Buffer::Vector v;
+        MIME::Base64::Decoder d(v);
+        d.read(s.data(), s.data() + s.size());
+        BOOST_CHECK_EQUAL(string(v.begin(), v.end()), inp);
+      }
+
+    BOOST_AUTO_TEST_SUITE_END()
+
     BOOST_AUTO_TEST_SUITE(decoder)
 
       BOOST_AUTO_TEST_CASE(basic)
@@ -0,0 +1,24 @@
+#!/bin/sh
+
+# Minimal pre-authenticated IMAP server on stdin/stdout for testing
+# the tunnel transport - it answers LOGIN with BAD, i.e. the client
+# must not send it after the PREAUTH greeting.
+
+printf '* PREAUTH [CAPABILITY IMAP4rev1 UIDPLUS] ready\r\n'
+while read -r tag cmd rest; do
+  case "$cmd" in
+    LOGIN*)
+      printf '%s BAD already authenticated\r\n' "$tag"
+      ;;
+    SELECT*)
+      printf '* 0 EXISTS\r\n* 0 RECENT\r\n%s OK [READ-WRITE] done\r\n' "$tag"
+      ;;
+    LOGOUT*)
+      printf '* BYE bye\r\n%s OK done\r\n' "$tag"
+      exit 0
+      ;;
+    *)
+      printf '%s OK done\r\n' "$tag"
+      ;;
+  esac
+done
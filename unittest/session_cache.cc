@@ -0,0 +1,121 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+#include <net/session_cache.h>
+
+#include <openssl/ssl.h>
+
+#include <fstream>
+#include <string>
+#include <time.h>
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE( session_cache )
+
+  static const char dir[] = "tmp/session_cache";
+
+  static SSL_SESSION *create_session(unsigned char id, long timeout)
+  {
+    SSL_SESSION *s = SSL_SESSION_new();
+    unsigned char sid[32] = { id };
+    SSL_SESSION_set1_id(s, sid, sizeof sid);
+    unsigned char key[48] = { 23 };
+    SSL_SESSION_set1_master_key(s, key, sizeof key);
+    SSL_SESSION_set_protocol_version(s, TLS1_2_VERSION);
+    // i2d_SSL_SESSION() needs a cipher
+    SSL_CTX *ctx = SSL_CTX_new(SSLv23_client_method());
+    ::SSL *ssl = SSL_new(ctx);
+    const unsigned char suite[] = { 0xc0, 0x2f };
+    SSL_SESSION_set_cipher(s, SSL_CIPHER_find(ssl, suite));
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    SSL_SESSION_set_time(s, time(nullptr));
+    SSL_SESSION_set_timeout(s, timeout);
+    return s;
+  }
+
+  static unsigned char session_id(SSL_SESSION *s)
+  {
+    unsigned n = 0;
+    const unsigned char *id = SSL_SESSION_get_id(s, &n);
+    BOOST_REQUIRE(n);
+    return id[0];
+  }
+
+  BOOST_AUTO_TEST_CASE( persist )
+  {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    string filename = string(dir) + "/a.tls";
+    {
+      Net::SSL::Session_Cache cache(filename, 3600);
+      BOOST_CHECK(!cache.get("example.org 993"));
+      SSL_SESSION *s = create_session(42, 3600);
+      cache.put("example.org 993", s);
+      SSL_SESSION_free(s);
+      s = create_session(43, 3600);
+      cache.put("example.org 143", s);
+      SSL_SESSION_free(s);
+    }
+    BOOST_CHECK(fs::status(filename).permissions() ==
+        (fs::owner_read | fs::owner_write));
+    Net::SSL::Session_Cache cache(filename, 3600);
+    SSL_SESSION *s = cache.get("example.org 993");
+    BOOST_REQUIRE(s);
+    BOOST_CHECK_EQUAL(session_id(s), 42u);
+    SSL_SESSION_free(s);
+    s = cache.get("example.org 143");
+    BOOST_REQUIRE(s);
+    BOOST_CHECK_EQUAL(session_id(s), 43u);
+    SSL_SESSION_free(s);
+    BOOST_CHECK(!cache.get("example.org 995"));
+  }
+
+  BOOST_AUTO_TEST_CASE( expired )
+  {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    string filename = string(dir) + "/b.tls";
+    Net::SSL::Session_Cache cache(filename, 3600);
+    // server side timeout already reached
+    SSL_SESSION *s = create_session(42, 0);
+    cache.put("example.org 993", s);
+    SSL_SESSION_free(s);
+    BOOST_CHECK(!cache.get("example.org 993"));
+  }
+
+  BOOST_AUTO_TEST_CASE( corrupt )
+  {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    string filename = string(dir) + "/c.tls";
+    {
+      ofstream f(filename);
+      f << "garbage\n" << (time(nullptr) + 100) << " zz example.org 993\n";
+    }
+    Net::SSL::Session_Cache cache(filename, 3600);
+    BOOST_CHECK(!cache.get("example.org 993"));
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
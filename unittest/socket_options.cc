@@ -0,0 +1,110 @@
+// Copyright 2015, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <net/socket_options.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <limits>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace std;
+namespace asio = boost::asio;
+
+BOOST_AUTO_TEST_SUITE( socket_options )
+
+  BOOST_AUTO_TEST_CASE( apply )
+  {
+    asio::io_service io_service;
+    asio::ip::tcp::socket socket(io_service);
+    socket.open(asio::ip::tcp::v4());
+    Net::TCP::Client::Options opts;
+    opts.rcvbuf = 64 * 1024;
+    opts.keepalive_idle = 42;
+    opts.keepalive_count = 3;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    Net::TCP::apply_socket_options(socket, opts, lg);
+
+    asio::socket_base::receive_buffer_size rcvbuf;
+    socket.get_option(rcvbuf);
+    // e.g. Linux doubles it
+    BOOST_CHECK(rcvbuf.value() >= 64 * 1024);
+    asio::ip::tcp::no_delay nodelay;
+    socket.get_option(nodelay);
+    BOOST_CHECK(nodelay.value());
+    asio::socket_base::keep_alive keepalive;
+    socket.get_option(keepalive);
+    BOOST_CHECK(keepalive.value());
+#ifdef TCP_KEEPIDLE
+    Net::TCP::Integer_Option<IPPROTO_TCP, TCP_KEEPIDLE> idle;
+    socket.get_option(idle);
+    BOOST_CHECK_EQUAL(idle.value(), 42);
+    Net::TCP::Integer_Option<IPPROTO_TCP, TCP_KEEPCNT> count;
+    socket.get_option(count);
+    BOOST_CHECK_EQUAL(count.value(), 3);
+#endif
+  }
+
+  BOOST_AUTO_TEST_CASE( defaults )
+  {
+    asio::io_service io_service;
+    asio::ip::tcp::socket socket(io_service);
+    socket.open(asio::ip::tcp::v4());
+    Net::TCP::Client::Options opts;
+    opts.nodelay = false;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    Net::TCP::apply_socket_options(socket, opts, lg);
+
+    asio::ip::tcp::no_delay nodelay;
+    socket.get_option(nodelay);
+    BOOST_CHECK(!nodelay.value());
+    asio::socket_base::keep_alive keepalive;
+    socket.get_option(keepalive);
+    BOOST_CHECK(!keepalive.value());
+  }
+
+  // i.e. values that don't fit into an int are capped instead of
+  // wrapping around to a negative size
+  BOOST_AUTO_TEST_CASE( large_buffer )
+  {
+    asio::io_service io_service;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    int values[2] = {0};
+    unsigned sizes[2] = { numeric_limits<unsigned>::max(),
+      unsigned(numeric_limits<int>::max()) };
+    for (unsigned i = 0; i < 2; ++i) {
+      asio::ip::tcp::socket socket(io_service);
+      socket.open(asio::ip::tcp::v4());
+      Net::TCP::Client::Options opts;
+      opts.rcvbuf = sizes[i];
+      Net::TCP::apply_socket_options(socket, opts, lg);
+      asio::socket_base::receive_buffer_size rcvbuf;
+      socket.get_option(rcvbuf);
+      values[i] = rcvbuf.value();
+    }
+    BOOST_CHECK_EQUAL(values[0], values[1]);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()